@@ -40,6 +40,8 @@
 
 #include "stage.h"
 
+#include <chrono>
+
 namespace moveit { namespace task_constructor {
 
 class ContainerBasePrivate;
@@ -87,6 +89,7 @@ public:
 	PRIVATE_CLASS(SerialContainer)
 	SerialContainer(const std::string& name = "serial container");
 
+	void reset() override;
 	void init(const moveit::core::RobotModelConstPtr& robot_model) override;
 
 	bool canCompute() const override;
@@ -156,6 +159,7 @@ protected:
 /** Plan for different alternatives in parallel.
  *
  * Solution of all children are reported - sorted by cost.
+ * With parallel planning enabled (Task::setNumThreads()), children are computed concurrently.
  */
 class Alternatives : public ParallelContainerBase
 {
@@ -174,13 +178,29 @@ public:
  * Try to find feasible solutions using first child. Only if this fails,
  * proceed to the next child trying an alternative planning strategy.
  * All solutions of the last active child are reported.
+ *
+ * In speculative mode (finite speculation_delay), lower-ranked children are computed concurrently
+ * to the active one: the i-th child starts i * speculation_delay seconds after planning started.
+ * Their solutions are held back until all higher-ranked children failed. As soon as a child
+ * found a solution, all lower-ranked children are stopped.
  */
 class Fallbacks : public ParallelContainerBase
 {
-	mutable Stage* active_child_ = nullptr;
+	Stage* active_child_ = nullptr;  // highest-ranked child, whose solutions are reported
+	const Stage* limit_ = nullptr;  // lowest-ranked child still considered (speculative mode)
+	std::chrono::steady_clock::time_point start_;  // start of planning
+	bool started_ = false;
+
+	// is child due to be computed speculatively?
+	bool speculate(const Stage* child, size_t rank) const;
+	// advance active_child_ to next child that can compute or has pending solutions
+	void activateNext();
 
 public:
-	Fallbacks(const std::string &name = "fallbacks") : ParallelContainerBase(name) {}
+	Fallbacks(const std::string &name = "fallbacks");
+
+	/// start lower-ranked children after this delay [s] each, infinity disables speculation
+	void setSpeculationDelay(double delay) { setProperty("speculation_delay", delay); }
 
 	void reset() override;
 	void init(const moveit::core::RobotModelConstPtr& robot_model) override;
@@ -192,13 +212,21 @@ public:
 
 
 class MergerPrivate;
-/** Plan for different sub tasks in parallel and finally merge all sub solutions into a single trajectory */
+/** Plan for different sub tasks in parallel and finally merge all sub solutions into a single trajectory
+ *
+ * With parallel planning enabled (Task::setNumThreads()), children are computed concurrently.
+ * Combinations of sub solutions are merged in order of their summed cost. Pairs of sub solutions
+ * found colliding with each other are remembered and all combinations containing them are skipped.
+ */
 class Merger : public ParallelContainerBase
 {
 public:
 	PRIVATE_CLASS(Merger)
 	Merger(const std::string &name = "merger");
 
+	/// limit number of merged combinations per source state (0: unlimited)
+	void setMaxMerges(uint32_t max_merges) { setProperty("max_merges", max_merges); }
+
 	void reset() override;
 	void init(const core::RobotModelConstPtr &robot_model) override;
 	bool canCompute() const override;
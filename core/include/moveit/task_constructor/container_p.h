@@ -43,6 +43,9 @@
 #include "stage_p.h"
 
 #include <map>
+#include <set>
+#include <deque>
+#include <unordered_map>
 #include <climits>
 
 namespace moveit { namespace core {
@@ -106,9 +109,18 @@ public:
 	bool canCompute() const override;
 	void compute() override;
 
+	/** compute all children that can compute
+	 *
+	 * When planning in parallel, children are computed concurrently by the task's scheduler.
+	 * Otherwise, they are computed one after the other. */
+	void computeChildren();
+
 	InterfacePtr pendingBackward() const { return pending_backward_; }
 	InterfacePtr pendingForward() const { return pending_forward_; }
 
+	/// forget the mapping of a child's state, which is going to be freed
+	void unmapInternalState(const InterfaceState* internal) { internal_to_external_.erase(internal); }
+
 protected:
 	ContainerBasePrivate(ContainerBase *me, const std::string &name);
 
@@ -173,7 +185,55 @@ public:
 	// validate connectivity of chain
 	void validateConnectivity() const override;
 
+	/// update path summaries and state priorities, and schedule enumeration of full paths through solution
+	void onNewSolution(const SolutionBase& solution);
+	/// are there any full solution paths left to announce?
+	bool hasPendingPaths() const { return !pending_paths_.empty(); }
+	/// announce the cheapest full solution paths not yet announced, i.e. all those
+	/// not more expensive than the cheapest pending partial path
+	void liftSolutions();
+	/// forget all solution paths
+	void resetPaths();
+
 private:
+	/** Summary of the best partial solution paths through an internal state.
+	 *
+	 * best[BACKWARD] describes the best path arriving at the state (depth + accumulated cost),
+	 * best[FORWARD] the best path leaving from it. Sub solutions are only added, never removed.
+	 * Hence, both summaries can be updated incrementally, visiting only those states,
+	 * whose summary actually changes. */
+	struct StateSummary {
+		InterfaceState::Priority best[2];
+		bool valid[2] = {false, false};
+	};
+	/** Partial solution path, explored best-first (A*) towards a full path.
+	 *
+	 * A path seeded from a new solution may only be extended with solutions that were announced
+	 * earlier (as defined by their sequence number). Thus, every full path is enumerated exactly once:
+	 * when its latest solution arrives. */
+	struct SolutionPath {
+		std::deque<const SolutionBase*> trace;
+		size_t latest;  // sequence number of the solution that seeded this path
+		size_t missing_before, missing_after;  // number of solutions missing to reach start / end
+		double cost;  // accumulated cost of trace
+		double estimate;  // cost + lower bound on the cost to complete trace
+
+		bool operator<(const SolutionPath& other) const { return estimate < other.estimate; }
+	};
+
+	/// summary of best path through state in direction dir (lazily computed)
+	template <Interface::Direction dir>
+	const InterfaceState::Priority& summary(const InterfaceState* state);
+	/// (re)compute summary of state in direction dir, returns true if it has changed
+	template <Interface::Direction dir>
+	bool updateSummary(const InterfaceState* state);
+	/// update summaries in direction dir starting from state, as long as they are changing
+	template <Interface::Direction dir>
+	void propagate(const InterfaceState* state, std::vector<const InterfaceState*>& touched);
+	/// extend path by one solution in direction dir (in all possible ways)
+	template <Interface::Direction dir>
+	void extend(const SolutionPath& path);
+
 	// connect cur stage to its predecessor and successor
 	bool connect(container_type::const_iterator cur);
 
@@ -190,6 +250,12 @@ private:
 
 private:
 	InterfaceFlags required_interface_;
+
+	std::unordered_map<const InterfaceState*, StateSummary> summaries_;
+	// sequence numbers of children's solutions in order of their arrival
+	std::unordered_map<const SolutionBase*, size_t> sequence_;
+	// partial solution paths, sorted by estimated cost of their completion
+	ordered<SolutionPath> pending_paths_;
 };
 PIMPL_FUNCTIONS(SerialContainer)
 
@@ -212,6 +278,9 @@ public:
 	{}
 	void fillMessage(moveit_task_constructor_msgs::Solution &solution,
 	                 Introspection* introspection = nullptr) const override;
+	void visitSubTrajectories(const std::function<void(const SubTrajectory&)>& visitor) const override {
+		wrapped_->visitSubTrajectories(visitor);
+	}
 
 private:
 	const SolutionBase* wrapped_;
@@ -232,9 +301,20 @@ public:
 
 	void validateConnectivity() const override;
 
+	/** compute all children (concurrently if a scheduler is available) and join them
+	 *
+	 * Solutions of children are passed to the container's onNewSolution() only after the join,
+	 * in order of the children. Thus the result is independent of thread timing. */
+	void computeChildrenJoined();
+	/// defer a child's solution while computeChildrenJoined() is running, returns true if deferred
+	bool deferSolution(const SolutionBase& s);
+
 private:
 	/// callback for new externally received states
 	void onNewExternalState(Interface::Direction dir, Interface::iterator external, bool updated);
+
+	bool defer_solutions_ = false;
+	std::vector<const SolutionBase*> deferred_solutions_;
 };
 PIMPL_FUNCTIONS(ParallelContainerBase)
 
@@ -251,24 +331,54 @@ PIMPL_FUNCTIONS(WrapperBase)
 class MergerPrivate : public ParallelContainerBasePrivate {
 	friend class Merger;
 
-	moveit::core::JointModelGroupPtr jmg_merged_;
+public:
 	typedef std::vector<const SubTrajectory*> ChildSolutionList;
 	typedef std::map<const StagePrivate*, ChildSolutionList> ChildSolutionMap;
+	typedef std::pair<const SubTrajectory*, const SubTrajectory*> Conflict;
+	// bookkeeping of a single source state
+	struct SourceSolutions {
+		ChildSolutionMap solutions;  // children's solutions, each list sorted by cost
+		size_t merges = 0;  // number of materialized merged trajectories
+		std::set<Conflict> conflicts;  // pairs of sub solutions known to collide with each other
+	};
+
+private:
+	moveit::core::JointModelGroupPtr jmg_merged_;
 	// map from external source state (iterator) to all corresponding children's solutions
-	std::map<InterfaceState*, ChildSolutionMap> source_state_to_solutions_;
+	std::map<InterfaceState*, SourceSolutions> source_state_to_solutions_;
 
 public:
 	typedef std::function<void(SubTrajectory&&)> Spawner;
+	/// merge a combination, returns true if a merged trajectory was materialized (valid or not)
+	typedef std::function<bool(const ChildSolutionList&)> CombinationMerger;
 	MergerPrivate(Merger* me, const std::string& name);
 
 	InterfaceFlags requiredInterface() const override;
 
 	void onNewPropagateSolution(const SolutionBase& s);
 	void onNewGeneratorSolution(const SolutionBase& s);
-	void mergeAnyCombination(const ChildSolutionMap& all_solutions, const SolutionBase& current,
+	/// merge combinations including the current solution, in order of their summed cost
+	void mergeAnyCombination(SourceSolutions& source, const SolutionBase& current,
 	                         const planning_scene::PlanningSceneConstPtr& start_scene, const Spawner& spawner);
-	void merge(const ChildSolutionList& sub_solutions,
+	/** pass combinations including current (created by creator) to merge, in order of their summed cost
+	 *
+	 * Combinations containing a conflict of source are skipped. Enumeration stops after max_merges (if nonzero)
+	 * materialized merges of source. merge may add new conflicts to source, which are considered for subsequent
+	 * combinations. */
+	static void enumerateCombinations(SourceSolutions& source, const StagePrivate* creator, const SubTrajectory* current,
+	                                  uint32_t max_merges, const CombinationMerger& merge);
+	/// merge sub solutions and spawn the result if valid, returns false if no merged trajectory was materialized
+	bool merge(SourceSolutions& source, const ChildSolutionList& sub_solutions,
 	           const planning_scene::PlanningSceneConstPtr& start_scene, const Spawner& spawner);
+	/** remember colliding pairs of sub solutions from the colliding merged trajectory
+	 *
+	 * Only contacts between links, whose poses depend on joints of a single sub solution each, are recorded:
+	 * as merged waypoints only depend on their own sub trajectories, these collide in any combination. */
+	void findConflicts(SourceSolutions& source, const ChildSolutionList& sub_solutions,
+	                   const robot_trajectory::RobotTrajectory& merged,
+	                   const planning_scene::PlanningSceneConstPtr& start_scene);
+	/// does the combination contain a known conflict?
+	static bool hasConflict(const SourceSolutions& source, const ChildSolutionList& sub_solutions);
 
 	void sendForward(SubTrajectory&& t, const InterfaceState* from);
 	void sendBackward(SubTrajectory&& t, const InterfaceState* to);
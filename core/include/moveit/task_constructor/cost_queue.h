@@ -2,6 +2,8 @@
 
 #include <queue>
 #include <list>
+#include <set>
+#include <unordered_map>
 #include <deque>
 #include <iostream>
 #include <algorithm>
@@ -23,7 +25,9 @@ struct ValueOrPointeeLess<T, decltype(*std::declval<T>() < *std::declval<T>())>
  *
  *  In contrast to std::priority_queue, we use a std::list as the underlying container.
  *  This ensures, that existing iterators remain valid upon insertion and deletion.
- *  Sorted insertion has logarithmic complexity.
+ *  The list is accompanied by a balanced-tree index of its iterators, such that
+ *  sorted insertion, update, and erasure have logarithmic complexity.
+ *  Items comparing equal keep their insertion order (new items go behind existing ones).
  */
 template <typename T,
           typename Compare = ValueOrPointeeLess<T>>
@@ -51,18 +55,62 @@ protected:
 	container_type c;
 	Compare comp;
 
+private:
+	/// compare list iterators by their pointees
+	struct IteratorLess {
+		Compare comp;
+		bool operator()(const iterator& x, const iterator& y) const { return comp(*x, *y); }
+	};
+	/// sorted index into c: multiset::insert places equal items at the upper bound
+	typedef std::multiset<iterator, IteratorLess> index_type;
+	index_type index_;
+	/// map list items (by address) onto their index entries, allowing removal without comparison
+	std::unordered_map<const value_type*, typename index_type::iterator> handles_;
+
+	/// add pos (residing in other) to the index and splice it into c at the corresponding position
+	iterator link(iterator pos, container_type& other) {
+		typename index_type::iterator idx = index_.insert(pos);
+		handles_[&*pos] = idx;
+		iterator at = ++idx == index_.end() ? c.end() : *idx;
+		c.splice(at, other, pos);
+		return pos;
+	}
+	/// remove pos from the index (but not from c)
+	void unlink(const_iterator pos) {
+		auto h = handles_.find(&*pos);
+		index_.erase(h->second);
+		handles_.erase(h);
+	}
+	/// rebuild index from (sorted) c
+	void reindex() {
+		index_.clear();
+		handles_.clear();
+		for (iterator it = c.begin(), end = c.end(); it != end; ++it)
+			handles_[&*it] = index_.insert(index_.end(), it);
+	}
+
 public:
 	/// initialize empty container
-	explicit ordered() {}
+	explicit ordered() : index_(IteratorLess{comp}) {}
+	ordered(const ordered& other) : c(other.c), comp(other.comp), index_(IteratorLess{comp}) { reindex(); }
+	ordered(ordered&& other) = default;
+	ordered& operator=(const ordered& other) {
+		c = other.c;
+		comp = other.comp;
+		index_ = index_type(IteratorLess{comp});
+		reindex();
+		return *this;
+	}
+	ordered& operator=(ordered&& other) = default;
 
 	bool empty() const { return c.empty(); }
 	size_type size() const { return c.size(); }
 
-	void clear() { c.clear(); }
+	void clear() { c.clear(); index_.clear(); handles_.clear(); }
 
 	reference top() { return c.front(); }
 	const_reference top() const { return c.front(); }
-	value_type pop() { value_type result(top()); c.pop_front(); return result; }
+	value_type pop() { unlink(c.begin()); value_type result(std::move(c.front())); c.pop_front(); return result; }
 
 	reference front() { return c.front(); }
 	const_reference front() const { return c.front(); }
@@ -83,44 +131,58 @@ public:
 	const_reverse_iterator crend() const { return c.rend(); }
 
 	/// explicitly sort container, useful if many items have changed their value
-	void sort() { c.sort(comp); }
+	void sort() { c.sort(comp); reindex(); }
 
 	iterator insert(const value_type& item) {
-		iterator at = std::upper_bound(c.begin(), c.end(), item, comp);
-		return c.insert(at, item);
+		container_type temp;
+		return link(temp.insert(temp.end(), item), temp);
 	}
 	iterator insert(value_type&& item) {
-		iterator at = std::upper_bound(c.begin(), c.end(), item, comp);
-		return c.insert(at, std::move(item));
+		container_type temp;
+		return link(temp.insert(temp.end(), std::move(item)), temp);
 	}
 	inline void push(const value_type& item) { insert(item); }
 	inline void push(value_type&& item) { insert(std::move(item)); }
 
-	iterator erase(const_iterator pos) { return c.erase(pos); }
+	iterator erase(const_iterator pos) { unlink(pos); return c.erase(pos); }
 
 	/// update sort position of a single item after changes
 	iterator update(iterator &it) {
-		container_type temp;
-		temp.splice(temp.end(), c, it);  // move it from c to temp
-		iterator at = std::upper_bound(c.begin(), c.end(), *it, comp);
-		c.splice(at, temp, it);
-		return it;
+		unlink(it);
+		return link(it, c);
+	}
+	/** update sort positions of several items (given by a range of iterators) after changes
+	 *
+	 * All items are unlinked first, such that changed items are never compared with each other. */
+	template <typename InputIt>
+	void update(InputIt first, InputIt last) {
+		for (InputIt it = first; it != last; ++it)
+			unlink(*it);
+		for (InputIt it = first; it != last; ++it)
+			link(*it, c);
 	}
 
 	/// move element pos from this to other container, inserting before other_pos
 	iterator moveTo(iterator pos, container_type& other, iterator other_pos) {
+		unlink(pos);
 		other.splice(other_pos, c, pos);
 		return pos;
 	}
 	/// move element pos from other container into this one (sorted)
 	iterator moveFrom(iterator pos, container_type& other) {
-		iterator at = std::upper_bound(begin(), end(), *pos, comp);
-		c.splice(at, other, pos);
-		return pos;
+		return link(pos, other);
 	}
 
 	template<typename Predicate>
-	void remove_if(Predicate p) { c.remove_if(p); }
+	void remove_if(Predicate p) {
+		for (iterator it = c.begin(), end = c.end(); it != end;) {
+			if (p(*it)) {
+				unlink(it);
+				it = c.erase(it);
+			} else
+				++it;
+		}
+	}
 };
 
 namespace detail {
@@ -54,6 +54,7 @@ namespace moveit { namespace task_constructor {
 MOVEIT_CLASS_FORWARD(Stage)
 MOVEIT_CLASS_FORWARD(Task)
 MOVEIT_CLASS_FORWARD(SolutionBase)
+MOVEIT_CLASS_FORWARD(SubTrajectory)
 
 class IntrospectionPrivate;
 
@@ -76,18 +77,46 @@ public:
 
 	/// fill task state message for publishing the current task state
 	moveit_task_constructor_msgs::TaskStatistics& fillTaskStatistics(moveit_task_constructor_msgs::TaskStatistics& msg);
-	/// publish the current state of task
-	void publishTaskState();
+	/** publish the current state of task
+	 *
+	 * Publishing is rate-limited (see setStatisticsPeriod()). Intermediate messages only
+	 * report changes since the previous message, full snapshots are published periodically.
+	 * force publishes a full snapshot immediately.
+	 */
+	void publishTaskState(bool force = false);
+
+	/// minimum period [s] between task statistics messages (0: publish on every call)
+	void setStatisticsPeriod(double period);
+	/// period [s] of full task statistics snapshots (0: always publish snapshots)
+	void setSnapshotPeriod(double period);
 
 	/// indicate that this task was reset
 	void reset();
 
 	/// register the given solution, assigning a unique ID
 	void registerSolution(const SolutionBase &s);
+	/// forget about the given solution, which is going to be destroyed
+	void unregisterSolution(const SolutionBase &s);
 
 	/// publish the given solution
 	void publishSolution(const SolutionBase &s);
 
+	/** Publish light solution messages, only comprising meta data (ids, costs, comments, markers)
+	 *
+	 * Trajectories and scenes are omitted and only serialized when a solution is
+	 * requested via the GetSolution service.
+	 */
+	void setLightSolutionMessages(bool light);
+	bool lightSolutionMessages() const;
+
+	/** limit the number of cached serialized payloads, evicting the least recently used ones
+	 *
+	 * Defaults are 1000 sub trajectories and 10 start scenes. Evicted payloads are serialized again on demand. */
+	void setPayloadCacheSize(size_t sub_trajectories, size_t start_scenes = 10);
+
+	/// fill trajectory and scene diff of given sub trajectory, caching the serialized messages
+	void fillPayload(moveit_task_constructor_msgs::SubTrajectory& msg, const SubTrajectory& s);
+
 	/// publish all top-level solutions of task
 	void publishAllSolutions(bool wait = true);
 
@@ -103,7 +132,9 @@ public:
 
 private:
 	void fillStageStatistics(const Stage &stage, moveit_task_constructor_msgs::StageStatistics &s);
-	void fillSolution(moveit_task_constructor_msgs::Solution &msg, const SolutionBase &s);
+	/// fill changes since last published task statistics
+	void fillTaskStatisticsDelta(moveit_task_constructor_msgs::TaskStatistics& msg);
+	void fillSolution(moveit_task_constructor_msgs::Solution &msg, const SolutionBase &s, bool payload = true);
 	/// retrieve or set id of given stage
 	uint32_t stageId(const moveit::task_constructor::Stage * const s);
 	/// retrieve solution with given id
@@ -0,0 +1,144 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Robert Haschke
+   Desc:   Memory pool for InterfaceStates and solutions created during planning
+*/
+
+#pragma once
+
+#include <moveit/macros/class_forward.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+
+namespace moveit { namespace task_constructor {
+
+MOVEIT_CLASS_FORWARD(MemoryPool)
+
+/** Pool of small memory blocks, shared by all stages of a Task.
+ *
+ * Small requests are served from free lists, one per size class, which are fed
+ * from large chunks of memory. Freed blocks are recycled via their size class' free list.
+ * Chunks are returned to the system in bulk, when the pool is destroyed.
+ * Larger requests are forwarded to the global operator new.
+ *
+ * The pool is thread-safe. PoolAllocator keeps the pool alive as long as there are
+ * objects allocated from it, e.g. solutions still referenced after the Task was reset.
+ */
+class MemoryPool
+{
+public:
+	struct Statistics {
+		size_t allocations = 0;  ///< number of allocations served so far
+		size_t in_use = 0;  ///< bytes currently in use
+		size_t peak = 0;  ///< peak number of bytes in use
+		size_t reserved = 0;  ///< bytes reserved from the system
+	};
+
+	explicit MemoryPool(size_t chunk_size = 64 * 1024);
+	~MemoryPool();
+	MemoryPool(const MemoryPool&) = delete;
+	MemoryPool& operator=(const MemoryPool&) = delete;
+
+	void* allocate(size_t bytes);
+	void deallocate(void* p, size_t bytes) noexcept;
+
+	Statistics statistics() const;
+
+private:
+	static constexpr size_t GRANULARITY = alignof(std::max_align_t);
+	static constexpr size_t MAX_BLOCK_SIZE = 512;
+	static constexpr size_t NUM_SIZE_CLASSES = MAX_BLOCK_SIZE / GRANULARITY;
+
+	struct FreeBlock { FreeBlock* next; };
+
+	mutable std::mutex mutex_;
+	FreeBlock* free_lists_[NUM_SIZE_CLASSES] = {};
+	std::vector<char*> chunks_;
+	char* cursor_ = nullptr;  // unused part of current chunk: [cursor_, end_)
+	char* end_ = nullptr;
+	const size_t chunk_size_;
+	Statistics statistics_;
+};
+
+/** Allocator, serving allocations from a (shared) MemoryPool
+ *
+ * A default-constructed allocator, i.e. without pool, uses the global operator new. */
+template <typename T>
+class PoolAllocator
+{
+	static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned types are not supported");
+
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	PoolAllocator() noexcept = default;
+	explicit PoolAllocator(const MemoryPoolPtr& pool) noexcept : pool_(pool) {}
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U>& other) noexcept : pool_(other.pool()) {}
+
+	T* allocate(size_t n) {
+		const size_t bytes = n * sizeof(T);
+		return static_cast<T*>(pool_ ? pool_->allocate(bytes) : ::operator new(bytes));
+	}
+	void deallocate(T* p, size_t n) noexcept {
+		if (pool_)
+			pool_->deallocate(p, n * sizeof(T));
+		else
+			::operator delete(p);
+	}
+
+	const MemoryPoolPtr& pool() const { return pool_; }
+
+private:
+	MemoryPoolPtr pool_;
+};
+
+template <typename T, typename U>
+inline bool operator==(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+	return lhs.pool() == rhs.pool();
+}
+template <typename T, typename U>
+inline bool operator!=(const PoolAllocator<T>& lhs, const PoolAllocator<U>& rhs) {
+	return lhs.pool() != rhs.pool();
+}
+
+} }
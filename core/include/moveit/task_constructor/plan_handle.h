@@ -0,0 +1,111 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/* Author: Robert Haschke
+   Desc:   Handle of asynchronous Task planning
+*/
+
+#pragma once
+
+#include <moveit/task_constructor/storage.h>
+#include <moveit/task_constructor/cost_queue.h>
+#include <moveit/macros/class_forward.h>
+
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace moveit { namespace task_constructor {
+
+class Task;
+MOVEIT_CLASS_FORWARD(PlanHandle)
+
+/** Handle of a Task planning in a background thread, created by Task::planAsync()
+ *
+ * The handle provides a thread-safe stream of the task's new top-level solutions in cost order.
+ * Consumers can wait for the first (or a sufficiently cheap) solution and start using it, while planning continues.
+ * While planning, the task must not be accessed otherwise. Destroying the handle cancels planning.
+ */
+class PlanHandle {
+public:
+	~PlanHandle();
+
+	/** cancel planning
+	 *
+	 * The planning loop stops after the current iteration. Running stages see an expired
+	 * deadline, i.e. their timeout() drops to zero, and ComputeIK stops sampling. */
+	void cancel();
+
+	/// wait (at most timeout seconds) for planning to finish, returns true if finished
+	bool wait(double timeout = std::numeric_limits<double>::infinity()) const;
+	bool finished() const;
+	/// result of planning (true if solutions were found), only valid when finished
+	bool success() const;
+
+	/** retrieve the cheapest not yet retrieved solution
+	 *
+	 * Waits at most timeout seconds for a new solution. Returns nullptr if there is none. */
+	SolutionBaseConstPtr next(double timeout = std::numeric_limits<double>::infinity());
+
+	/** wait for a solution cheaper than max_cost
+	 *
+	 * Returns the cheapest solution found so far (without retrieving it from the stream) as soon as
+	 * its cost is below max_cost. Returns nullptr if there is none after timeout seconds or when planning finished. */
+	SolutionBaseConstPtr waitForSolution(double max_cost = std::numeric_limits<double>::infinity(),
+	                                     double timeout = std::numeric_limits<double>::infinity()) const;
+
+private:
+	friend class Task;
+	explicit PlanHandle(Task& task);
+
+	// the following methods are called by the planning thread
+	void push(const SolutionBaseConstPtr& solution);
+	void finish(bool success);
+
+	// wait until predicate holds or timeout passed, lock needs to be held
+	template <typename Predicate>
+	bool waitFor(std::unique_lock<std::mutex>& lock, double timeout, Predicate predicate) const;
+
+	Task& task_;
+	std::thread thread_;
+
+	mutable std::mutex mutex_;
+	mutable std::condition_variable cond_;
+	ordered<SolutionBaseConstPtr> pending_;  // not yet retrieved solutions
+	SolutionBaseConstPtr best_;  // cheapest solution so far
+	bool finished_ = false;
+	bool success_ = false;
+};
+
+} }
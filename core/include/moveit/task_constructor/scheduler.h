@@ -0,0 +1,184 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Author: Robert Haschke
+   Desc:   Work-stealing thread pool and scheduler for parallel planning
+*/
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <exception>
+
+namespace moveit { namespace task_constructor {
+
+/** Work-stealing thread pool
+ *
+ * Each worker owns a double-ended job queue: it pushes and pops its own jobs at the back,
+ * while idle workers steal jobs from the front of other queues.
+ * Jobs submitted from non-worker threads are placed into a shared injection queue.
+ *
+ * Jobs are grouped into JobGroups, which can be joined. The joining thread doesn't block,
+ * but helps processing pending jobs. Thus nested fork-join parallelism, e.g. containers
+ * computing their children within a job, cannot dead-lock.
+ */
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Job;
+
+	/// a set of jobs that can be joined
+	class JobGroup {
+		friend class ThreadPool;
+		std::atomic<size_t> pending_{0};
+		std::mutex mutex_;  // protects exception_
+		std::exception_ptr exception_;
+	};
+
+	/** create pool with given number of worker threads
+	 *
+	 * Joining threads help processing jobs. Thus, even without any workers, all jobs get processed. */
+	explicit ThreadPool(unsigned int num_workers);
+	~ThreadPool();
+
+	unsigned int numWorkers() const { return workers_.size(); }
+
+	/// submit a new job as part of the given group
+	void submit(JobGroup& group, Job&& job);
+	/// process pending jobs until all jobs of group have finished; rethrow first exception of a job
+	void join(JobGroup& group);
+
+private:
+	struct Entry {
+		JobGroup* group;
+		Job job;
+	};
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Entry> entries;
+	};
+
+	/// index of the queue owned by the calling thread (injection queue for non-workers)
+	size_t ownQueue() const;
+	/// fetch an entry from own queue (LIFO) or steal one from another queue (FIFO)
+	bool fetch(size_t own, Entry& entry);
+	/// run the entry's job, recording its exception and notifying joiners
+	void run(Entry& entry);
+	void work(size_t index);
+
+	std::vector<std::unique_ptr<Queue>> queues_;  // one per worker + injection queue
+	std::vector<std::thread> workers_;
+
+	std::mutex mutex_;  // protects sleeping on cv_
+	std::condition_variable cv_;
+	std::atomic<size_t> queued_{0};  // number of entries waiting in all queues
+	bool stop_ = false;
+};
+
+
+/** Scheduler for parallel planning, computing the children of containers concurrently
+ *
+ * Serialization rule: All bookkeeping of the stage graph, i.e. storing solutions,
+ * adding, removing or updating InterfaceStates in Interfaces, calling solution callbacks,
+ * and all container callbacks (onNewSolution(), copyState(), liftSolution()) is serialized
+ * by the scheduler's mutex. A thread computing a stage holds this mutex by default.
+ * Only expensive, side-effect free computations (e.g. solver calls or IK sampling),
+ * which don't touch the stage graph, release the mutex temporarily via Stage::Unlocked,
+ * thus allowing other stages to proceed concurrently.
+ * A stage is computed by at most one thread at a time, such that stages don't need to
+ * protect their own member variables.
+ *
+ * Parallel planning doesn't necessarily find the same solutions as serial planning:
+ * A container decides which children are ready for computation before any of them runs.
+ * Thus, states spawned by a child within a step are processed by its siblings in the next
+ * step only, while serial planning processes them immediately. Only if all stages are
+ * deterministic and planning runs to completion, the same set of solutions is found.
+ * Otherwise (limited number of solutions, timeout, or randomized stages) results may differ.
+ */
+class Scheduler
+{
+public:
+	typedef ThreadPool::Job Job;
+
+	/// create scheduler using num_threads threads in total (including the calling one)
+	explicit Scheduler(unsigned int num_threads);
+
+	unsigned int numThreads() const { return pool_.numWorkers() + 1; }
+
+	/** Scoped lock of the scheduler's mutex, registered as lock of the calling thread
+	 *
+	 * The calling thread's lock is temporarily released by parallel() and Stage::Unlocked.
+	 * Locks need to be destroyed in reverse order of their creation. */
+	class Lock {
+		friend class Scheduler;
+
+	public:
+		explicit Lock(Scheduler& scheduler);
+		~Lock();
+		Lock(const Lock&) = delete;
+		Lock& operator=(const Lock&) = delete;
+
+		std::unique_lock<std::mutex>& get() { return lock_; }
+
+	private:
+		std::unique_lock<std::mutex> lock_;
+		Lock* previous_;  // previously registered lock of this thread
+	};
+
+	/// mutex serializing all modifications of the stage graph
+	std::mutex& mutex() { return mutex_; }
+
+	/// lock on mutex() held by the calling thread, throws std::logic_error if there is none
+	std::unique_lock<std::mutex>& heldLock();
+
+	/** Compute given jobs concurrently, each of them holding the mutex while running
+	 *
+	 * lock needs to hold the mutex. It is released while waiting for the jobs to finish.
+	 * The first exception thrown by any job is rethrown. */
+	void parallel(std::vector<Job>& jobs, std::unique_lock<std::mutex>& lock);
+
+private:
+	std::mutex mutex_;
+	ThreadPool pool_;
+};
+
+} }
@@ -42,8 +42,12 @@
 #include "utils.h"
 #include <moveit/macros/class_forward.h>
 #include <moveit/task_constructor/storage.h>
+#include <moveit/task_constructor/timing.h>
 #include <vector>
+#include <deque>
 #include <list>
+#include <map>
+#include <mutex>
 
 #define PRIVATE_CLASS(Class) \
 	friend class Class##Private; \
@@ -164,8 +168,8 @@ public:
 	 * The logic of the individual stage should ensure this limit is respected.
 	 */
 	void setTimeout(double timeout) { setProperty("timeout", timeout); }
-	/// timeout of stage per computation
-	double timeout() const { return properties().get<double>("timeout"); }
+	/// timeout of stage per computation, limited by the Task's planning deadline (if any)
+	double timeout() const;
 
 	/** set marker namespace for solutions
 	 *
@@ -190,13 +194,51 @@ public:
 	void removeSolutionCallback(SolutionCallbackList::const_iterator which);
 
 	const ordered<SolutionBaseConstPtr>& solutions() const;
-	const std::list<SolutionBaseConstPtr>& failures() const;
+	const std::deque<SolutionBaseConstPtr>& failures() const;
 	size_t numFailures() const;
 	/// call to increase number of failures w/o storing a (failure) trajectory
 	void silentFailure();
+	/// named statistics counters (e.g. cache hits), published via introspection
+	const std::map<std::string, size_t>& counters() const;
+	/// increase named counter by n
+	void incrementCounter(const std::string& name, size_t n = 1);
+
+	/** timing statistics of instrumented code sections
+	 *
+	 * Built-in sections are "compute", "new_solution", and "interface" (adding states to / updating
+	 * states in the stage's interfaces). Durations of containers include those of their children.
+	 */
+	const std::map<std::string, TimingStatistics>& timings() const;
+	/// (create and) access timing statistics of named section, e.g. for use with a ScopedTimer
+	TimingStatistics& timing(const std::string& name);
+	/// estimated memory [bytes] of states created by this stage
+	size_t stateMemory() const;
+	/// estimated memory [bytes] of solutions (and failures) stored by this stage
+	size_t solutionMemory() const;
+
+	/** declare an admissible lower bound of the cost of any solution of this stage (default: 0)
+	 *
+	 * When pruning is enabled in the Task, this tightens the bound used to skip useless computations. */
+	void setCostLowerBound(double bound);
+	double costLowerBound() const;
 	/// should we generate failure solutions?
 	bool storeFailures() const;
 
+	/// policy to limit the memory of failures stored (if introspection is enabled)
+	enum FailureRetention {
+		RETAIN_ALL,  ///< keep all failures (default)
+		RETAIN_LAST,  ///< keep the last max_failures failures
+		RETAIN_SAMPLE,  ///< keep a uniformly sampled subset of max_failures failures (reservoir sampling)
+		RETAIN_COUNTS,  ///< don't keep any failures, but count them by comment (see counters())
+	};
+	/** set failure retention policy
+	 *
+	 * Failures are still passed to solution callbacks and registered with introspection when found.
+	 * Dropped failures free their states and scenes, and are not available via introspection anymore.
+	 * numFailures() still counts all failures. */
+	void setFailureRetention(FailureRetention policy, size_t max_failures = 0);
+	FailureRetention failureRetention() const;
+
 	/// get the stage's property map
 	PropertyMap& properties();
 	const PropertyMap& properties() const {
@@ -211,6 +253,26 @@ public:
 	/// analyze source of error and report accordingly
 	void reportPropertyError(const Property::error &e);
 
+	/** Scope releasing the task's planning lock, allowing other stages to compute concurrently
+	 *
+	 * When planning with multiple threads (see Task::setNumThreads()), all modifications of the
+	 * stage graph (spawning solutions, modifying interfaces, container callbacks) are serialized
+	 * by a task-wide lock, which is held while a stage computes. Wrap expensive, side-effect free
+	 * computations, e.g. solver calls, into an Unlocked scope to allow for concurrency.
+	 * Within this scope, don't spawn solutions or access any other stage. Scopes must not be nested.
+	 * When planning serially, this is a no-op.
+	 */
+	class Unlocked {
+	public:
+		explicit Unlocked(const Stage& stage);
+		~Unlocked();
+		Unlocked(const Unlocked&) = delete;
+		Unlocked& operator=(const Unlocked&) = delete;
+
+	private:
+		std::unique_lock<std::mutex>* lock_;
+	};
+
 protected:
 	/// Stage can only be instantiated through derived classes
 	Stage(StagePrivate *impl);
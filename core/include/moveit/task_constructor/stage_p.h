@@ -41,7 +41,16 @@
 #include <moveit/task_constructor/stage.h>
 #include <moveit/task_constructor/storage.h>
 #include <moveit/task_constructor/cost_queue.h>
+#include <moveit/task_constructor/memory_pool.h>
 #include <ostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <unordered_map>
 
 // define pimpl() functions accessing correctly casted pimpl_ pointer
 #define PIMPL_FUNCTIONS(Class) \
@@ -51,6 +60,61 @@
 namespace moveit { namespace task_constructor {
 
 class ContainerBase;
+class Scheduler;
+/** Cost of the k-th best solution of a task, shared by all its stages for branch-and-bound pruning
+ *
+ * Partial solutions, whose cost is not below this bound, cannot contribute to the best k solutions anymore. */
+class CostBound {
+public:
+	inline double value() const { return value_.load(std::memory_order_relaxed); }
+	inline void set(double value) { value_.store(value, std::memory_order_relaxed); }
+	inline void reset() { set(std::numeric_limits<double>::infinity()); }
+
+private:
+	std::atomic<double> value_ { std::numeric_limits<double>::infinity() };
+};
+
+/** Wall-clock deadline of a task's planning, shared by all its stages
+ *
+ * The remaining time is divided evenly among the stages, which are currently able to compute. */
+class Deadline {
+	typedef std::chrono::steady_clock Clock;
+
+public:
+	/// set deadline timeout seconds from now (infinity: no deadline)
+	inline void set(double timeout) {
+		canceled_.store(false, std::memory_order_relaxed);
+		active_ = std::isfinite(timeout);
+		if (active_)
+			deadline_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+	}
+	inline bool active() const { return active_; }
+	/// remaining time [s], infinity if not active
+	inline double remaining() const {
+		if (!active_) return std::numeric_limits<double>::infinity();
+		return std::max(0.0, std::chrono::duration<double>(deadline_ - Clock::now()).count());
+	}
+	inline bool expired() const { return canceled() || (active_ && Clock::now() >= deadline_); }
+	/// expire immediately (thread-safe)
+	inline void cancel() { canceled_.store(true, std::memory_order_relaxed); }
+	inline bool canceled() const { return canceled_.load(std::memory_order_relaxed); }
+
+	/// set number of stages sharing the remaining time
+	inline void setShares(unsigned int shares) { shares_.store(std::max(1u, shares), std::memory_order_relaxed); }
+	/// timeout for a single computation of a stage, limiting its own timeout to its share of the remaining time
+	inline double timeout(double stage_timeout) const {
+		if (canceled()) return 0.0;
+		if (!active_) return stage_timeout;
+		return std::min(stage_timeout, remaining() / shares_.load(std::memory_order_relaxed));
+	}
+
+private:
+	bool active_ = false;
+	Clock::time_point deadline_;
+	std::atomic<unsigned int> shares_ { 1 };
+	std::atomic<bool> canceled_ { false };
+};
+
 class StagePrivate {
 	friend class Stage;
 	friend std::ostream& operator<<(std::ostream& os, const StagePrivate& stage);
@@ -79,6 +143,8 @@ public:
 
 	virtual bool canCompute() const = 0;
 	virtual void compute() = 0;
+	/// call compute(), recording its timing statistics
+	void runCompute();
 
 	inline const Stage* me() const { return me_; }
 	inline Stage* me() { return me_; }
@@ -111,6 +177,28 @@ public:
 	inline void setPrevEnds(const InterfacePtr& prev_ends) { prev_ends_ = prev_ends; }
 	inline void setNextStarts(const InterfacePtr& next_starts) { next_starts_ = next_starts; }
 	inline void setIntrospection(Introspection* introspection) { introspection_ = introspection; }
+	inline void setScheduler(Scheduler* scheduler) { scheduler_ = scheduler; }
+	/// task's scheduler, only available when planning in parallel
+	inline Scheduler* scheduler() const { return scheduler_; }
+	/// set task's cost bound, only available when pruning is enabled
+	inline void setCostBound(const CostBound* bound) { cost_bound_ = bound; }
+	inline const CostBound* costBound() const { return cost_bound_; }
+	/// set task's planning deadline
+	inline void setDeadline(const Deadline* deadline) { deadline_ = deadline; }
+	inline const Deadline* deadline() const { return deadline_; }
+	/** Check whether computing this stage on a partial solution of given cost is useless
+	 *
+	 * True, if cost plus the stage's own lower bound reaches the task's cost bound. Pruned items are counted. */
+	bool prune(double cost);
+	/// set task's memory pool, used for states and solutions created from now on
+	void setMemoryPool(const MemoryPoolPtr& pool);
+	inline const MemoryPoolPtr& memoryPool() const { return memory_pool_; }
+
+	/// create a new solution, allocated from the task's memory pool
+	template <typename T, typename... Args>
+	std::shared_ptr<T> makeSolution(Args&&... args) {
+		return std::allocate_shared<T>(PoolAllocator<T>(memory_pool_), std::forward<Args>(args)...);
+	}
 	void composePropertyErrorMsg(const std::string& name, std::ostream& os);
 
 	// methods to spawn new solutions
@@ -123,6 +211,16 @@ public:
 	void newSolution(const SolutionBasePtr& solution);
 	bool storeFailures() const { return introspection_ != nullptr; }
 
+	typedef std::list<InterfaceState, PoolAllocator<InterfaceState>> StateList;
+	/// remember count states created along with a failure, to free them when the failure is dropped
+	void registerFailureStates(const SolutionBase& failure, StateList::iterator first, unsigned int count);
+	/// apply retention policy after the latest failure was stored and announced
+	void retainFailures();
+	/// drop a failure, which was removed from failures_, freeing its states
+	void dropFailure(const SolutionBaseConstPtr& failure);
+	/// drop all (successful) solutions matching predicate, returns their number
+	size_t dropSolutions(const std::function<bool(const SolutionBase&)>& predicate);
+
 protected:
 	Stage* const me_; // associated/owning Stage instance
 	std::string name_;
@@ -134,10 +232,24 @@ protected:
 	// functions called for each new solution
 	std::list<Stage::SolutionCallback> solution_cbs_;
 
-	std::list<InterfaceState> states_;  // storage for created states
+	StateList states_;  // storage for created states
 	ordered<SolutionBaseConstPtr> solutions_;
-	std::list<SolutionBaseConstPtr> failures_;
+	std::deque<SolutionBaseConstPtr> failures_;
 	size_t num_failures_ = 0;  // num of failures if not stored
+	Stage::FailureRetention failure_retention_ = Stage::RETAIN_ALL;
+	size_t max_failures_ = 0;  // number of failures kept by RETAIN_LAST and RETAIN_SAMPLE
+	std::minstd_rand failure_rng_;  // random generator for RETAIN_SAMPLE
+	// states created along with a failure (for RETAIN_LAST and RETAIN_SAMPLE)
+	std::unordered_map<const SolutionBase*, std::pair<StateList::iterator, unsigned int>> failure_states_;
+	std::map<std::string, size_t> counters_;  // named statistics counters
+	size_t solution_memory_ = 0;  // estimated memory of stored solutions
+	double cost_lower_bound_ = 0.0;  // admissible lower bound of the cost of our solutions
+
+	std::map<std::string, TimingStatistics> timings_;
+	// built-in sections, remaining valid in timings_
+	TimingStatistics* const compute_timing_;
+	TimingStatistics* const new_solution_timing_;
+	TimingStatistics* const interface_timing_;
 
 private:
 	// !! items write-accessed only by ContainerBasePrivate to maintain hierarchy !!
@@ -148,6 +260,10 @@ private:
 	InterfaceWeakPtr next_starts_;  // interface to be used for sendForward()
 
 	Introspection* introspection_;  // task's introspection instance
+	Scheduler* scheduler_;  // task's scheduler for parallel planning
+	const CostBound* cost_bound_ = nullptr;  // task's cost bound for pruning
+	const Deadline* deadline_ = nullptr;  // task's planning deadline
+	MemoryPoolPtr memory_pool_;  // task's memory pool for states and solutions
 };
 PIMPL_FUNCTIONS(Stage)
 std::ostream& operator<<(std::ostream& os, const StagePrivate& stage);
@@ -267,8 +383,17 @@ private:
 	template<Interface::Direction other>
 	void newState(Interface::iterator it, bool updated);
 
+	typedef ordered<StatePair, StatePairLess> PendingList;
+	void addPending(const StatePair& pair);
+	// remove pair from pending_by_state_ entry of given state
+	void unindexPending(const InterfaceState* state, PendingList::iterator pair);
+	// remove all pending pairs involving state
+	void removePending(const InterfaceState* state);
+
 	// ordered list of pending state pairs
-	ordered<StatePair, StatePairLess> pending;
+	PendingList pending;
+	// pending pairs by involved state, allowing to re-sort only those affected by a state update
+	std::unordered_map<const InterfaceState*, std::vector<PendingList::iterator>> pending_by_state_;
 };
 PIMPL_FUNCTIONS(Connecting)
 
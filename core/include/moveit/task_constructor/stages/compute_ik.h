@@ -40,6 +40,8 @@
 #include <moveit/task_constructor/cost_queue.h>
 #include <geometry_msgs/PoseStamped.h>
 #include <Eigen/Geometry>
+#include <map>
+#include <memory>
 
 namespace moveit {
 namespace core {
@@ -62,10 +64,17 @@ namespace moveit { namespace task_constructor { namespace stages {
  *
  * Properties of the internally received InterfaceState can be forwarded to the
  * newly generated, externally exposed InterfaceState.
+ *
+ * Several queued target poses can be processed in a batch. When the task plans with
+ * multiple threads (see Task::setNumThreads()), the IK sampling of a batch is distributed
+ * over the task's threads. Each sampling job uses its own RobotState and its own kinematics
+ * solver instance, loaded via the kinematics plugin loader from the robot_description parameter.
+ * Results of all jobs are merged in job order, such that they are reproducible for a given ik_seed.
  */
 class ComputeIK : public WrapperBase {
 public:
 	ComputeIK(const std::string &name="IK", Stage::pointer &&child = Stage::pointer());
+	~ComputeIK();
 
 	void reset() override;
 	void init(const core::RobotModelConstPtr &robot_model) override;
@@ -113,9 +122,71 @@ public:
 	void setMinSolutionDistance(double distance) {
 		setProperty("min_solution_distance", distance);
 	}
+	/** apply min_solution_distance to all solutions spawned by this stage, not only to those of the same target
+	 *
+	 * Near-duplicates of previously spawned solutions are rejected (before collision checking),
+	 * even if they originate from a different target pose or scene. Rejections are reported by the
+	 * stage counter "duplicate_ik_solutions".
+	 */
+	void setUniqueSolutions(bool flag) {
+		setProperty("unique_solutions", flag);
+	}
+
+	/// number of queued target poses processed per compute() call
+	void setMaxBatchSize(uint32_t n) {
+		setProperty("max_batch_size", n);
+	}
+	/// seed for random IK restarts, providing reproducible results (0: non-deterministic)
+	void setIKSeed(uint32_t seed) {
+		setProperty("ik_seed", seed);
+	}
+
+	/** cache collision checks of the end-effector placed at the target pose
+	 *
+	 * Poses closer than resolution (in meters and radians) share their cached result:
+	 * contacts appearing or vanishing within the resolution may be missed (or reported wrongly).
+	 * Hits and misses are reported as stage counters.
+	 */
+	void setCacheCollisions(bool flag, double resolution = 1e-4) {
+		setProperty("cache_collisions", flag);
+		setProperty("collision_cache_resolution", resolution);
+	}
+
+	/** cache IK solutions in file, persisting across tasks and processes
+	 *
+	 * Solutions are keyed by robot model, group, IK link, and the pose of that link w.r.t. the planning frame,
+	 * quantized with resolution (in meters and radians). Cached solutions for a key are tried as IK seeds first
+	 * and validated against the current scene. An empty file name disables the cache.
+	 * Targets solved (or not) from cached seeds are reported as stage counters "ik_cache_hits" ("ik_cache_misses").
+	 */
+	void setIKCache(const std::string& file, double resolution = 1e-3) {
+		setProperty("ik_cache_file", file);
+		setProperty("ik_cache_resolution", resolution);
+	}
+
+	// implementation details, defined in compute_ik_p.h
+	struct CollisionCache;
+	struct IKCache;
+	struct SolutionIndex;
 
 protected:
 	ordered<const SolutionBase*> upstream_solutions_;
+
+private:
+	struct IKTarget;
+	/// read properties for upstream solution s, returns nullptr if there is nothing to sample
+	std::unique_ptr<IKTarget> prepare(const SolutionBase& s);
+	/// spawn all IK solutions (and failures) found for target
+	void spawnSolutions(const IKTarget& target);
+
+	std::unique_ptr<CollisionCache> collision_cache_;
+	std::shared_ptr<IKCache> ik_cache_;
+	/// solutions spawned so far, per group and min_solution_distance (if unique_solutions is enabled)
+	std::map<std::pair<const moveit::core::JointModelGroup*, double>, std::unique_ptr<SolutionIndex>> solution_indices_;
+	struct SolverPool;
+	/// kinematics solver instances used by concurrent sampling jobs
+	std::unique_ptr<SolverPool> solver_pool_;
+	size_t num_targets_ = 0;  // number of processed targets, used for seeding
 };
 
 } } }
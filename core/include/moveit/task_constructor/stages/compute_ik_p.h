@@ -0,0 +1,184 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Robert Haschke
+   Desc:   Private Implementation of the ComputeIK stage
+*/
+
+#pragma once
+
+#include <moveit/task_constructor/stages/compute_ik.h>
+#include <moveit/collision_detection/collision_matrix.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_model/link_model.h>
+#include <moveit/robot_state/robot_state.h>
+
+#include <Eigen/Geometry>
+#include <boost/functional/hash.hpp>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace moveit { namespace task_constructor { namespace stages {
+
+/** Index of joint configurations to reject near-duplicate IK solutions
+ *
+ * Configurations are stored in a flat array and bucketed into a grid over (up to) three bounded
+ * single-variable joints: As jmg->distance() sums the weighted distances of all joints, a configuration
+ * closer than min_distance differs by less than min_distance / weight in each of these joints.
+ * Hence, only the neighboring cells need to be checked with the exact jmg->distance().
+ */
+struct ComputeIK::SolutionIndex {
+	typedef std::array<long long, 3> Key;
+	struct KeyHash {
+		size_t operator()(const Key& key) const { return boost::hash_range(key.begin(), key.end()); }
+	};
+
+	const moveit::core::JointModelGroup* jmg = nullptr;
+	double min_distance = 0.0;
+	size_t dim = 0;
+	std::vector<std::pair<size_t, double>> axes;  // group variable index and cell size of grid axes
+	std::vector<double> positions;  // flat array of all stored configurations
+	std::unordered_map<Key, std::vector<size_t>, KeyHash> cells;  // configurations per grid cell
+
+	void reset(const moveit::core::JointModelGroup* group, double distance);
+	size_t size() const { return dim ? positions.size() / dim : 0; }
+	/// is there a stored configuration closer than min_distance?
+	bool contains(const double* joint_positions) const;
+	void insert(const double* joint_positions);
+
+private:
+	Key key(const double* joint_positions) const;
+};
+
+/// quantized pose: position and (unique) quaternion
+typedef std::array<long long, 7> PoseKey;
+
+/** Cache for results of the target pose collision check
+ *
+ * Results are cached per scene fingerprint (world, ACM, robot state), placed link, and
+ * quantized pose of that link. Poses within the quantization resolution share their result:
+ * a cached result may thus differ from an exact check, if a contact appears or vanishes
+ * within the resolution. Additionally, a conservative bounding-sphere test determines whether
+ * the placed links are separated from all other collision objects. In this case, the result
+ * doesn't depend on the placement and is shared by all separated placements.
+ *
+ * Fingerprints hash collision shapes by address. Hence, each fingerprint keeps its first scene
+ * as a reference alive, such that its shapes' addresses cannot be reused. Other scenes with
+ * the same fingerprint are compared to the reference once: if they differ (a hash collision),
+ * they are checked without the cache.
+ */
+struct ComputeIK::CollisionCache {
+	struct Sphere {
+		Eigen::Vector3d center;
+		double radius;
+	};
+	struct Result {
+		bool colliding;
+		std::string contacts;
+	};
+	struct PoseKeyHash {
+		size_t operator()(const PoseKey& key) const { return boost::hash_range(key.begin(), key.end()); }
+	};
+
+	/// all data for placing a given link into scenes with the same fingerprint
+	struct Context {
+		collision_detection::AllowedCollisionMatrix acm;  // scene's ACM, ignoring parent links
+		std::vector<Sphere> obstacles;  // bounding spheres of static collision objects
+		std::vector<Sphere> moved;  // bounding spheres of placed collision objects, relative to parent link
+		std::unique_ptr<Result> separated;  // result if moved and static objects are separated
+		std::unordered_map<PoseKey, Result, PoseKeyHash> results;
+	};
+
+	/// memoized fingerprint of a scene instance
+	struct Fingerprint {
+		std::weak_ptr<const planning_scene::PlanningScene> scene;  // expired if the address was reused
+		size_t value;
+		bool cacheable;  // does the scene equal the fingerprint's reference scene?
+	};
+
+	static constexpr size_t MAX_CONTEXTS = 64;
+	static constexpr size_t MAX_RESULTS = 1 << 16;
+
+	std::map<const planning_scene::PlanningScene*, Fingerprint> fingerprints_;
+	std::map<size_t, planning_scene::PlanningSceneConstPtr> references_;  // first scene per fingerprint
+	std::map<std::pair<size_t, const robot_model::LinkModel*>, Context> contexts_;
+
+	/// fingerprint of scene, verified against the fingerprint's reference scene
+	const Fingerprint& fingerprint(const planning_scene::PlanningSceneConstPtr& scene);
+	Context& context(size_t fingerprint, const planning_scene::PlanningSceneConstPtr& scene,
+	                 const robot_model::LinkModel* parent);
+
+	/// check placement of parent link at pose, which was already applied to state
+	bool isColliding(const planning_scene::PlanningSceneConstPtr& scene, const robot_state::RobotState& state,
+	                 const robot_model::LinkModel* parent, const Eigen::Isometry3d& pose, double resolution,
+	                 std::string& contacts, Stage& stage);
+};
+
+/** IK solutions persisted in a file, shared by all stages using the same file
+ *
+ * The file starts with a magic header, followed by records of: 64-bit key, 32-bit number of joint values,
+ * and the joint values (doubles, native byte order). New solutions are appended (and flushed) immediately,
+ * such that they survive crashes and restarts. Keys are hashes, thus only valid for the same boost version.
+ */
+struct ComputeIK::IKCache {
+	static constexpr size_t MAX_SEEDS = 8;  // maximum number of solutions stored per key
+	static constexpr uint32_t MAX_VARIABLES = 1024;  // sanity limit for record sizes read from file
+	static constexpr char MAGIC[8] = { 'M', 'T', 'C', 'I', 'K', 'C', '0', '1' };
+
+	std::string file;
+	std::ofstream out;  // append stream, closed if the file couldn't be used
+	std::mutex mutex;  // protects seeds and out
+	std::unordered_map<uint64_t, std::vector<std::vector<double>>> seeds;
+
+	/// get the (shared) cache for file, loading it if required
+	static std::shared_ptr<IKCache> get(const std::string& file);
+	static uint64_t key(const moveit::core::JointModelGroup* jmg, const robot_model::LinkModel* link,
+	                    const Eigen::Isometry3d& pose, double resolution);
+
+	std::vector<std::vector<double>> lookup(uint64_t key);
+	void insert(uint64_t key, const std::vector<double>& joint_positions);
+
+private:
+	void load();
+	bool add(uint64_t key, const std::vector<double>& joint_positions);
+};
+
+} } }
@@ -45,6 +45,7 @@
 
 namespace moveit { namespace core {
 MOVEIT_CLASS_FORWARD(RobotState)
+class JointModel;
 } }
 
 namespace moveit { namespace task_constructor { namespace stages {
@@ -86,6 +87,8 @@ protected:
 protected:
 	GroupPlannerVector planner_;
 	moveit::core::JointModelGroupPtr merged_jmg_;
+	// joints (with variables) not planned for, which need to match between start and end states
+	std::vector<const moveit::core::JointModel*> unplanned_joints_;
 	std::list<SubTrajectory> subsolutions_;
 	std::list<InterfaceState> states_;
 };
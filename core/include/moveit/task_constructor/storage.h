@@ -42,10 +42,14 @@
 #include <moveit/macros/class_forward.h>
 #include <moveit/task_constructor/properties.h>
 #include <moveit/task_constructor/cost_queue.h>
+#include <moveit/task_constructor/timing.h>
 #include <moveit_task_constructor_msgs/Solution.h>
 #include <visualization_msgs/MarkerArray.h>
+#include <boost/container/small_vector.hpp>
 
+#include <algorithm>
 #include <list>
+#include <memory>
 #include <vector>
 #include <deque>
 #include <cassert>
@@ -76,6 +80,7 @@ MOVEIT_CLASS_FORWARD(Introspection)
 class InterfaceState {
 	friend class SolutionBase; // addIncoming() / addOutgoing() should be called only by SolutionBase
 	friend class Interface; // allow Interface to set owner_ and priority_
+	friend class StagePrivate; // allow StagePrivate to set origin_
 public:
 	/** InterfaceStates are ordered according to two values:
 	 *  Depth of interlinked trajectory parts and accumulated trajectory costs along that path.
@@ -95,7 +100,8 @@ public:
 		}
 		bool operator<(const Priority& other) const;
 	};
-	typedef std::deque<SolutionBase*> Solutions;
+	/// most states have a single incoming or outgoing solution: store it inline
+	typedef boost::container::small_vector<SolutionBase*, 1> Solutions;
 
 	/// create an InterfaceState from a planning scene
 	InterfaceState(const planning_scene::PlanningScenePtr& ps);
@@ -105,9 +111,44 @@ public:
 	InterfaceState(const InterfaceState& other);
 
 	inline const planning_scene::PlanningSceneConstPtr& scene() const { return scene_; }
+	/// number of parent scenes the scene is derived from via diff()
+	unsigned int sceneDepth() const;
+	/// estimated memory footprint [bytes] of the scene, including its (possibly shared) parent scenes
+	size_t sceneFootprint() const;
+
+	/** Limit the length of scene diff chains (0: unlimited, default)
+	 *
+	 * Most stages derive new scenes via diff() from their input state's scene. Each diff keeps its
+	 * parent alive and lookups traverse the whole chain. If a newly created InterfaceState's scene
+	 * exceeds the given depth, its parent chain is collapsed into a single scene, sharing unchanged
+	 * collision shapes with the original chain. The scene's own changes are kept as a diff to the
+	 * collapsed parent. Note that scene() then differs from the scene passed to the constructor.
+	 */
+	static void setMaxSceneDepth(unsigned int depth);
+	static unsigned int maxSceneDepth();
+
+	/** Hash of world object ids and attached bodies' names and links, together with their numbers of shapes
+	 *
+	 * States with different fingerprints have different objects, i.e. they cannot be connected.
+	 * Continuous values (object poses, joint values) are not hashed, as they are compared with a tolerance:
+	 * the fingerprint never rejects states considered compatible by a full comparison.
+	 * The fingerprint is computed lazily on first access. */
+	size_t sceneFingerprint() const;
+	/** Fingerprint of the given scene
+	 *
+	 * If exact, additionally hashes everything affecting collision checks: collision shapes (by identity),
+	 * exact object poses, touch links, the allowed collision matrix, and the robot state. */
+	static size_t sceneFingerprint(const planning_scene::PlanningScene& scene, bool exact = false);
 	inline const Solutions& incomingTrajectories() const { return incoming_trajectories_; }
 	inline const Solutions& outgoingTrajectories() const { return outgoing_trajectories_; }
 
+	/** Was this state created by a stage together with an incoming (or outgoing) trajectory?
+	 *
+	 * Trajectories in this direction are final: a state created as the end of an incoming trajectory
+	 * (by forward propagation) won't receive any further incoming trajectories, and vice versa. */
+	inline bool createdByIncoming() const { return origin_ == INCOMING; }
+	inline bool createdByOutgoing() const { return origin_ == OUTGOING; }
+
 	PropertyMap& properties() { return properties_; }
 	const PropertyMap& properties() const { return properties_; }
 
@@ -122,16 +163,29 @@ private:
 	// these methods should be only called by SolutionBase::set[Start|End]State()
 	inline void addIncoming(SolutionBase* t) { incoming_trajectories_.push_back(t); }
 	inline void addOutgoing(SolutionBase* t) { outgoing_trajectories_.push_back(t); }
+	// called by StagePrivate when dropping a failure
+	inline void removeIncoming(const SolutionBase* t) { remove(incoming_trajectories_, t); }
+	inline void removeOutgoing(const SolutionBase* t) { remove(outgoing_trajectories_, t); }
+	static void remove(Solutions& solutions, const SolutionBase* t) {
+		solutions.erase(std::remove(solutions.begin(), solutions.end(), t), solutions.end());
+	}
 
 private:
+	// set by StagePrivate when creating a new state together with its trajectory
+	enum Origin : unsigned char { NONE, INCOMING, OUTGOING };
+
 	planning_scene::PlanningSceneConstPtr scene_;
 	PropertyMap properties_;
 	Solutions incoming_trajectories_;
 	Solutions outgoing_trajectories_;
+	Origin origin_ = NONE;  // direction of the trajectory this state was created with
+	mutable bool has_fingerprint_ = false;
+	mutable size_t fingerprint_ = 0;  // lazily computed sceneFingerprint()
 
 	// members needed for priority scheduling in Interface list
 	Priority priority_;
 	Interface* owner_ = nullptr;  // allow update of priority
+	ordered<InterfaceState*>::iterator handle_;  // position within owner_, valid if owner_ is set
 };
 
 /** Interface provides a cost-sorted list of InterfaceStates available as input for a stage. */
@@ -164,7 +218,8 @@ public:
 
 	enum Direction { FORWARD, BACKWARD, START=FORWARD, END=BACKWARD };
 	typedef std::function<void(iterator it, bool updated)> NotifyFunction;
-	Interface(const NotifyFunction &notify = NotifyFunction());
+	/// timing optionally records the duration of add() and updatePriority() calls
+	Interface(const NotifyFunction &notify = NotifyFunction(), TimingStatistics* timing = nullptr);
 
 	/// add a new InterfaceState
 	void add(InterfaceState &state);
@@ -177,6 +232,7 @@ public:
 
 private:
 	const NotifyFunction notify_;
+	TimingStatistics* const timing_;
 
 	// restrict access to some functions to ensure consistency
 	// (we need to set/unset InterfaceState::owner_)
@@ -189,8 +245,9 @@ private:
 
 
 class StagePrivate;
+class SubTrajectory;
 /// abstract base class for solutions (primitive and sequences)
-class SolutionBase {
+class SolutionBase : public std::enable_shared_from_this<SolutionBase> {
 public:
 	virtual ~SolutionBase() = default;
 
@@ -228,12 +285,29 @@ public:
 	auto& markers() { return markers_; }
 	const auto& markers() const { return markers_; }
 
+	/// function appending markers to the given list
+	typedef std::function<void(std::vector<visualization_msgs::Marker>&)> MarkerGenerator;
+	/** add markers generated on demand, i.e. only when the solution is serialized
+	 *
+	 * This avoids the cost of building markers, which are never viewed.
+	 * Data captured by the generator needs to remain valid during the lifetime of the solution. */
+	void addMarkerGenerator(const MarkerGenerator& generator) { marker_generators_.push_back(generator); }
+	const std::vector<MarkerGenerator>& markerGenerators() const { return marker_generators_; }
+	/// append all markers, stored and generated ones
+	void generateMarkers(std::vector<visualization_msgs::Marker>& markers) const;
+
 	/// append this solution to Solution msg
 	virtual void fillMessage(moveit_task_constructor_msgs::Solution &solution,
 	                         Introspection* introspection = nullptr) const = 0;
 	void fillInfo(moveit_task_constructor_msgs::SolutionInfo& info,
 	              Introspection* introspection = nullptr) const;
 
+	/// estimated memory [bytes] owned by this solution
+	virtual size_t footprint() const;
+
+	/// call visitor for all SubTrajectories composing this solution, in order
+	virtual void visitSubTrajectories(const std::function<void(const SubTrajectory&)>& visitor) const = 0;
+
 	/// order solutions by their cost
 	bool operator<(const SolutionBase& other) const {
 		return this->cost_ < other.cost_;
@@ -253,7 +327,9 @@ private:
 	// comment for this solution, e.g. explanation of failure
 	std::string comment_;
 	// markers for this solution, e.g. target frame or collision indicators
-	std::deque<visualization_msgs::Marker> markers_;
+	std::vector<visualization_msgs::Marker> markers_;
+	// generators of markers created on demand
+	std::vector<MarkerGenerator> marker_generators_;
 
 	// begin and end InterfaceState of this solution/trajectory
 	const InterfaceState* start_ = nullptr;
@@ -275,6 +351,13 @@ public:
 
 	void fillMessage(moveit_task_constructor_msgs::Solution &msg,
 	                 Introspection* introspection = nullptr) const override;
+	/// fill trajectory and end scene (diff) into msg
+	void fillPayload(moveit_task_constructor_msgs::SubTrajectory &msg) const;
+
+	size_t footprint() const override;
+	void visitSubTrajectories(const std::function<void(const SubTrajectory&)>& visitor) const override {
+		visitor(*this);
+	}
 
 private:
 	// actual trajectory, might be empty
@@ -303,6 +386,8 @@ public:
 
 	/// append all subsolutions to solution
 	void fillMessage(moveit_task_constructor_msgs::Solution &msg, Introspection *introspection) const override;
+	size_t footprint() const override;
+	void visitSubTrajectories(const std::function<void(const SubTrajectory&)>& visitor) const override;
 
 	inline const InterfaceState* internalStart() const { return subsolutions_.front()->start(); }
 	inline const InterfaceState* internalEnd() const { return subsolutions_.back()->end(); }
@@ -46,6 +46,11 @@
 
 #include <moveit/macros/class_forward.h>
 
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <queue>
+
 namespace moveit { namespace core {
 	MOVEIT_CLASS_FORWARD(RobotModel)
 	MOVEIT_CLASS_FORWARD(RobotState)
@@ -60,6 +65,11 @@ namespace moveit { namespace task_constructor {
 MOVEIT_CLASS_FORWARD(Stage)
 MOVEIT_CLASS_FORWARD(ContainerBase)
 MOVEIT_CLASS_FORWARD(Task)
+MOVEIT_CLASS_FORWARD(MemoryPool)
+class Scheduler;
+class CostBound;
+class Deadline;
+MOVEIT_CLASS_FORWARD(PlanHandle)
 
 /** A Task is the root of a tree of stages.
  *
@@ -69,10 +79,39 @@ MOVEIT_CLASS_FORWARD(Task)
 class Task : protected WrapperBase {
 public:
 	// +1 TODO: move into MoveIt! core
+	/** get the planning pipeline for given model and parameters, creating it if required (thread-safe)
+	 *
+	 * Pipelines are shared by all tasks (of the process), as long as they are used.
+	 * Creating a pipeline loads and configures its plugins, which is serialized among all threads. */
 	static planning_pipeline::PlanningPipelinePtr createPlanner(const moveit::core::RobotModelConstPtr &model,
 	                                                            const std::string &ns = "move_group",
 	                                                            const std::string &planning_plugin_param_name = "planning_plugin",
 	                                                            const std::string &adapter_plugins_param_name = "request_adapters");
+	/** preload planning pipelines for all given namespaces, e.g. at startup, to not pay their creation at plan time
+	 *
+	 * Preloaded pipelines are retained (even if no task uses them) until releasePlanners() is called.
+	 * Pipelines are cached per model instance: tasks only benefit if they use the same model.
+	 * A retained pipeline keeps its model alive: if the model was not loaded via loadRobotModel()
+	 * (or the overload below), the caller needs to keep its RobotModelLoader alive until releasePlanners().
+	 * Creating pipelines doesn't block other tasks: only the cache lookup is serialized. */
+	static void warmUpPlanners(const moveit::core::RobotModelConstPtr &model,
+	                           const std::vector<std::string> &namespaces = { "move_group" },
+	                           const std::string &planning_plugin_param_name = "planning_plugin",
+	                           const std::string &adapter_plugins_param_name = "request_adapters");
+	/** preload planning pipelines for the model loaded from robot_description
+	 *
+	 * The model (and its loader) is shared with all tasks calling loadRobotModel(robot_description, true)
+	 * and retained together with the pipelines. */
+	static void warmUpPlanners(const std::string &robot_description,
+	                           const std::vector<std::string> &namespaces = { "move_group" },
+	                           const std::string &planning_plugin_param_name = "planning_plugin",
+	                           const std::string &adapter_plugins_param_name = "request_adapters");
+	/** retain all pipelines (and model loaders) created from now on, even if no task uses them anymore
+	 *
+	 * Otherwise (default), a pipeline is destroyed with the last task using it. */
+	static void setRetainPlanners(bool retain);
+	/// release all retained pipelines and loaders: they are destroyed with the last task using them
+	static void releasePlanners();
 	Task(const std::string& id = "",
 	     ContainerBase::pointer &&container = std::make_unique<SerialContainer>("task pipeline"));
 	Task(Task &&other);
@@ -84,8 +123,12 @@ public:
 	const moveit::core::RobotModelConstPtr& getRobotModel() const { return robot_model_; }
 	/// setting the robot model also resets the task
 	void setRobotModel(const moveit::core::RobotModelConstPtr& robot_model);
-	/// load robot model from given parameter
-	void loadRobotModel(const std::string& robot_description = "robot_description");
+	/** load robot model from given parameter
+	 *
+	 * By default, each task loads its own model. If share is true, the model (and thus the planning pipelines)
+	 * is shared with all other tasks sharing the given parameter. These tasks also share the model's kinematics
+	 * solver instances, which are not reentrant in general: only share if the tasks don't plan concurrently. */
+	void loadRobotModel(const std::string& robot_description = "robot_description", bool share = false);
 
 	// TODO: use Stage::insert as well?
 	void add(Stage::pointer &&stage);
@@ -107,9 +150,55 @@ public:
 	/// initialize all stages with given scene
 	void init();
 
-	/// reset, init scene (if not yet done), and init all stages, then start planning
-	bool plan(size_t max_solutions = 0);
-	/// interrupt current planning (or execution)
+	/** set number of threads used for planning (0: hardware concurrency)
+	 *
+	 * By default, stages are computed serially in a single thread.
+	 * With multiple threads, the children of containers are computed concurrently.
+	 * See Scheduler for the rules stages need to follow in this case. */
+	void setNumThreads(unsigned int num_threads);
+	unsigned int numThreads() const { return num_threads_; }
+
+	/** only the best k solutions are of interest: prune computations that cannot improve on them (0: disabled)
+	 *
+	 * Once k solutions were found, stages skip input states (and Connecting stages state pairs),
+	 * whose already accumulated partial solution cost plus the stage's costLowerBound()
+	 * is not below the cost of the k-th best solution. This assumes non-negative costs.
+	 * Pruned computations are counted as "pruned" in Stage::counters(). */
+	void setPruning(size_t k) { pruning_ = k; }
+	size_t pruning() const { return pruning_; }
+
+	/** reset, init scene (if not yet done), and init all stages, then start planning
+	 *
+	 * Planning stops when max_solutions are found (0: unlimited) or after timeout seconds.
+	 * With a finite timeout, the remaining time is divided among the stages able to compute,
+	 * limiting their timeout() per computation. */
+	bool plan(size_t max_solutions = 0, double timeout = std::numeric_limits<double>::infinity());
+	/** start planning in a background thread, returning immediately
+	 *
+	 * The returned handle streams new solutions and allows to cancel planning (see PlanHandle).
+	 * Task and stage callbacks are called from the planning thread. Until planning finished,
+	 * the task must not be accessed otherwise, except for preempt(). */
+	PlanHandlePtr planAsync(size_t max_solutions = 0, double timeout = std::numeric_limits<double>::infinity());
+	/** continue planning with the existing states and solutions of all stages, i.e. without reset() and init()
+	 *
+	 * Only valid after a previous call to plan(), e.g. one that stopped due to max_solutions, timeout, or preempt().
+	 * Planning continues with the scenes obtained by plan(). Thus, resume() refuses (returning false),
+	 * if dropInvalidSolutions() detected a changed start scene: plan() is needed to plan for the new scene. */
+	bool resume(size_t max_solutions = 0, double timeout = std::numeric_limits<double>::infinity());
+	/** drop all solutions, which are not valid anymore for the changed start scene, returns their number
+	 *
+	 * This only filters the existing solutions, it doesn't plan. Each solution's start scene is compared to scene:
+	 *  - If robot state, attached bodies, or ACM differ, the solution is dropped.
+	 *  - If world objects were added, removed, moved, or reshaped, all sub trajectories of the solution are
+	 *    re-checked for collisions with the changed objects. Solutions attaching a changed object are dropped.
+	 *
+	 * Limitations: Only complete solutions are validated, interface states and partial solutions of stages
+	 * are kept. Poses derived from other objects (e.g. place poses on a moved table) are not re-validated.
+	 * Kept solutions continue to refer to their original scenes. To plan for the new scene, stages need to
+	 * obtain it themselves (e.g. CurrentState, or an updated FixedState) when calling plan() again,
+	 * which resets the task, including the kept solutions. */
+	size_t dropInvalidSolutions(const planning_scene::PlanningSceneConstPtr& scene);
+	/// interrupt current planning (or execution), running stages see an expired deadline
 	void preempt();
 	/// execute solution
 	void execute(const SolutionBase& s);
@@ -119,7 +208,7 @@ public:
 
 	size_t numSolutions() const { return solutions().size(); }
 	const ordered<SolutionBaseConstPtr>& solutions() const { return stages()->solutions(); }
-	const std::list<SolutionBaseConstPtr>& failures() const { return stages()->failures(); }
+	const std::deque<SolutionBaseConstPtr>& failures() const { return stages()->failures(); }
 
 	/// publish all top-level solutions
 	void publishAllSolutions(bool wait = true);
@@ -140,16 +229,45 @@ public:
 		setProperty(name, std::string(value));
 	}
 
-protected:
+	/** single planning step, allowing for a custom planning loop (without ROS): init(); while (canCompute()) compute();
+	 *
+	 * When planning in parallel, compute() holds the scheduler's lock while computing. */
 	bool canCompute() const override;
 	void compute() override;
+
+protected:
 	void onNewSolution(const SolutionBase &s) override;
 
 private:
 	std::string id_;
 	robot_model_loader::RobotModelLoaderPtr robot_model_loader_;
 	moveit::core::RobotModelConstPtr robot_model_;
-	bool preempt_requested_;
+	std::atomic<bool> preempt_requested_;
+
+	// parallel planning
+	unsigned int num_threads_ = 1;
+	std::unique_ptr<Scheduler> scheduler_;
+
+	// memory pool for states and solutions, released on reset()
+	MemoryPoolPtr memory_pool_;
+
+	// branch-and-bound pruning using the cost of the k-th best solution
+	size_t pruning_ = 0;
+	// can resume() continue planning? Set by plan(), cleared by reset() and a changed start scene
+	bool resumable_ = false;
+	std::unique_ptr<CostBound> cost_bound_;
+	// costs of the (up to) pruning_ best solutions, the largest one on top
+	std::priority_queue<double> best_costs_;
+
+	// wall-clock deadline of planning
+	std::unique_ptr<Deadline> deadline_;
+
+	// handle of asynchronous planning (if running), accessed by the planning and the calling thread
+	std::weak_ptr<PlanHandle> plan_handle_;
+	std::mutex plan_handle_mutex_;  // protects plan_handle_
+	PlanHandlePtr planHandle();
+	// plan without resetting preemption requests, optionally resuming without reset() and init()
+	bool planImpl(size_t max_solutions, double timeout, bool resume = false);
 
 	// introspection and monitoring
 	std::unique_ptr<Introspection> introspection_;
@@ -0,0 +1,86 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Robert Haschke
+   Desc:   Timing statistics of instrumented code sections
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+
+namespace moveit { namespace task_constructor {
+
+/// accumulated wall-clock durations [s] of an instrumented code section
+struct TimingStatistics {
+	size_t count = 0;
+	double total = 0.0;
+	double min = std::numeric_limits<double>::infinity();
+	double max = 0.0;
+
+	inline void add(double duration) {
+		++count;
+		total += duration;
+		if (duration < min) min = duration;
+		if (duration > max) max = duration;
+	}
+	inline double mean() const { return count ? total / count : 0.0; }
+};
+
+/** add duration of its scope to given statistics (if not null)
+ *
+ * Statistics of a stage are protected by the stage's mutex. When combined with Stage::Unlocked,
+ * declare the timer before the Unlocked guard, such that it is destroyed (and records) after relocking. */
+class ScopedTimer {
+	typedef std::chrono::steady_clock Clock;
+
+public:
+	explicit ScopedTimer(TimingStatistics* stats) : stats_(stats) {
+		if (stats_) start_ = Clock::now();
+	}
+	explicit ScopedTimer(TimingStatistics& stats) : ScopedTimer(&stats) {}
+	~ScopedTimer() {
+		if (stats_) stats_->add(std::chrono::duration<double>(Clock::now() - start_).count());
+	}
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+	TimingStatistics* stats_;
+	Clock::time_point start_;
+};
+
+} }
@@ -40,6 +40,9 @@
 
 #include <type_traits>
 #include <initializer_list>
+#include <algorithm>
+#include <list>
+#include <map>
 
 /** template class to compose flags from enums in a type-safe fashion */
 template<typename Enum>
@@ -94,3 +97,58 @@ private:
 };
 
 #define DECLARE_FLAGS(Flags, Enum) typedef QFlags<Enum> Flags;
+
+namespace moveit { namespace task_constructor {
+
+/// cache of values (e.g. serialized messages), evicting the least recently used entries beyond capacity
+template <class Key, class Value>
+class LRUCache {
+	typedef std::list<std::pair<Key, Value>> Entries;
+	Entries entries_;  // most recently used first
+	std::map<Key, typename Entries::iterator> index_;
+	size_t capacity_;
+
+	void evict() {
+		while (entries_.size() > capacity_) {
+			index_.erase(entries_.back().first);
+			entries_.pop_back();
+		}
+	}
+
+public:
+	LRUCache(size_t capacity) : capacity_(capacity) {}
+
+	size_t size() const { return entries_.size(); }
+
+	/// cached value of key, filled by fill(Value&) if not yet cached
+	template <class Fill>
+	const Value& get(const Key& key, const Fill& fill) {
+		auto it = index_.find(key);
+		if (it != index_.end()) {
+			entries_.splice(entries_.begin(), entries_, it->second);
+			return entries_.front().second;
+		}
+		entries_.emplace_front(key, Value());
+		fill(entries_.front().second);
+		index_.emplace(key, entries_.begin());
+		evict();  // keeps the front entry for capacity > 0
+		return entries_.front().second;
+	}
+	void erase(const Key& key) {
+		auto it = index_.find(key);
+		if (it == index_.end())
+			return;
+		entries_.erase(it->second);
+		index_.erase(it);
+	}
+	void clear() {
+		entries_.clear();
+		index_.clear();
+	}
+	void setCapacity(size_t capacity) {
+		capacity_ = std::max<size_t>(capacity, 1);
+		evict();
+	}
+};
+
+} }
@@ -37,6 +37,7 @@
 #include <moveit/task_constructor/container_p.h>
 #include <moveit/task_constructor/introspection.h>
 #include <moveit/task_constructor/merge.h>
+#include <moveit/task_constructor/scheduler.h>
 #include <moveit/planning_scene/planning_scene.h>
 
 #include <ros/console.h>
@@ -44,6 +45,9 @@
 #include <memory>
 #include <iostream>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
 #include <boost/range/adaptor/reversed.hpp>
 #include <boost/format.hpp>
 #include <functional>
@@ -55,8 +59,8 @@ namespace moveit { namespace task_constructor {
 ContainerBasePrivate::ContainerBasePrivate(ContainerBase *me, const std::string &name)
    : StagePrivate(me, name)
 {
-	pending_backward_.reset(new Interface);
-	pending_forward_.reset(new Interface);
+	pending_backward_.reset(new Interface(Interface::NotifyFunction(), interface_timing_));
+	pending_forward_.reset(new Interface(Interface::NotifyFunction(), interface_timing_));
 }
 
 ContainerBasePrivate::const_iterator ContainerBasePrivate::childByIndex(int index, bool for_insert) const {
@@ -123,6 +127,39 @@ void ContainerBasePrivate::compute()
 	static_cast<ContainerBase*>(me_)->compute();
 }
 
+void ContainerBasePrivate::computeChildren()
+{
+	auto compute = [](Stage& stage) {
+		try {
+			ROS_DEBUG("Computing stage '%s'", stage.name().c_str());
+			stage.pimpl()->runCompute();
+		} catch (const Property::error &e) {
+			stage.reportPropertyError(e);
+		}
+	};
+
+	if (!scheduler()) {
+		for (const auto& child : children_) {
+			if (child->pimpl()->canCompute())
+				compute(*child);
+		}
+		return;
+	}
+
+	// compute all children, which are ready for computation, concurrently
+	std::vector<Scheduler::Job> jobs;
+	for (const auto& child : children_) {
+		if (!child->pimpl()->canCompute())
+			continue;
+		Stage* stage = child.get();
+		jobs.push_back([compute, stage]() { compute(*stage); });
+	}
+	if (jobs.size() == 1)
+		jobs.front()();  // no need to involve other threads
+	else if (!jobs.empty())
+		scheduler()->parallel(jobs, scheduler()->heldLock());
+}
+
 void ContainerBasePrivate::copyState(Interface::iterator external, const InterfacePtr& target, bool updated) {
 	// TODO: update internal's prio from external's new priority
 	if (updated)
@@ -300,102 +337,186 @@ std::ostream& operator<<(std::ostream& os, const ContainerBase& container) {
 }
 
 
-struct SolutionCollector {
-	SolutionCollector(size_t max_depth) : max_depth(max_depth) {}
+namespace {
+// trajectories attached to state in given direction
+template <Interface::Direction dir>
+const InterfaceState::Solutions& trajectories(const InterfaceState* state);
+template <>
+const InterfaceState::Solutions& trajectories<Interface::FORWARD>(const InterfaceState* state) {
+	return state->outgoingTrajectories();
+}
+template <>
+const InterfaceState::Solutions& trajectories<Interface::BACKWARD>(const InterfaceState* state) {
+	return state->incomingTrajectories();
+}
+
+// state reached when following solution in given direction
+template <Interface::Direction dir>
+const InterfaceState* follow(const SolutionBase* solution);
+template <>
+const InterfaceState* follow<Interface::FORWARD>(const SolutionBase* solution) { return solution->end(); }
+template <>
+const InterfaceState* follow<Interface::BACKWARD>(const SolutionBase* solution) { return solution->start(); }
+}
 
-	void operator()(const SolutionSequence::container_type& trace, double cost) {
-#ifndef NDEBUG
-		// Traced path should not extend past container boundaries, i.e. trace.size() <= max_depth
-		// However, as the Merging-Connect's solution may be composed of several subsolutions, we need to disregard those
-		size_t len = trace.size();
-		const StagePrivate* prev_creator = nullptr;
-		for (const auto& s : trace) {
-			if (s->creator() == prev_creator)
-				--len;
-			else
-				prev_creator = s->creator();
+template <Interface::Direction dir>
+const InterfaceState::Priority& SerialContainerPrivate::summary(const InterfaceState* state)
+{
+	StateSummary& entry = summaries_[state];  // references remain valid on rehashing
+	if (!entry.valid[dir])
+		updateSummary<dir>(state);
+	return entry.best[dir];
+}
+
+template <Interface::Direction dir>
+bool SerialContainerPrivate::updateSummary(const InterfaceState* state)
+{
+	// best path in direction dir: (0, 0.0) if there are no trajectories at all
+	InterfaceState::Priority best;
+	bool first = true;
+	for (const SolutionBase* solution : trajectories<dir>(state)) {
+		// failures are considered too: they mark paths with infinite costs
+		InterfaceState::Priority prio = summary<dir>(follow<dir>(solution)) + InterfaceState::Priority(1, solution->cost());
+		if (first || prio < best) {
+			best = prio;
+			first = false;
 		}
-		assert(len <= max_depth);
-#endif
-		solutions.emplace_back(std::make_pair(trace, cost));
 	}
 
-	typedef std::list<std::pair<SolutionSequence::container_type, double>> SolutionCostPairs;
-	SolutionCostPairs solutions;
-	const size_t max_depth;
-};
-
-void updateStateCosts(const SolutionSequence::container_type &partial_solution_path,
-                      const InterfaceState::Priority &prio) {
-	for (const SolutionBase* solution : partial_solution_path) {
-		// here it suffices to update the start state, because the end state is the start state
-		// of the next solution (they are all connected)
-		InterfaceState* state = const_cast<InterfaceState*>(solution->start());
-		if (state->owner()) state->owner()->updatePriority(state, prio);
+	StateSummary& entry = summaries_[state];
+	bool changed = !entry.valid[dir] || best != entry.best[dir];
+	entry.best[dir] = best;
+	entry.valid[dir] = true;
+	return changed;
+}
+
+template <Interface::Direction dir>
+void SerialContainerPrivate::propagate(const InterfaceState* state, std::vector<const InterfaceState*>& touched)
+{
+	// summaries in direction dir depend on states in this direction: propagate changes into opposite direction
+	constexpr Interface::Direction opposite = dir == Interface::FORWARD ? Interface::BACKWARD : Interface::FORWARD;
+	std::vector<const InterfaceState*> todo { state };
+	while (!todo.empty()) {
+		state = todo.back();
+		todo.pop_back();
+		if (!updateSummary<dir>(state))
+			continue;
+		touched.push_back(state);
+		for (const SolutionBase* solution : trajectories<opposite>(state))
+			todo.push_back(follow<opposite>(solution));
 	}
-	// finally update the end state of the last solution
-	if (partial_solution_path.empty()) return;
-	InterfaceState* state = const_cast<InterfaceState*>(partial_solution_path.back()->end());
-	if (state->owner()) state->owner()->updatePriority(state, prio);
 }
 
-void SerialContainer::onNewSolution(const SolutionBase &current)
+void SerialContainerPrivate::onNewSolution(const SolutionBase& current)
 {
-	auto impl = pimpl();
-	const StagePrivate *creator = current.creator();
-	auto& children = impl->children();
+	const size_t latest = sequence_.size();
+	sequence_.emplace(&current, latest);
 
 	// find number of stages before and after creator stage
-	size_t num_before = 0, num_after = 0;
-	for (auto it = children.begin(), end = children.end(); it != end; ++it, ++num_before)
-		if ((*it)->pimpl() == creator)
+	size_t num_before = 0;
+	for (auto it = children().begin(), end = children().end(); it != end; ++it, ++num_before)
+		if ((*it)->pimpl() == current.creator())
 			break;
-	assert(num_before < children.size());  // creator should be one of our children
-	num_after = children.size()-1 - num_before;
-
-	SolutionSequence::container_type trace; trace.reserve(children.size());
-
-	// find all incoming solution paths ending at current solution
-	SolutionCollector incoming(num_before);
-	traverse<Interface::BACKWARD>(current, std::ref(incoming), trace);
-
-	// find all outgoing solution paths starting at current solution
-	SolutionCollector outgoing(num_after);
-	traverse<Interface::FORWARD>(current, std::ref(outgoing), trace);
-
-	// collect (and sort) all solutions spanning from start to end of this container
-	ordered<SolutionSequencePtr> sorted;
-	SolutionSequence::container_type solution;
-	solution.reserve(children.size());
-	for (auto& in : incoming.solutions) {
-		for (auto& out : outgoing.solutions) {
-			InterfaceState::Priority prio(in.first.size() + 1 + out.first.size(),
-			                              in.second + current.cost() + out.second);
-			// found a complete solution path connecting start to end?
-			if (prio.depth() == children.size()) {
-				if (std::isinf(prio.cost()))
-					continue;  // don't propagate failures
-				assert(solution.empty());
-				// insert incoming solutions in reverse order
-				solution.insert(solution.end(), in.first.rbegin(), in.first.rend());
-				// insert current solution
-				solution.push_back(&current);
-				// insert outgoing solutions in normal order
-				solution.insert(solution.end(), out.first.begin(), out.first.end());
-				// store solution in sorted list
-				sorted.insert(std::make_shared<SolutionSequence>(std::move(solution), prio.cost(), impl));
-			} else if (prio.depth() > 1) {
-				// update state priorities along the whole partial solution path
-				updateStateCosts(in.first, prio);
-				updateStateCosts({&current}, prio);
-				updateStateCosts(out.first, prio);
-			}
+	assert(num_before < children().size());  // creator should be one of our children
+	size_t num_after = children().size()-1 - num_before;
+
+	// update summaries of all states downstream (incoming paths) and upstream (outgoing paths) of current
+	std::vector<const InterfaceState*> touched;
+	propagate<Interface::BACKWARD>(current.end(), touched);
+	propagate<Interface::FORWARD>(current.start(), touched);
+
+	// update state priorities from the best partial solution path passing through them
+	for (const InterfaceState* state : touched) {
+		InterfaceState::Priority prio = summary<Interface::BACKWARD>(state) + summary<Interface::FORWARD>(state);
+		if (prio.depth() > 1 && prio.depth() < children().size() && state->owner())
+			state->owner()->updatePriority(const_cast<InterfaceState*>(state), prio);
+	}
+
+	// schedule enumeration of full solution paths through current (if there are any)
+	const InterfaceState::Priority& prefix = summary<Interface::BACKWARD>(current.start());
+	const InterfaceState::Priority& suffix = summary<Interface::FORWARD>(current.end());
+	if (prefix.depth() != num_before || suffix.depth() != num_after ||
+	    !std::isfinite(prefix.cost() + suffix.cost()))
+		return;  // don't propagate failures
+
+	SolutionPath path;
+	path.trace.push_back(&current);
+	path.latest = latest;
+	path.missing_before = num_before;
+	path.missing_after = num_after;
+	path.cost = current.cost();
+	path.estimate = path.cost + prefix.cost() + suffix.cost();
+	pending_paths_.insert(std::move(path));
+}
+
+template <Interface::Direction dir>
+void SerialContainerPrivate::extend(const SolutionPath& path)
+{
+	const bool backward = dir == Interface::BACKWARD;
+	const InterfaceState* frontier = backward ? path.trace.front()->start() : path.trace.back()->end();
+	const size_t missing = backward ? path.missing_before : path.missing_after;
+	// lower bound for the costs of the opposite end (already completed when extending forward)
+	const double remaining = backward ? summary<Interface::FORWARD>(path.trace.back()->end()).cost() : 0.0;
+
+	for (const SolutionBase* solution : trajectories<dir>(frontier)) {
+		// only consider solutions announced before the seeding one (this also skips failures)
+		auto seq = sequence_.find(solution);
+		if (seq == sequence_.end() || seq->second > path.latest)
+			continue;
+		// only consider solutions that can be completed to a full path
+		const InterfaceState::Priority& best = summary<dir>(follow<dir>(solution));
+		if (best.depth() != missing - 1 || !std::isfinite(best.cost()))
+			continue;
+
+		SolutionPath next(path);
+		if (backward) {
+			next.trace.push_front(solution);
+			--next.missing_before;
+		} else {
+			next.trace.push_back(solution);
+			--next.missing_after;
 		}
+		next.cost += solution->cost();
+		next.estimate = next.cost + best.cost() + remaining;
+		pending_paths_.insert(std::move(next));
 	}
+}
+
+void SerialContainerPrivate::liftSolutions()
+{
+	bool lifted = false;
+	while (!pending_paths_.empty()) {
+		const SolutionPath& top = pending_paths_.top();
+		bool complete = top.missing_before == 0 && top.missing_after == 0;
+		// a partial path's estimate bounds the cost of all its completions:
+		// stop extending once the cheapest full paths were announced
+		if (lifted && !complete)
+			return;
 
-	// finally store + announce new solutions to external interface
-	for (const auto &solution : sorted)
-		impl->liftSolution(solution, solution->internalStart(), solution->internalEnd());
+		SolutionPath path = pending_paths_.pop();
+		if (path.missing_before > 0)
+			extend<Interface::BACKWARD>(path);
+		else if (path.missing_after > 0)
+			extend<Interface::FORWARD>(path);
+		else {  // found the cheapest full path not announced yet
+			SolutionSequence::container_type solution(path.trace.begin(), path.trace.end());
+			auto sequence = makeSolution<SolutionSequence>(std::move(solution), path.cost, this);
+			liftSolution(sequence, sequence->internalStart(), sequence->internalEnd());
+			lifted = true;
+		}
+	}
+}
+
+void SerialContainerPrivate::resetPaths()
+{
+	summaries_.clear();
+	sequence_.clear();
+	pending_paths_.clear();
+}
+
+void SerialContainer::onNewSolution(const SolutionBase &current)
+{
+	pimpl()->onNewSolution(current);
 }
 
 
@@ -503,11 +624,13 @@ void SerialContainer::init(const moveit::core::RobotModelConstPtr& robot_model)
 	if (const InterfacePtr& target = (*start)->pimpl()->starts())
 		impl->starts_.reset(new Interface(std::bind(&SerialContainerPrivate::copyState, impl,
 		                                            std::placeholders::_1, std::cref(target),
-		                                            std::placeholders::_2)));
+		                                            std::placeholders::_2),
+		                                  impl->interface_timing_));
 	if (const InterfacePtr& target = (*last)->pimpl()->ends())
 		impl->ends_.reset(new Interface(std::bind(&SerialContainerPrivate::copyState, impl,
 		                                          std::placeholders::_1, std::cref(target),
-		                                          std::placeholders::_2)));
+		                                          std::placeholders::_2),
+		                                impl->interface_timing_));
 }
 
 // prune interface for children in range [first, last) to given direction
@@ -669,8 +792,16 @@ void SerialContainerPrivate::validateConnectivity() const
 	if (errors) throw errors;
 }
 
+void SerialContainer::reset()
+{
+	pimpl()->resetPaths();
+	ContainerBase::reset();
+}
+
 bool SerialContainer::canCompute() const
 {
+	if (pimpl()->hasPendingPaths())
+		return true;
 	for(const auto& stage : pimpl()->children()) {
 		if (stage->pimpl()->canCompute())
 			return true;
@@ -680,17 +811,11 @@ bool SerialContainer::canCompute() const
 
 void SerialContainer::compute()
 {
-	for(const auto& stage : pimpl()->children()) {
-		try {
-			if(!stage->pimpl()->canCompute())
-				continue;
-
-			ROS_DEBUG("Computing stage '%s'", stage->name().c_str());
-			stage->pimpl()->compute();
-		} catch (const Property::error &e) {
-			stage->reportPropertyError(e);
-		}
-	}
+	auto impl = pimpl();
+	impl->computeChildren();
+	// full solution paths are announced lazily: in each step, all those
+	// not more expensive than any pending partial path
+	impl->liftSolutions();
 }
 
 template <Interface::Direction dir>
@@ -710,6 +835,10 @@ void SerialContainer::traverse(const SolutionBase &start, const SolutionProcesso
 		trace.pop_back();
 	}
 }
+template void SerialContainer::traverse<Interface::FORWARD>(const SolutionBase&, const SolutionProcessor&,
+                                                           SolutionSequence::container_type&, double);
+template void SerialContainer::traverse<Interface::BACKWARD>(const SolutionBase&, const SolutionProcessor&,
+                                                            SolutionSequence::container_type&, double);
 
 
 void WrappedSolution::fillMessage(moveit_task_constructor_msgs::Solution &solution,
@@ -803,6 +932,48 @@ void ParallelContainerBasePrivate::onNewExternalState(Interface::Direction dir,
 		copyState(external, stage->pimpl()->pullInterface(dir), updated);
 }
 
+bool ParallelContainerBasePrivate::deferSolution(const SolutionBase& s)
+{
+	if (!defer_solutions_)
+		return false;
+	deferred_solutions_.push_back(&s);
+	return true;
+}
+
+void ParallelContainerBasePrivate::computeChildrenJoined()
+{
+	auto flush = [this]() {
+		defer_solutions_ = false;
+		if (deferred_solutions_.empty())
+			return;
+
+		// sort by child rank, keeping the order of each child's solutions
+		std::vector<std::pair<size_t, const SolutionBase*>> sorted;
+		sorted.reserve(deferred_solutions_.size());
+		for (const SolutionBase* s : deferred_solutions_) {
+			size_t rank = 0;
+			for (auto it = children().begin(); it != children().end() && (*it)->pimpl() != s->creator(); ++it)
+				++rank;
+			sorted.emplace_back(rank, s);
+		}
+		deferred_solutions_.clear();
+		std::stable_sort(sorted.begin(), sorted.end(),
+		                 [](const auto& a, const auto& b) { return a.first < b.first; });
+
+		for (const auto& entry : sorted)
+			static_cast<ContainerBase*>(me_)->onNewSolution(*entry.second);
+	};
+
+	defer_solutions_ = true;
+	try {
+		computeChildren();
+	} catch (...) {
+		flush();
+		throw;
+	}
+	flush();
+}
+
 
 ParallelContainerBase::ParallelContainerBase(ParallelContainerBasePrivate *impl)
    : ContainerBase(impl)
@@ -827,11 +998,13 @@ void ParallelContainerBase::init(const moveit::core::RobotModelConstPtr& robot_m
 	// initialize this' pull connections
 	impl->starts().reset(required & READS_START
 	                     ? new Interface(std::bind(&ParallelContainerBasePrivate::onNewExternalState,
-	                                               impl, Interface::FORWARD, std::placeholders::_1, std::placeholders::_2))
+	                                               impl, Interface::FORWARD, std::placeholders::_1, std::placeholders::_2),
+	                                     impl->interface_timing_)
 	                     : nullptr);
 	impl->ends().reset(required & READS_END
 	                   ? new Interface(std::bind(&ParallelContainerBasePrivate::onNewExternalState,
-	                                             impl, Interface::BACKWARD, std::placeholders::_1, std::placeholders::_2))
+	                                             impl, Interface::BACKWARD, std::placeholders::_1, std::placeholders::_2),
+	                                   impl->interface_timing_)
 	                   : nullptr);
 
 	// initialize push connections of children according to their demands
@@ -844,23 +1017,23 @@ void ParallelContainerBase::init(const moveit::core::RobotModelConstPtr& robot_m
 void ParallelContainerBase::liftSolution(const SolutionBase& solution, double cost, std::string comment)
 {
 	auto impl = pimpl();
-	impl->liftSolution(std::make_shared<WrappedSolution>(impl, &solution, cost, std::move(comment)),
+	impl->liftSolution(impl->makeSolution<WrappedSolution>(impl, &solution, cost, std::move(comment)),
 	                   solution.start(), solution.end());
 }
 
 void ParallelContainerBase::spawn(InterfaceState &&state, SubTrajectory&& t)
 {
-	pimpl()->StagePrivate::spawn(std::move(state), std::make_shared<SubTrajectory>(std::move(t)));
+	pimpl()->StagePrivate::spawn(std::move(state), pimpl()->makeSolution<SubTrajectory>(std::move(t)));
 }
 
 void ParallelContainerBase::sendForward(const InterfaceState& from, InterfaceState&& to, SubTrajectory&& t)
 {
-	pimpl()->StagePrivate::sendForward(from, std::move(to), std::make_shared<SubTrajectory>(std::move(t)));
+	pimpl()->StagePrivate::sendForward(from, std::move(to), pimpl()->makeSolution<SubTrajectory>(std::move(t)));
 }
 
 void ParallelContainerBase::sendBackward(InterfaceState&& from, const InterfaceState& to, SubTrajectory&& t)
 {
-	pimpl()->StagePrivate::sendBackward(std::move(from), to, std::make_shared<SubTrajectory>(std::move(t)));
+	pimpl()->StagePrivate::sendBackward(std::move(from), to, pimpl()->makeSolution<SubTrajectory>(std::move(t)));
 }
 
 
@@ -900,7 +1073,7 @@ bool WrapperBase::canCompute() const
 void WrapperBase::compute()
 {
 	try {
-		wrapped()->pimpl()->compute();
+		wrapped()->pimpl()->runCompute();
 	} catch (const Property::error &e) {
 		wrapped()->reportPropertyError(e);
 	}
@@ -917,23 +1090,28 @@ bool Alternatives::canCompute() const
 
 void Alternatives::compute()
 {
-	for (const auto& stage : pimpl()->children()) {
-		try {
-			stage->pimpl()->compute();
-		} catch (const Property::error &e) {
-			stage->reportPropertyError(e);
-		}
-	}
+	pimpl()->computeChildrenJoined();
 }
 
 void Alternatives::onNewSolution(const SolutionBase& s)
 {
+	if (pimpl()->deferSolution(s))
+		return;
 	liftSolution(s);
 }
 
+Fallbacks::Fallbacks(const std::string &name)
+   : ParallelContainerBase(name)
+{
+	properties().declare<double>("speculation_delay", std::numeric_limits<double>::infinity(),
+	                             "delay [s] between speculatively starting lower-ranked children");
+}
+
 void Fallbacks::reset()
 {
 	active_child_ = nullptr;
+	limit_ = nullptr;
+	started_ = false;
 	ParallelContainerBase::reset();
 }
 
@@ -943,34 +1121,98 @@ void Fallbacks::init(const moveit::core::RobotModelConstPtr& robot_model)
 	active_child_ = pimpl()->children().front().get();
 }
 
+bool Fallbacks::speculate(const Stage* child, size_t rank) const
+{
+	double delay = properties().get<double>("speculation_delay");
+	if (!std::isfinite(delay) || !started_)
+		return false;
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count() >= rank * delay &&
+	       child->pimpl()->canCompute();
+}
+
 bool Fallbacks::canCompute() const
 {
-	while (active_child_) {
-		StagePrivate* child = active_child_->pimpl();
-		if (child->canCompute()) return true;
+	for (auto it = active_child_ ? active_child_->pimpl()->it() : pimpl()->children().end();
+	     it != pimpl()->children().end(); ++it) {
+		const Stage* child = it->get();
+		if (child->pimpl()->canCompute())
+			return true;
+		// solutions of a speculatively computed child are pending
+		if (child != active_child_ && !child->solutions().empty())
+			return true;
+		if (child == limit_)
+			break;
+	}
+	return false;
+}
 
-		// active child failed, continue with next
-		auto next = child->it(); ++next;
+void Fallbacks::activateNext()
+{
+	while (active_child_ && !active_child_->pimpl()->canCompute()) {
+		// active child failed, continue with next (unless stopped by a higher-ranked success)
+		auto next = active_child_->pimpl()->it(); ++next;
+		if (active_child_ == limit_ || next == pimpl()->children().end()) {
+			active_child_ = nullptr;
+			break;
+		}
 		active_child_ = next->get();
+
+		// report solutions found while computing speculatively
+		for (const SolutionBaseConstPtr& s : active_child_->solutions())
+			liftSolution(*s);
 	}
-	return false;
 }
 
 void Fallbacks::compute()
 {
+	activateNext();
 	if (!active_child_)
 		return;
 
-	try {
-		active_child_->pimpl()->compute();
-	} catch (const Property::error &e) {
-		active_child_->reportPropertyError(e);
+	if (!started_) {
+		start_ = std::chrono::steady_clock::now();
+		started_ = true;
+	}
+
+	// compute active child and lower-ranked children that are due for speculation
+	std::vector<Stage*> children { active_child_ };
+	const auto& all = pimpl()->children();
+	for (auto it = active_child_->pimpl()->it(); it->get() != limit_ && ++it != all.end();)
+		if (speculate(it->get(), std::distance(all.cbegin(), it)))
+			children.push_back(it->get());
+
+	auto compute = [](Stage& stage) {
+		try {
+			stage.pimpl()->runCompute();
+		} catch (const Property::error &e) {
+			stage.reportPropertyError(e);
+		}
+	};
+	if (children.size() == 1 || !pimpl()->scheduler()) {
+		for (Stage* child : children)
+			compute(*child);
+		return;
 	}
+	std::vector<Scheduler::Job> jobs;
+	for (Stage* child : children)
+		jobs.push_back([compute, child]() { compute(*child); });
+	Scheduler* scheduler = pimpl()->scheduler();
+	scheduler->parallel(jobs, scheduler->heldLock());
 }
 
 void Fallbacks::onNewSolution(const SolutionBase& s)
 {
-	liftSolution(s);
+	const Stage* child = s.creator()->me();
+	if (std::isfinite(properties().get<double>("speculation_delay"))) {
+		// stop all lower-ranked children
+		if (!limit_ || std::find_if(child->pimpl()->it(), pimpl()->children().end(),
+		                            [this](const Stage::pointer& other) { return other.get() == limit_; })
+		                  != pimpl()->children().end())
+			limit_ = child;
+	}
+	// hold back solutions of speculatively computed children
+	if (child == active_child_)
+		liftSolution(s);
 }
 
 
@@ -1028,6 +1270,7 @@ void Merger::init(const core::RobotModelConstPtr& robot_model)
 Merger::Merger(MergerPrivate *impl)
    : ParallelContainerBase(impl)
 {
+	properties().declare<uint32_t>("max_merges", 0, "max number of merged combinations per source state (0: unlimited)");
 }
 
 bool Merger::canCompute() const
@@ -1040,18 +1283,14 @@ bool Merger::canCompute() const
 
 void Merger::compute()
 {
-	for (const auto& stage : pimpl()->children()) {
-		try {
-			stage->pimpl()->compute();
-		} catch (const Property::error &e) {
-			stage->reportPropertyError(e);
-		}
-	}
+	pimpl()->computeChildrenJoined();
 }
 
 void Merger::onNewSolution(const SolutionBase& s)
 {
 	auto impl = pimpl();
+	if (impl->deferSolution(s))
+		return;
 	switch (impl->interfaceFlags()) {
 	case PROPAGATE_FORWARDS:
 	case PROPAGATE_BACKWARDS:
@@ -1072,6 +1311,8 @@ void MergerPrivate::onNewPropagateSolution(const SolutionBase& s)
 		ROS_ERROR_NAMED("Merger", "Only simple trajectories are supported");
 		return;
 	}
+	if (s.isFailure())
+		return;  // failures cannot contribute to any valid combination
 
 	InterfaceFlags dir = interfaceFlags();
 	assert(dir == PROPAGATE_FORWARDS || dir == PROPAGATE_BACKWARDS);
@@ -1084,13 +1325,16 @@ void MergerPrivate::onNewPropagateSolution(const SolutionBase& s)
 	assert(source_it != internalToExternalMap().end());
 	InterfaceState* external_source_state = &*source_it->second;
 
-	// retrieve (or create if necessary) the ChildSolutionMap for the given external source state
-	ChildSolutionMap& all_solutions = source_state_to_solutions_.insert(std::make_pair(external_source_state, ChildSolutionMap())).first->second;
+	// retrieve (or create if necessary) the bookkeeping for the given external source state
+	SourceSolutions& source = source_state_to_solutions_[external_source_state];
+	ChildSolutionMap& all_solutions = source.solutions;
 
 	// retrieve (or create if necessary) the ChildSolutionList corresponding to the child
-	ChildSolutionList& child_solutions = all_solutions.insert(std::make_pair(s.creator(), ChildSolutionList())).first->second;
-	// insert the new child solution into the list
-	child_solutions.push_back(trajectory);
+	ChildSolutionList& child_solutions = all_solutions[s.creator()];
+	// insert the new child solution into the list, sorted by cost
+	child_solutions.insert(std::upper_bound(child_solutions.begin(), child_solutions.end(), trajectory,
+	                                        [](const SubTrajectory* a, const SubTrajectory* b) { return a->cost() < b->cost(); }),
+	                       trajectory);
 
 	// do we have solutions for all children?
 	if (all_solutions.size() < children().size()) return;
@@ -1098,7 +1342,7 @@ void MergerPrivate::onNewPropagateSolution(const SolutionBase& s)
 
 	// combine the new solution with all solutions from other children
 	auto spawner = dir == PROPAGATE_FORWARDS ? &MergerPrivate::sendForward : &MergerPrivate::sendBackward;
-	mergeAnyCombination(all_solutions, s, external_source_state->scene(),
+	mergeAnyCombination(source, s, external_source_state->scene(),
 	                    std::bind(spawner, this, std::placeholders::_1, external_source_state));
 }
 
@@ -1107,7 +1351,7 @@ void MergerPrivate::sendForward(SubTrajectory&& t, const InterfaceState* from)
 	// generate target state
 	planning_scene::PlanningScenePtr to = from->scene()->diff();
 	to->setCurrentState(t.trajectory()->getLastWayPoint());
-	StagePrivate::sendForward(*from, InterfaceState(to), std::make_shared<SubTrajectory>(std::move(t)));
+	StagePrivate::sendForward(*from, InterfaceState(to), makeSolution<SubTrajectory>(std::move(t)));
 }
 
 void MergerPrivate::sendBackward(SubTrajectory&& t, const InterfaceState* to)
@@ -1115,7 +1359,7 @@ void MergerPrivate::sendBackward(SubTrajectory&& t, const InterfaceState* to)
 	// generate target state
 	planning_scene::PlanningScenePtr from = to->scene()->diff();
 	from->setCurrentState(t.trajectory()->getFirstWayPoint());
-	StagePrivate::sendBackward(InterfaceState(from), *to, std::make_shared<SubTrajectory>(std::move(t)));
+	StagePrivate::sendBackward(InterfaceState(from), *to, makeSolution<SubTrajectory>(std::move(t)));
 }
 
 void MergerPrivate::onNewGeneratorSolution(const SolutionBase& s)
@@ -1123,52 +1367,144 @@ void MergerPrivate::onNewGeneratorSolution(const SolutionBase& s)
 	// TODO: implement in similar fashion as onNewPropagateSolution(), but also merge start/end states
 }
 
-void MergerPrivate::mergeAnyCombination(const ChildSolutionMap& all_solutions, const SolutionBase& current,
+void MergerPrivate::mergeAnyCombination(SourceSolutions& source, const SolutionBase& current,
                                         const planning_scene::PlanningSceneConstPtr& start_scene, const Spawner& spawner)
 {
-	std::vector<size_t> indeces; // which solution index was considered last for i-th child?
-	indeces.reserve(children().size());
+	enumerateCombinations(source, current.creator(), static_cast<const SubTrajectory*>(&current),
+	                      me()->properties().get<uint32_t>("max_merges"),
+	                      [&](const ChildSolutionList& sub_solutions) {
+		return merge(source, sub_solutions, start_scene, spawner);
+	});
+}
+
+void MergerPrivate::enumerateCombinations(SourceSolutions& source, const StagePrivate* creator, const SubTrajectory* current,
+                                          uint32_t max_merges, const CombinationMerger& merge)
+{
+	// candidate solutions per child, sorted by cost: only the current solution for its creator
+	ChildSolutionList current_only { current };
+	std::vector<const ChildSolutionList*> candidates;
+	candidates.reserve(source.solutions.size());
+	for (const auto& pair : source.solutions)
+		candidates.push_back(pair.first == creator ? &current_only : &pair.second);
+
+	// best-first enumeration of combinations: starting from the cheapest one (all zero indeces),
+	// successors increment a single index, which is not lower than the last incremented one
+	struct Combination {
+		double cost;
+		std::vector<size_t> indeces;  // solution index per child
+		size_t first;  // lowest child index allowed to increment
+		bool operator<(const Combination& other) const { return cost > other.cost; }  // min-heap
+	};
+	std::priority_queue<Combination> queue;
+	Combination cheapest { 0.0, std::vector<size_t>(candidates.size(), 0), 0 };
+	for (const ChildSolutionList* list : candidates)
+		cheapest.cost += list->front()->cost();
+	queue.push(std::move(cheapest));
+
+	ChildSolutionList sub_solutions(candidates.size());
+	while (!queue.empty() && (max_merges == 0 || source.merges < max_merges)) {
+		Combination combination = queue.top();
+		queue.pop();
+		for (size_t child = combination.first; child < candidates.size(); ++child) {
+			const ChildSolutionList& list = *candidates[child];
+			size_t index = combination.indeces[child];
+			if (index + 1 >= list.size())
+				continue;
+			Combination next { combination.cost + list[index + 1]->cost() - list[index]->cost(), combination.indeces, child };
+			++next.indeces[child];
+			queue.push(std::move(next));
+		}
 
-	ChildSolutionList sub_solutions;
-	sub_solutions.reserve(children().size());
+		for (size_t child = 0; child < candidates.size(); ++child)
+			sub_solutions[child] = (*candidates[child])[combination.indeces[child]];
+		if (hasConflict(source, sub_solutions))
+			continue;  // known to collide, don't materialize
 
-	// initialize vector of sub solutions
-	for (const auto &pair : all_solutions) {
-		// all children, except current solution's creator, start with zero index
-		indeces.push_back(pair.first != current.creator() ? 0 : pair.second.size()-1);
-		sub_solutions.push_back(pair.second[indeces.back()]);
+		if (merge(sub_solutions))
+			++source.merges;
 	}
-	while (true) {
-		merge(sub_solutions, start_scene, spawner);
-
-		// compose next combination
-		size_t child = 0;
-		for (auto it = all_solutions.cbegin(), end = all_solutions.cend(); it != end; ++it, ++child) {
-			if (it->first == current.creator()) continue;  // skip current solution's child
-			if (++indeces[child] >= it->second.size()) {
-				indeces[child] = 0;  // start over with zero
-				sub_solutions[child] = it->second[indeces[child]];
-				continue; // and continue with next child
-			}
-			// otherwise, a new solution combination is available
-			sub_solutions[child] = it->second[indeces[child]];
-			break;
+}
+
+bool MergerPrivate::hasConflict(const SourceSolutions& source, const ChildSolutionList& sub_solutions)
+{
+	if (source.conflicts.empty())
+		return false;
+	for (auto first = sub_solutions.begin(); first != sub_solutions.end(); ++first)
+		for (auto second = first + 1; second != sub_solutions.end(); ++second)
+			if (source.conflicts.count(std::minmax(*first, *second)))
+				return true;
+	return false;
+}
+
+void MergerPrivate::findConflicts(SourceSolutions& source, const ChildSolutionList& sub_solutions,
+                                  const robot_trajectory::RobotTrajectory& merged,
+                                  const planning_scene::PlanningSceneConstPtr& start_scene)
+{
+	if (sub_solutions.size() <= 2)
+		return;  // the pair itself is never enumerated again
+
+	// sub solution moving each joint
+	std::map<const moveit::core::JointModel*, const SubTrajectory*> joint_owner;
+	for (const SubTrajectory* sub : sub_solutions) {
+		if (sub->trajectory())
+			for (const moveit::core::JointModel* jm : sub->trajectory()->getGroup()->getJointModels())
+				joint_owner[jm] = sub;
+	}
+	// unique sub solution determining the link's pose, nullptr if there is none or several
+	auto link_owner = [&joint_owner](const moveit::core::LinkModel* link) -> const SubTrajectory* {
+		const SubTrajectory* owner = nullptr;
+		for (; link; link = link->getParentLinkModel()) {
+			auto it = joint_owner.find(link->getParentJointModel());
+			if (it == joint_owner.end())
+				continue;
+			if (owner && owner != it->second)
+				return nullptr;
+			owner = it->second;
 		}
-		if (child == children().size())  // all combinations exhausted?
-			break;
+		return owner;
+	};
+	auto body_owner = [&](const moveit::core::RobotState& state, const std::string& name,
+	                      collision_detection::BodyType type) -> const SubTrajectory* {
+		if (type == collision_detection::BodyTypes::ROBOT_LINK)
+			return link_owner(state.getRobotModel()->getLinkModel(name));
+		if (type == collision_detection::BodyTypes::ROBOT_ATTACHED) {
+			const moveit::core::AttachedBody* body = state.getAttachedBody(name);
+			return body ? link_owner(body->getAttachedLink()) : nullptr;
+		}
+		return nullptr;  // world objects are not owned by any sub solution
+	};
+
+	// analyse contacts of the first colliding waypoint
+	collision_detection::CollisionRequest request;
+	request.contacts = true;
+	request.max_contacts = std::numeric_limits<std::size_t>::max();
+	for (size_t i = 0; i < merged.getWayPointCount(); ++i) {
+		const moveit::core::RobotState& state = merged.getWayPoint(i);
+		collision_detection::CollisionResult result;
+		start_scene->checkCollision(request, result, state);
+		if (!result.collision)
+			continue;
+
+		for (const auto& contact : result.contacts) {
+			if (contact.second.empty())
+				continue;
+			const collision_detection::Contact& c = contact.second.front();
+			const SubTrajectory* first = body_owner(state, c.body_name_1, c.body_type_1);
+			const SubTrajectory* second = body_owner(state, c.body_name_2, c.body_type_2);
+			if (first && second && first != second)
+				source.conflicts.insert(std::minmax(first, second));
+		}
+		return;
 	}
 }
 
-void MergerPrivate::merge(const ChildSolutionList& sub_solutions,
+bool MergerPrivate::merge(SourceSolutions& source, const ChildSolutionList& sub_solutions,
                           const planning_scene::PlanningSceneConstPtr& start_scene, const Spawner& spawner)
 {
 	// transform vector of SubTrajectories into vector of RobotTrajectories
 	std::vector<robot_trajectory::RobotTrajectoryConstPtr> sub_trajectories;
 	sub_trajectories.reserve(sub_solutions.size());
 	for (const auto& sub : sub_solutions) {
-		// TODO: directly skip failures in mergeAnyCombination() or even earlier
-		if (sub->isFailure())
-			return;
 		if (sub->trajectory())
 			sub_trajectories.push_back(sub->trajectory());
 	}
@@ -1177,11 +1513,13 @@ void MergerPrivate::merge(const ChildSolutionList& sub_solutions,
 	robot_trajectory::RobotTrajectoryPtr merged = task_constructor::merge(sub_trajectories, start_scene->getCurrentState(), jmg);
 	if (jmg_merged_.get() != jmg)
 		jmg_merged_.reset(jmg);
-	if (!merged) return;
+	if (!merged) return false;
 
 	// check merged trajectory for collisions
-	if (!start_scene->isPathValid(*merged))
-		return;
+	if (!start_scene->isPathValid(*merged)) {
+		findConflicts(source, sub_solutions, *merged, start_scene);
+		return true;
+	}
 
 	SubTrajectory t(merged);
 	// accumulate costs and markers
@@ -1189,9 +1527,12 @@ void MergerPrivate::merge(const ChildSolutionList& sub_solutions,
 	for (const auto& sub : sub_solutions) {
 		costs += sub->cost();
 		t.markers().insert(t.markers().end(), sub->markers().begin(), sub->markers().end());
+		for (const auto& generator : sub->markerGenerators())
+			t.addMarkerGenerator(generator);
 	}
 	t.setCost(costs);
 	spawner(std::move(t));
+	return true;
 }
 
 } }
@@ -38,6 +38,7 @@
 #include <moveit/task_constructor/introspection.h>
 #include <moveit/task_constructor/task.h>
 #include <moveit/task_constructor/storage.h>
+#include <moveit/task_constructor/utils.h>
 #include <moveit_task_constructor_msgs/Property.h>
 
 #include <ros/node_handle.h>
@@ -46,6 +47,10 @@
 #include <moveit/planning_scene/planning_scene.h>
 
 #include <boost/bimap.hpp>
+#include <algorithm>
+#include <chrono>
+#include <list>
+#include <mutex>
 
 namespace moveit { namespace task_constructor {
 
@@ -55,6 +60,29 @@ std::string getProcessId() {
 	gethostname(our_hostname, sizeof(our_hostname)-1);
 	return std::to_string(getpid()) + "@" + our_hostname;
 }
+
+void fillStageMetrics(const Stage& stage, moveit_task_constructor_msgs::StageStatistics& s) {
+	for (const auto& counter : stage.counters()) {
+		moveit_task_constructor_msgs::Counter c;
+		c.name = counter.first;
+		c.value = counter.second;
+		s.counters.push_back(c);
+	}
+	for (const auto& pair : stage.timings()) {
+		if (pair.second.count == 0)
+			continue;
+		moveit_task_constructor_msgs::Timing t;
+		t.name = pair.first;
+		t.count = pair.second.count;
+		t.total = pair.second.total;
+		t.min = pair.second.min;
+		t.max = pair.second.max;
+		s.timings.push_back(t);
+	}
+	s.state_memory = stage.stateMemory();
+	s.solution_memory = stage.solutionMemory();
+}
+
 }
 
 class IntrospectionPrivate {
@@ -75,6 +103,15 @@ public:
 		stage_to_id_map_[&task_] = 0; // root is task having ID = 0
 
 		id_solution_bimap_.clear();
+		last_solution_id_ = 0;
+
+		// next statistics message needs to be a snapshot
+		deltas_.clear();
+		last_snapshot_ = Clock::time_point();
+
+		std::lock_guard<std::mutex> lock(payload_mutex_);
+		payloads_.clear();
+		start_scenes_.clear();
 	}
 
 	ros::NodeHandle nh_;
@@ -93,6 +130,33 @@ public:
 	/// mapping from stages to their id
 	std::map<const void*, moveit_task_constructor_msgs::StageStatistics::_id_type> stage_to_id_map_;
 	boost::bimap<uint32_t, const SolutionBase*> id_solution_bimap_;
+	uint32_t last_solution_id_ = 0;
+
+	typedef std::chrono::steady_clock Clock;
+	/// new solutions per stage since last published statistics
+	struct StageDelta {
+		std::vector<const SolutionBase*> solved;
+		std::vector<uint32_t> failed;
+	};
+	std::map<const Stage*, StageDelta> deltas_;
+	uint32_t statistics_seq_ = 0;
+	Clock::duration statistics_period_ = std::chrono::milliseconds(100);
+	Clock::duration snapshot_period_ = std::chrono::seconds(1);
+	Clock::time_point last_statistics_;
+	Clock::time_point last_snapshot_;
+
+	/// publish solutions without trajectories and scenes
+	bool light_solutions_ = false;
+	/// serializes filling of solution messages (by planning and service threads)
+	std::mutex fill_mutex_;
+	/// skip payloads while filling a light solution message
+	bool omit_payloads_ = false;
+
+	/// serialized trajectories and scenes (payloads) of SubTrajectories
+	LRUCache<const SubTrajectory*, moveit_task_constructor_msgs::SubTrajectory> payloads_{ 1000 };
+	/// serialized start scenes
+	LRUCache<const planning_scene::PlanningScene*, moveit_msgs::PlanningScene> start_scenes_{ 10 };
+	std::mutex payload_mutex_;
 };
 
 Introspection::Introspection(const Task &task)
@@ -112,10 +176,36 @@ void Introspection::publishTaskDescription()
 	impl->task_description_publisher_.publish(fillTaskDescription(msg));
 }
 
-void Introspection::publishTaskState()
+void Introspection::publishTaskState(bool force)
 {
+	const auto now = IntrospectionPrivate::Clock::now();
+	if (!force && now - impl->last_statistics_ < impl->statistics_period_)
+		return;
+	impl->last_statistics_ = now;
+
 	::moveit_task_constructor_msgs::TaskStatistics msg;
-	impl->task_statistics_publisher_.publish(fillTaskStatistics(msg));
+	if (force || impl->last_snapshot_ == IntrospectionPrivate::Clock::time_point() ||
+	    now - impl->last_snapshot_ >= impl->snapshot_period_) {
+		impl->last_snapshot_ = now;
+		fillTaskStatistics(msg);
+	} else
+		fillTaskStatisticsDelta(msg);
+	impl->deltas_.clear();
+
+	msg.seq = ++impl->statistics_seq_;
+	impl->task_statistics_publisher_.publish(msg);
+}
+
+void Introspection::setStatisticsPeriod(double period)
+{
+	impl->statistics_period_ = std::chrono::duration_cast<IntrospectionPrivate::Clock::duration>
+	                           (std::chrono::duration<double>(period));
+}
+
+void Introspection::setSnapshotPeriod(double period)
+{
+	impl->snapshot_period_ = std::chrono::duration_cast<IntrospectionPrivate::Clock::duration>
+	                         (std::chrono::duration<double>(period));
 }
 
 void Introspection::reset()
@@ -131,29 +221,90 @@ void Introspection::reset()
 
 void Introspection::registerSolution(const SolutionBase &s)
 {
-	solutionId(s);
+	uint32_t id = solutionId(s);
+
+	// remember new solution for next statistics delta
+	IntrospectionPrivate::StageDelta& delta = impl->deltas_[s.creator()->me()];
+	if (s.isFailure())
+		delta.failed.push_back(id);
+	else
+		delta.solved.push_back(&s);
+}
+
+void Introspection::unregisterSolution(const SolutionBase &s)
+{
+	impl->id_solution_bimap_.right.erase(&s);
+
+	std::lock_guard<std::mutex> lock(impl->payload_mutex_);
+	if (const SubTrajectory* t = dynamic_cast<const SubTrajectory*>(&s))
+		impl->payloads_.erase(t);
+	if (s.start())  // scene might be freed
+		impl->start_scenes_.erase(s.start()->scene().get());
 }
 
 void Introspection::fillSolution(moveit_task_constructor_msgs::Solution &msg,
-                                 const SolutionBase &s)
+                                 const SolutionBase &s, bool payload)
 {
+	std::lock_guard<std::mutex> fill_lock(impl->fill_mutex_);
+	impl->omit_payloads_ = !payload;
 	s.fillMessage(msg, this);
+	impl->omit_payloads_ = false;
+
 	msg.process_id = impl->process_id_;
 	msg.task_id = impl->task_.id();
-	s.start()->scene()->getPlanningSceneMsg(msg.start_scene);
+	if (!payload)
+		return;
+
+	std::lock_guard<std::mutex> lock(impl->payload_mutex_);
+	const planning_scene::PlanningScene* scene = s.start()->scene().get();
+	msg.start_scene = impl->start_scenes_.get(scene, [scene](moveit_msgs::PlanningScene& m) {
+		scene->getPlanningSceneMsg(m);
+	});
+}
+
+void Introspection::fillPayload(moveit_task_constructor_msgs::SubTrajectory &msg, const SubTrajectory &s)
+{
+	if (impl->omit_payloads_)
+		return;
+
+	std::lock_guard<std::mutex> lock(impl->payload_mutex_);
+	const moveit_task_constructor_msgs::SubTrajectory& payload =
+	      impl->payloads_.get(&s, [&s](moveit_task_constructor_msgs::SubTrajectory& m) { s.fillPayload(m); });
+	msg.trajectory = payload.trajectory;
+	msg.scene_diff = payload.scene_diff;
 }
 
 void Introspection::publishSolution(const SolutionBase &s)
 {
 	moveit_task_constructor_msgs::Solution msg;
-	fillSolution(msg, s);
+	fillSolution(msg, s, !impl->light_solutions_);
 	impl->solution_publisher_.publish(msg);
 }
 
+void Introspection::setLightSolutionMessages(bool light)
+{
+	impl->light_solutions_ = light;
+}
+
+bool Introspection::lightSolutionMessages() const
+{
+	return impl->light_solutions_;
+}
+
+void Introspection::setPayloadCacheSize(size_t sub_trajectories, size_t start_scenes)
+{
+	std::lock_guard<std::mutex> lock(impl->payload_mutex_);
+	impl->payloads_.setCapacity(sub_trajectories);
+	impl->start_scenes_.setCapacity(start_scenes);
+}
+
 void Introspection::publishAllSolutions(bool wait)
 {
 	for (const auto& solution : impl->task_.solutions()) {
-		publishSolution(*solution);
+		// always publish full solutions for display
+		moveit_task_constructor_msgs::Solution msg;
+		fillSolution(msg, *solution);
+		impl->solution_publisher_.publish(msg);
 
 		if (wait) {
 			std::cout << "Press <Enter> to continue ..." << std::endl;
@@ -195,8 +346,13 @@ uint32_t Introspection::stageId(const Stage* const s) const
 
 uint32_t Introspection::solutionId(const SolutionBase& s)
 {
-	auto result = impl->id_solution_bimap_.left.insert(std::make_pair(1 + impl->id_solution_bimap_.size(), &s));
-	return result.first->first;
+	auto it = impl->id_solution_bimap_.right.find(&s);
+	if (it != impl->id_solution_bimap_.right.end())
+		return it->second;
+	// ids are never reused, even if solutions were unregistered
+	uint32_t id = ++impl->last_solution_id_;
+	impl->id_solution_bimap_.left.insert(std::make_pair(id, &s));
+	return id;
 }
 
 void Introspection::fillStageStatistics(const Stage& stage, moveit_task_constructor_msgs::StageStatistics& s)
@@ -210,6 +366,8 @@ void Introspection::fillStageStatistics(const Stage& stage, moveit_task_construc
 		s.failed.push_back(solutionId(*solution));
 
 	s.num_failed = stage.numFailures();
+
+	fillStageMetrics(stage, s);
 }
 
 moveit_task_constructor_msgs::TaskDescription& Introspection::fillTaskDescription(moveit_task_constructor_msgs::TaskDescription &msg)
@@ -268,7 +426,35 @@ moveit_task_constructor_msgs::TaskStatistics& Introspection::fillTaskStatistics(
 
 	msg.id = impl->task_.id();
 	msg.process_id = impl->process_id_;
+	msg.snapshot = true;
 	return msg;
 }
 
+void Introspection::fillTaskStatisticsDelta(moveit_task_constructor_msgs::TaskStatistics &msg)
+{
+	msg.stages.clear();
+	msg.stages.reserve(impl->deltas_.size());
+	for (auto& pair : impl->deltas_) {
+		const Stage& stage = *pair.first;
+		IntrospectionPrivate::StageDelta& delta = pair.second;
+		moveit_task_constructor_msgs::StageStatistics stat;
+		stat.id = stageId(&stage);
+
+		// new successful solutions ordered by cost, as in snapshots
+		std::stable_sort(delta.solved.begin(), delta.solved.end(),
+		                 [](const SolutionBase* a, const SolutionBase* b) { return *a < *b; });
+		stat.solved.reserve(delta.solved.size());
+		for (const SolutionBase* s : delta.solved)
+			stat.solved.push_back(solutionId(*s));
+		stat.failed = std::move(delta.failed);
+		stat.num_failed = stage.numFailures();
+		fillStageMetrics(stage, stat);
+		msg.stages.push_back(std::move(stat));
+	}
+
+	msg.id = impl->task_.id();
+	msg.process_id = impl->process_id_;
+	msg.snapshot = false;
+}
+
 } }
@@ -3,6 +3,10 @@
 #include <moveit/robot_state/robot_state.h>
 #include <eigen_conversions/eigen_msg.h>
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 namespace vm = visualization_msgs;
 
 namespace moveit { namespace task_constructor {
@@ -79,6 +83,54 @@ std::vector<std::string> linkNames(const std::vector<const moveit::core::LinkMod
 	return names;
 }
 
+/** markers of a link's visual or collision elements, with poses relative to the link frame
+ *
+ * Creating geometry markers (e.g. resolving meshes) is costly. Thus, these templates are created once
+ * per robot model and link and shared by all generated markers. */
+template <class T> // with T = urdf::Visual or urdf::Collision
+std::shared_ptr<const std::vector<visualization_msgs::Marker>>
+linkMarkers(const moveit::core::RobotModelConstPtr& robot_model, const urdf::Link& link)
+{
+	struct Entry {
+		std::weak_ptr<const moveit::core::RobotModel> robot_model;  // detect reuse of a freed model's address
+		std::shared_ptr<const std::vector<visualization_msgs::Marker>> markers;
+	};
+	static std::mutex mutex;
+	static std::map<std::pair<const moveit::core::RobotModel*, std::string>, Entry> cache;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry& entry = cache[std::make_pair(robot_model.get(), link.name)];
+	if (entry.markers && entry.robot_model.lock() == robot_model)
+		return entry.markers;
+
+	auto markers = std::make_shared<std::vector<visualization_msgs::Marker>>();
+	const urdf::ModelInterface& model = *robot_model->getURDF();
+	bool valid_found = false;
+	auto element_handler = [&](const T& element){
+		if (element && element->geometry) {
+			visualization_msgs::Marker m;
+			m.header.frame_id = robot_model->getModelFrame();
+			createGeometryMarker(m, *element->geometry, element->origin,
+			                     materialColor(model, materialName(*element)));
+			markers->push_back(std::move(m));
+			valid_found = true;
+		}
+	};
+
+	// code adapted from rviz::RobotLink::createVisual() / createCollision()
+	// either we have an array of collision/visual elements
+	for(const auto& element : elements_vector<T>(link))
+		element_handler(element);
+
+	// or there is a single such element
+	if (!valid_found)
+		element_handler(element<T>(link));
+
+	entry.robot_model = robot_model;
+	entry.markers = markers;
+	return markers;
+}
+
 /** generate marker msgs to visualize the robot state, calling the given callback for each of them
  *  link_names: set of links to include (or all if empty) */
 template <class T> // with T = urdf::Visual or urdf::Collision
@@ -86,37 +138,23 @@ void generateMarkers(const moveit::core::RobotState &robot_state,
                      const MarkerCallback& callback,
                      const std::vector<std::string> &link_names = {})
 {
-	const std::vector<std::string>* names = link_names.empty() ? &robot_state.getRobotModel()->getLinkModelNames()
+	const moveit::core::RobotModelConstPtr& robot_model = robot_state.getRobotModel();
+	const std::vector<std::string>* names = link_names.empty() ? &robot_model->getLinkModelNames()
 	                                                           : &link_names;
-	const urdf::ModelInterfaceSharedPtr& model = robot_state.getRobotModel()->getURDF();
+	const urdf::ModelInterfaceSharedPtr& model = robot_model->getURDF();
 	if (!model) return;
 
 	visualization_msgs::Marker m;
-	m.header.frame_id = robot_state.getRobotModel()->getModelFrame();
-
-	// code adapted from rviz::RobotLink::createVisual() / createCollision()
 	for (const auto &name : *names) {
 		const urdf::LinkConstSharedPtr& link = model->getLink(name);
 		if (!link) return;
 
-		bool valid_found = false;
-		auto element_handler = [&](const T& element){
-			if (element && element->geometry) {
-				createGeometryMarker(m, *element->geometry, element->origin,
-				                     materialColor(*model, materialName(*element)));
-				m.pose = rviz_marker_tools::composePoses(robot_state.getGlobalLinkTransform(name), m.pose);
-				callback(m, name);
-				valid_found = true;
-			}
-		};
-
-		// either we have an array of collision/visual elements
-		for(const auto& element : elements_vector<T>(*link))
-			element_handler(element);
-
-		// or there is a single such element
-		if (!valid_found)
-			element_handler(element<T>(*link));
+		// instantiate shared templates at the link's current pose
+		for (const visualization_msgs::Marker& tmpl : *linkMarkers<T>(robot_model, *link)) {
+			m = tmpl;
+			m.pose = rviz_marker_tools::composePoses(robot_state.getGlobalLinkTransform(name), tmpl.pose);
+			callback(m, name);
+		}
 	}
 }
 
@@ -0,0 +1,116 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+/* Author: Robert Haschke
+   Desc:   Memory pool for InterfaceStates and solutions created during planning
+*/
+
+#include <moveit/task_constructor/memory_pool.h>
+
+#include <algorithm>
+#include <new>
+
+namespace moveit { namespace task_constructor {
+
+constexpr size_t MemoryPool::GRANULARITY;
+constexpr size_t MemoryPool::MAX_BLOCK_SIZE;
+
+MemoryPool::MemoryPool(size_t chunk_size)
+   : chunk_size_(std::max(chunk_size, size_t(MAX_BLOCK_SIZE)))
+{
+}
+
+MemoryPool::~MemoryPool()
+{
+	for (char* chunk : chunks_)
+		::operator delete(chunk);
+}
+
+void* MemoryPool::allocate(size_t bytes)
+{
+	// round up to size class
+	bytes = std::max<size_t>(1, (bytes + GRANULARITY - 1) / GRANULARITY) * GRANULARITY;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	void* result;
+	if (bytes > MAX_BLOCK_SIZE)
+		result = ::operator new(bytes);
+	else {
+		FreeBlock*& head = free_lists_[bytes / GRANULARITY - 1];
+		if (head) {  // recycle a previously freed block
+			result = head;
+			head = head->next;
+		} else {
+			if (cursor_ + bytes > end_) {  // current chunk exhausted: fetch a new one
+				// the remainder of the old chunk is wasted, but is smaller than MAX_BLOCK_SIZE
+				chunks_.push_back(static_cast<char*>(::operator new(chunk_size_)));
+				cursor_ = chunks_.back();
+				end_ = cursor_ + chunk_size_;
+				statistics_.reserved += chunk_size_;
+			}
+			result = cursor_;
+			cursor_ += bytes;
+		}
+	}
+	++statistics_.allocations;
+	statistics_.in_use += bytes;
+	statistics_.peak = std::max(statistics_.peak, statistics_.in_use);
+	return result;
+}
+
+void MemoryPool::deallocate(void* p, size_t bytes) noexcept
+{
+	if (!p)
+		return;
+	bytes = std::max<size_t>(1, (bytes + GRANULARITY - 1) / GRANULARITY) * GRANULARITY;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	statistics_.in_use -= bytes;
+	if (bytes > MAX_BLOCK_SIZE)
+		::operator delete(p);
+	else {
+		FreeBlock* block = static_cast<FreeBlock*>(p);
+		FreeBlock*& head = free_lists_[bytes / GRANULARITY - 1];
+		block->next = head;
+		head = block;
+	}
+}
+
+MemoryPool::Statistics MemoryPool::statistics() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return statistics_;
+}
+
+} }
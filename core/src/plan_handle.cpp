@@ -0,0 +1,134 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+/* Author: Robert Haschke
+   Desc:   Handle of asynchronous Task planning
+*/
+
+#include <moveit/task_constructor/plan_handle.h>
+#include <moveit/task_constructor/task.h>
+
+#include <chrono>
+#include <cmath>
+
+namespace moveit { namespace task_constructor {
+
+PlanHandle::PlanHandle(Task& task)
+   : task_(task)
+{}
+
+PlanHandle::~PlanHandle()
+{
+	cancel();
+	if (!thread_.joinable())
+		return;
+	// the planning thread might have released the last reference
+	if (thread_.get_id() == std::this_thread::get_id())
+		thread_.detach();
+	else
+		thread_.join();
+}
+
+void PlanHandle::cancel()
+{
+	if (!finished())
+		task_.preempt();
+}
+
+template <typename Predicate>
+bool PlanHandle::waitFor(std::unique_lock<std::mutex>& lock, double timeout, Predicate predicate) const
+{
+	if (!std::isfinite(timeout)) {
+		cond_.wait(lock, predicate);
+		return true;
+	}
+	return cond_.wait_for(lock, std::chrono::duration<double>(std::max(0.0, timeout)), predicate);
+}
+
+bool PlanHandle::wait(double timeout) const
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	return waitFor(lock, timeout, [this]() { return finished_; });
+}
+
+bool PlanHandle::finished() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return finished_;
+}
+
+bool PlanHandle::success() const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return success_;
+}
+
+SolutionBaseConstPtr PlanHandle::next(double timeout)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (!waitFor(lock, timeout, [this]() { return !pending_.empty() || finished_; }) || pending_.empty())
+		return SolutionBaseConstPtr();
+	return pending_.pop();
+}
+
+SolutionBaseConstPtr PlanHandle::waitForSolution(double max_cost, double timeout) const
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto found = [this, max_cost]() { return best_ && best_->cost() < max_cost; };
+	if (!waitFor(lock, timeout, [this, &found]() { return found() || finished_; }) || !found())
+		return SolutionBaseConstPtr();
+	return best_;
+}
+
+void PlanHandle::push(const SolutionBaseConstPtr& solution)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_.insert(solution);
+		if (!best_ || solution->cost() < best_->cost())
+			best_ = solution;
+	}
+	cond_.notify_all();
+}
+
+void PlanHandle::finish(bool success)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		finished_ = true;
+		success_ = success;
+	}
+	cond_.notify_all();
+}
+
+} }
@@ -0,0 +1,230 @@
+/*********************************************************************
+ * Software License Agreement (BSD License)
+ *
+ *  Copyright (c) 2018, Bielefeld University
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions
+ *  are met:
+ *
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of Bielefeld University nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ *  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ *  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ *  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ *  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ *  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ *  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ *  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+ *  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ *********************************************************************/
+
+
+/* Author: Robert Haschke
+   Desc:   Work-stealing thread pool and scheduler for parallel planning
+*/
+
+#include <moveit/task_constructor/scheduler.h>
+#include <stdexcept>
+
+namespace moveit { namespace task_constructor {
+
+namespace {
+// pool and queue index of current worker thread
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+// innermost scheduler lock registered by current thread
+thread_local Scheduler::Lock* current_lock = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned int num_workers)
+{
+	// last queue serves as injection queue for non-worker threads
+	for (unsigned int i = 0; i <= num_workers; ++i)
+		queues_.emplace_back(new Queue);
+
+	workers_.reserve(num_workers);
+	for (unsigned int i = 0; i < num_workers; ++i)
+		workers_.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_all();
+	for (auto& worker : workers_)
+		worker.join();
+}
+
+size_t ThreadPool::ownQueue() const
+{
+	return current_pool == this ? current_queue : workers_.size();
+}
+
+void ThreadPool::submit(JobGroup& group, Job&& job)
+{
+	++group.pending_;
+	{
+		// count before pushing, such that queued_ never underestimates the number of entries
+		std::lock_guard<std::mutex> lock(mutex_);
+		++queued_;
+	}
+	Queue& queue = *queues_[ownQueue()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.entries.push_back(Entry{&group, std::move(job)});
+	}
+	cv_.notify_one();
+}
+
+bool ThreadPool::fetch(size_t own, Entry& entry)
+{
+	{  // process own queue in LIFO order: most recently forked (nested) jobs first
+		Queue& queue = *queues_[own];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.entries.empty()) {
+			entry = std::move(queue.entries.back());
+			queue.entries.pop_back();
+			--queued_;
+			return true;
+		}
+	}
+	// steal from other queues in FIFO order
+	for (size_t i = 1, num = queues_.size(); i < num; ++i) {
+		Queue& queue = *queues_[(own + i) % num];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.entries.empty()) {
+			entry = std::move(queue.entries.front());
+			queue.entries.pop_front();
+			--queued_;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(Entry& entry)
+{
+	JobGroup& group = *entry.group;
+	try {
+		entry.job();
+	} catch (...) {
+		std::lock_guard<std::mutex> lock(group.mutex_);
+		if (!group.exception_)
+			group.exception_ = std::current_exception();
+	}
+	entry.job = nullptr;  // release job's resources before signaling completion
+
+	{
+		// group might be destroyed by its joiner as soon as pending_ drops to zero
+		std::lock_guard<std::mutex> lock(mutex_);
+		--group.pending_;
+	}
+	cv_.notify_all();
+}
+
+void ThreadPool::join(JobGroup& group)
+{
+	const size_t own = ownQueue();
+	Entry entry;
+	while (group.pending_ > 0) {
+		// help processing pending jobs (of any group)
+		if (fetch(own, entry)) {
+			run(entry);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [this, &group]() { return group.pending_ == 0 || queued_ > 0; });
+	}
+	// all jobs finished, no need to lock group.mutex_ anymore
+	if (group.exception_)
+		std::rethrow_exception(group.exception_);
+}
+
+void ThreadPool::work(size_t index)
+{
+	current_pool = this;
+	current_queue = index;
+
+	Entry entry;
+	while (true) {
+		if (fetch(index, entry)) {
+			run(entry);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+		if (stop_ && queued_ == 0)
+			return;
+	}
+}
+
+
+Scheduler::Scheduler(unsigned int num_threads)
+   : pool_(num_threads > 1 ? num_threads - 1 : 0)
+{}
+
+Scheduler::Lock::Lock(Scheduler& scheduler)
+   : lock_(scheduler.mutex()), previous_(current_lock)
+{
+	current_lock = this;
+}
+
+Scheduler::Lock::~Lock()
+{
+	current_lock = previous_;
+}
+
+std::unique_lock<std::mutex>& Scheduler::heldLock()
+{
+	for (Lock* lock = current_lock; lock; lock = lock->previous_) {
+		if (lock->lock_.mutex() != &mutex_)
+			continue;
+		if (!lock->lock_.owns_lock())
+			break;  // released, e.g. while joining jobs
+		return lock->lock_;
+	}
+	throw std::logic_error("calling thread doesn't hold the scheduler's lock");
+}
+
+void Scheduler::parallel(std::vector<Job>& jobs, std::unique_lock<std::mutex>& lock)
+{
+	if (lock.mutex() != &mutex_ || !lock.owns_lock())
+		throw std::logic_error("parallel() requires to hold the scheduler's lock");
+
+	ThreadPool::JobGroup group;
+	for (Job& job : jobs) {
+		pool_.submit(group, [this, &job]() {
+			Lock lock(*this);
+			job();
+		});
+	}
+
+	// release lock while waiting for (and helping with) the jobs
+	lock.unlock();
+	try {
+		pool_.join(group);
+	} catch (...) {
+		lock.lock();
+		throw;
+	}
+	lock.lock();
+}
+
+} }
@@ -38,6 +38,7 @@
 #include <moveit/task_constructor/stage_p.h>
 #include <moveit/task_constructor/container_p.h>
 #include <moveit/task_constructor/introspection.h>
+#include <moveit/task_constructor/scheduler.h>
 #include <moveit/planning_scene/planning_scene.h>
 #include <iostream>
 #include <iomanip>
@@ -46,6 +47,24 @@
 
 namespace moveit { namespace task_constructor {
 
+namespace {
+/** Lower bound of the cost of any path continuing from state in given direction (assuming non-negative costs)
+ *
+ * Follows the chain of states created by their trajectory in this direction, which is final for them. */
+template <Interface::Direction dir>
+double pathCostBound(const InterfaceState* state)
+{
+	double cost = 0.0;
+	while (dir == Interface::FORWARD ? state->createdByOutgoing() : state->createdByIncoming()) {
+		const SolutionBase* solution = dir == Interface::FORWARD ? state->outgoingTrajectories().front()
+		                                                         : state->incomingTrajectories().front();
+		cost += solution->cost();
+		state = dir == Interface::FORWARD ? solution->end() : solution->start();
+	}
+	return cost;
+}
+}
+
 void InitStageException::push_back(const Stage &stage, const std::string &msg)
 {
 	errors_.emplace_back(std::make_pair(&stage, msg));
@@ -71,9 +90,35 @@ std::ostream& operator<<(std::ostream& os, const InitStageException& e) {
 
 
 StagePrivate::StagePrivate(Stage *me, const std::string &name)
-   : me_(me), name_(name), parent_(nullptr), introspection_(nullptr)
+   : me_(me), name_(name)
+   , compute_timing_(&timings_["compute"])
+   , new_solution_timing_(&timings_["new_solution"])
+   , interface_timing_(&timings_["interface"])
+   , parent_(nullptr), introspection_(nullptr), scheduler_(nullptr)
 {}
 
+void StagePrivate::runCompute()
+{
+	ScopedTimer timer(compute_timing_);
+	compute();
+}
+
+bool StagePrivate::prune(double cost)
+{
+	if (!cost_bound_ || cost + cost_lower_bound_ < cost_bound_->value())
+		return false;
+	++counters_["pruned"];
+	return true;
+}
+
+void StagePrivate::setMemoryPool(const MemoryPoolPtr& pool)
+{
+	memory_pool_ = pool;
+	// existing states need to remain valid: only switch allocator of empty state list
+	if (states_.empty())
+		states_ = decltype(states_)(PoolAllocator<InterfaceState>(pool));
+}
+
 InterfaceFlags StagePrivate::interfaceFlags() const
 {
 	InterfaceFlags f;
@@ -96,20 +141,111 @@ void StagePrivate::validateConnectivity() const
 bool StagePrivate::storeSolution(const SolutionBasePtr& solution)
 {
 	solution->setCreator(this);
-	if (introspection_)
-		introspection_->registerSolution(*solution);
 
 	if (solution->isFailure()) {
 		++num_failures_;
 		if (!storeFailures())
 			return false;  // drop solution
-		failures_.push_back(solution);
+		failures_.push_back(solution);  // retention policy is applied after announcing it
 	} else {
 		solutions_.insert(solution);
 	}
+	if (introspection_)
+		introspection_->registerSolution(*solution);
+	solution_memory_ += solution->footprint();
 	return true;
 }
 
+void StagePrivate::retainFailures()
+{
+	auto popBack = [this]() {
+		SolutionBaseConstPtr failure = std::move(failures_.back());
+		failures_.pop_back();
+		return failure;
+	};
+	switch (failure_retention_) {
+	case Stage::RETAIN_ALL:
+		break;
+	case Stage::RETAIN_LAST:
+		while (failures_.size() > max_failures_) {
+			SolutionBaseConstPtr failure = std::move(failures_.front());
+			failures_.pop_front();
+			dropFailure(failure);
+		}
+		break;
+	case Stage::RETAIN_SAMPLE:
+		if (failures_.size() > max_failures_) {
+			// keep the latest failure with probability max_failures / num_failures, replacing a random sample
+			SolutionBaseConstPtr dropped = popBack();
+			size_t index = std::uniform_int_distribution<size_t>(0, num_failures_ - 1)(failure_rng_);
+			if (index < failures_.size())
+				std::swap(dropped, failures_[index]);
+			dropFailure(dropped);
+		}
+		break;
+	case Stage::RETAIN_COUNTS:
+		++counters_["failed: " + failures_.back()->comment()];
+		dropFailure(popBack());
+		break;
+	}
+}
+
+void StagePrivate::registerFailureStates(const SolutionBase& failure, StateList::iterator first, unsigned int count)
+{
+	if (failure_retention_ != Stage::RETAIN_ALL)
+		failure_states_.insert(std::make_pair(&failure, std::make_pair(first, count)));
+}
+
+void StagePrivate::dropFailure(const SolutionBaseConstPtr& failure)
+{
+	if (introspection_)
+		introspection_->unregisterSolution(*failure);
+	solution_memory_ -= std::min(solution_memory_, failure->footprint());
+
+	// detach from start and end states
+	if (failure->start())
+		const_cast<InterfaceState*>(failure->start())->removeOutgoing(failure.get());
+	if (failure->end())
+		const_cast<InterfaceState*>(failure->end())->removeIncoming(failure.get());
+
+	// Free states created along with the failure. Failures are never passed to the parent (see newSolution()),
+	// i.e. they are not wrapped into parent solutions. Nevertheless, make sure the parent doesn't keep
+	// a mapping of the freed states, which could be confused with new states allocated at the same address.
+	auto states = failure_states_.find(failure.get());
+	if (states != failure_states_.end()) {
+		auto first = states->second.first;
+		auto last = std::next(first, states->second.second);
+		if (parent())
+			for (auto it = first; it != last; ++it)
+				parent()->pimpl()->unmapInternalState(&*it);
+		states_.erase(first, last);
+		failure_states_.erase(states);
+	}
+}
+
+size_t StagePrivate::dropSolutions(const std::function<bool(const SolutionBase&)>& predicate)
+{
+	std::vector<SolutionBaseConstPtr> dropped;  // keep alive until cleaned up
+	solutions_.remove_if([&](const SolutionBaseConstPtr& solution) {
+		if (!predicate(*solution))
+			return false;
+		dropped.push_back(solution);
+		return true;
+	});
+	for (const SolutionBaseConstPtr& solution : dropped) {
+		if (introspection_)
+			introspection_->unregisterSolution(*solution);
+		solution_memory_ -= std::min(solution_memory_, solution->footprint());
+
+		// detach from start and end states
+		if (solution->start())
+			const_cast<InterfaceState*>(solution->start())->removeOutgoing(solution.get());
+		if (solution->end())
+			const_cast<InterfaceState*>(solution->end())->removeIncoming(solution.get());
+	}
+	return dropped.size();
+}
+
 void StagePrivate::sendForward(const InterfaceState& from, InterfaceState&& to, SolutionBasePtr solution)
 {
 	assert(nextStarts());
@@ -118,12 +254,15 @@ void StagePrivate::sendForward(const InterfaceState& from, InterfaceState&& to,
 	me()->forwardProperties(from, to);
 
 	auto to_it = states_.insert(states_.end(), std::move(to));
+	to_it->origin_ = InterfaceState::INCOMING;
 
 	solution->setStartState(from);
 	solution->setEndState(*to_it);
 
 	if (!solution->isFailure())
 		nextStarts()->add(*to_it);
+	else
+		registerFailureStates(*solution, to_it, 1);
 
 	newSolution(solution);
 }
@@ -136,12 +275,15 @@ void StagePrivate::sendBackward(InterfaceState&& from, const InterfaceState& to,
 	me()->forwardProperties(to, from);
 
 	auto from_it = states_.insert(states_.end(), std::move(from));
+	from_it->origin_ = InterfaceState::OUTGOING;
 
 	solution->setStartState(*from_it);
 	solution->setEndState(to);
 
 	if (!solution->isFailure())
 		prevEnds()->add(*from_it);
+	else
+		registerFailureStates(*solution, from_it, 1);
 
 	newSolution(solution);
 }
@@ -154,6 +296,8 @@ void StagePrivate::spawn(InterfaceState&& state, SolutionBasePtr solution)
 
 	auto from = states_.insert(states_.end(), InterfaceState(state)); // copy
 	auto to = states_.insert(states_.end(), std::move(state));
+	from->origin_ = InterfaceState::OUTGOING;
+	to->origin_ = InterfaceState::INCOMING;
 
 	solution->setStartState(*from);
 	solution->setEndState(*to);
@@ -161,6 +305,8 @@ void StagePrivate::spawn(InterfaceState&& state, SolutionBasePtr solution)
 	if (!solution->isFailure()) {
 		prevEnds()->add(*from);
 		nextStarts()->add(*to);
+	} else {
+		registerFailureStates(*solution, from, 2);
 	}
 
 	newSolution(solution);
@@ -179,11 +325,15 @@ void StagePrivate::connect(const InterfaceState& from, const InterfaceState& to,
 
 void StagePrivate::newSolution(const SolutionBasePtr& solution)
 {
+	ScopedTimer timer(new_solution_timing_);
 	// call solution callbacks for both, valid solutions and failures
 	for (const auto& cb : solution_cbs_)
 		cb(*solution);
 
-	if (parent() && !solution->isFailure())
+	if (solution->isFailure()) {
+		if (storeFailures())
+			retainFailures();  // might drop the failure
+	} else if (parent())
 		parent()->onNewSolution(*solution);
 }
 
@@ -218,8 +368,17 @@ void Stage::reset()
 	// clear solutions + associated states
 	impl->solutions_.clear();
 	impl->failures_.clear();
+	impl->failure_states_.clear();
+	impl->failure_rng_.seed();
 	impl->num_failures_ = 0u;
-	impl->states_.clear();
+	impl->counters_.clear();
+	impl->solution_memory_ = 0;
+	// keep entries, built-in ones are referenced
+	for (auto& pair : impl->timings_)
+		pair.second = TimingStatistics();
+	// release states and the reference to the task's memory pool, which is freed once the last solution is gone
+	impl->states_ = decltype(impl->states_)();
+	impl->memory_pool_.reset();
 	// clear pull interfaces
 	if (impl->starts_) impl->starts_->clear();
 	if (impl->ends_) impl->ends_->clear();
@@ -289,7 +448,7 @@ const ordered<SolutionBaseConstPtr>& Stage::solutions() const
 	return pimpl()->solutions_;
 }
 
-const std::list<SolutionBaseConstPtr>& Stage::failures() const
+const std::deque<SolutionBaseConstPtr>& Stage::failures() const
 {
 	return pimpl()->failures_;
 }
@@ -303,10 +462,79 @@ void Stage::silentFailure() {
 	++(pimpl()->num_failures_);
 }
 
+const std::map<std::string, size_t>& Stage::counters() const
+{
+	return pimpl()->counters_;
+}
+
+void Stage::incrementCounter(const std::string& name, size_t n)
+{
+	pimpl()->counters_[name] += n;
+}
+
+const std::map<std::string, TimingStatistics>& Stage::timings() const
+{
+	return pimpl()->timings_;
+}
+
+TimingStatistics& Stage::timing(const std::string& name)
+{
+	return pimpl()->timings_[name];
+}
+
+size_t Stage::stateMemory() const
+{
+	return pimpl()->states_.size() * sizeof(InterfaceState);
+}
+
+size_t Stage::solutionMemory() const
+{
+	return pimpl()->solution_memory_;
+}
+
+double Stage::timeout() const
+{
+	const double timeout = properties().get<double>("timeout");
+	const Deadline* deadline = pimpl()->deadline();
+	return deadline ? deadline->timeout(timeout) : timeout;
+}
+
+void Stage::setCostLowerBound(double bound)
+{
+	pimpl()->cost_lower_bound_ = bound;
+}
+
+double Stage::costLowerBound() const
+{
+	return pimpl()->cost_lower_bound_;
+}
+
+void Stage::setFailureRetention(FailureRetention policy, size_t max_failures)
+{
+	pimpl()->failure_retention_ = policy;
+	pimpl()->max_failures_ = max_failures;
+}
+
+Stage::FailureRetention Stage::failureRetention() const
+{
+	return pimpl()->failure_retention_;
+}
+
 bool Stage::storeFailures() const {
 	return pimpl()->storeFailures();
 }
 
+Stage::Unlocked::Unlocked(const Stage& stage)
+   : lock_(stage.pimpl()->scheduler() ? &stage.pimpl()->scheduler()->heldLock() : nullptr)
+{
+	if (lock_) lock_->unlock();
+}
+
+Stage::Unlocked::~Unlocked()
+{
+	if (lock_) lock_->lock();
+}
+
 
 PropertyMap &Stage::properties()
 {
@@ -395,6 +623,29 @@ std::ostream& operator<<(std::ostream& os, const StagePrivate& impl) {
 	}
 	// name
 	os << " / " << impl.name();
+
+	// timing statistics and memory
+	const std::ios_base::fmtflags flags = os.flags();
+	const std::streamsize precision = os.precision();
+	const char* separator = "  [";
+	for (const auto& pair : impl.timings_) {
+		const TimingStatistics& t = pair.second;
+		if (t.count == 0)
+			continue;
+		os << separator << pair.first << ": " << t.count << "x "
+		   << std::fixed << std::setprecision(3) << 1000. * t.total << " ms"
+		   << " (" << 1000. * t.min << " - " << 1000. * t.max << ")";
+		separator = ", ";
+	}
+	os.flags(flags);
+	os.precision(precision);
+	const size_t memory = impl.me()->stateMemory() + impl.solution_memory_;
+	if (memory > 0) {
+		os << separator << "memory: " << memory / 1024 << " KiB";
+		separator = ", ";
+	}
+	if (separator[0] == ',')
+		os << "]";
 	return os;
 }
 
@@ -415,14 +666,16 @@ void PropagatingEitherWayPrivate::initInterface(PropagatingEitherWay::Direction
 {
 	if (dir & PropagatingEitherWay::FORWARD) {
 		if (!starts_)  // keep existing interface if possible
-			starts_.reset(new Interface(std::bind(&PropagatingEitherWayPrivate::dropFailedStarts, this, std::placeholders::_1)));
+			starts_.reset(new Interface(std::bind(&PropagatingEitherWayPrivate::dropFailedStarts, this, std::placeholders::_1),
+			                            interface_timing_));
 	} else {
 		starts_.reset();
 	}
 
 	if (dir & PropagatingEitherWay::BACKWARD) {
 		if (!ends_)  // keep existing interface if possible
-			ends_.reset(new Interface(std::bind(&PropagatingEitherWayPrivate::dropFailedEnds, this, std::placeholders::_1)));
+			ends_.reset(new Interface(std::bind(&PropagatingEitherWayPrivate::dropFailedEnds, this, std::placeholders::_1),
+			                          interface_timing_));
 	} else {
 		ends_.reset();
 	}
@@ -508,15 +761,19 @@ void PropagatingEitherWayPrivate::compute()
 
 	if (hasStartState()) {
 		const InterfaceState& state = fetchStartState();
-		// enforce property initialization from INTERFACE
-		properties_.performInitFrom(Stage::INTERFACE, state.properties());
-		me->computeForward(state);
+		if (!prune(pathCostBound<Interface::BACKWARD>(&state))) {
+			// enforce property initialization from INTERFACE
+			properties_.performInitFrom(Stage::INTERFACE, state.properties());
+			me->computeForward(state);
+		}
 	}
 	if (hasEndState()) {
 		const InterfaceState& state = fetchEndState();
-		// enforce property initialization from INTERFACE
-		properties_.performInitFrom(Stage::INTERFACE, state.properties());
-		me->computeBackward(state);
+		if (!prune(pathCostBound<Interface::FORWARD>(&state))) {
+			// enforce property initialization from INTERFACE
+			properties_.performInitFrom(Stage::INTERFACE, state.properties());
+			me->computeBackward(state);
+		}
 	}
 }
 
@@ -559,13 +816,13 @@ void PropagatingEitherWay::init(const moveit::core::RobotModelConstPtr& robot_mo
 void PropagatingEitherWay::sendForward(const InterfaceState& from,
                                        InterfaceState&& to,
                                        SubTrajectory&& t) {
-	pimpl()->sendForward(from, std::move(to), std::make_shared<SubTrajectory>(std::move(t)));
+	pimpl()->sendForward(from, std::move(to), pimpl()->makeSolution<SubTrajectory>(std::move(t)));
 }
 
 void PropagatingEitherWay::sendBackward(InterfaceState&& from,
                                         const InterfaceState& to,
                                         SubTrajectory&& t) {
-	pimpl()->sendBackward(std::move(from), to, std::make_shared<SubTrajectory>(std::move(t)));
+	pimpl()->sendBackward(std::move(from), to, pimpl()->makeSolution<SubTrajectory>(std::move(t)));
 }
 
 
@@ -631,7 +888,7 @@ Generator::Generator(const std::string &name)
 
 void Generator::spawn(InterfaceState&& state, SubTrajectory&& t)
 {
-	pimpl()->spawn(std::move(state), std::make_shared<SubTrajectory>(std::move(t)));
+	pimpl()->spawn(std::move(state), pimpl()->makeSolution<SubTrajectory>(std::move(t)));
 }
 
 
@@ -683,8 +940,10 @@ void MonitoringGeneratorPrivate::solutionCB(const SolutionBase &s)
 ConnectingPrivate::ConnectingPrivate(Connecting *me, const std::string &name)
    : ComputeBasePrivate(me, name)
 {
-	starts_.reset(new Interface(std::bind(&ConnectingPrivate::newState<Interface::BACKWARD>, this, std::placeholders::_1, std::placeholders::_2)));
-	ends_.reset(new Interface(std::bind(&ConnectingPrivate::newState<Interface::FORWARD>, this, std::placeholders::_1, std::placeholders::_2)));
+	starts_.reset(new Interface(std::bind(&ConnectingPrivate::newState<Interface::BACKWARD>, this, std::placeholders::_1, std::placeholders::_2),
+	                            interface_timing_));
+	ends_.reset(new Interface(std::bind(&ConnectingPrivate::newState<Interface::FORWARD>, this, std::placeholders::_1, std::placeholders::_2),
+	                          interface_timing_));
 }
 
 InterfaceFlags ConnectingPrivate::requiredInterface() const {
@@ -702,6 +961,37 @@ ConnectingPrivate::StatePair ConnectingPrivate::make_pair<Interface::FORWARD>
 	return std::make_pair(second, first);
 }
 
+void ConnectingPrivate::addPending(const StatePair& pair)
+{
+	PendingList::iterator it = pending.insert(pair);
+	pending_by_state_[&*pair.first].push_back(it);
+	pending_by_state_[&*pair.second].push_back(it);
+}
+
+void ConnectingPrivate::unindexPending(const InterfaceState* state, PendingList::iterator pair)
+{
+	auto entry = pending_by_state_.find(state);
+	std::vector<PendingList::iterator>& pairs = entry->second;
+	auto it = std::find(pairs.begin(), pairs.end(), pair);
+	*it = pairs.back();
+	pairs.pop_back();
+	if (pairs.empty())
+		pending_by_state_.erase(entry);
+}
+
+void ConnectingPrivate::removePending(const InterfaceState* state)
+{
+	auto entry = pending_by_state_.find(state);
+	if (entry == pending_by_state_.end())
+		return;
+	for (PendingList::iterator pair : entry->second) {
+		const InterfaceState* other = &*pair->first == state ? &*pair->second : &*pair->first;
+		unindexPending(other, pair);
+		pending.erase(pair);
+	}
+	pending_by_state_.erase(entry);
+}
+
 template <Interface::Direction other>
 void ConnectingPrivate::newState(Interface::iterator it, bool updated)
 {
@@ -709,19 +999,21 @@ void ConnectingPrivate::newState(Interface::iterator it, bool updated)
 	if (!std::isfinite(it->priority().cost())) {
 		// remove pending pairs, if cost updated to infinity
 		if (updated)
-			pending.remove_if([it](const StatePair& p) { return p.first == it; });
+			removePending(&*it);
 		return;
 	}
 	if (updated) {
-		// many pairs might be affected: sort
-		pending.sort();
+		// only pairs involving the updated state need to be re-sorted
+		auto entry = pending_by_state_.find(&*it);
+		if (entry != pending_by_state_.end())
+			pending.update(entry->second.begin(), entry->second.end());
 	} else { // new state: insert all pairs with other interface
 		InterfacePtr other_interface = pullInterface(other);
 		for (Interface::iterator oit = other_interface->begin(), oend = other_interface->end(); oit != oend; ++oit) {
 			if (!std::isfinite(oit->priority().cost()))
 				break;
 			if (static_cast<Connecting*>(me_)->compatible(*it, *oit))
-				pending.insert(make_pair<other>(it, oit));
+				addPending(make_pair<other>(it, oit));
 		}
 	}
 }
@@ -731,9 +1023,14 @@ bool ConnectingPrivate::canCompute() const{
 }
 
 void ConnectingPrivate::compute() {
-	const StatePair& top = pending.pop();
+	PendingList::iterator it = pending.begin();
+	unindexPending(&*it->first, it);
+	unindexPending(&*it->second, it);
+	const StatePair top = pending.pop();
 	const InterfaceState& from = *top.first;
 	const InterfaceState& to = *top.second;
+	if (prune(pathCostBound<Interface::BACKWARD>(&from) + pathCostBound<Interface::FORWARD>(&to)))
+		return;
 	static_cast<Connecting*>(me_)->compute(from, to);
 }
 
@@ -746,6 +1043,7 @@ Connecting::Connecting(const std::string &name)
 void Connecting::reset()
 {
 	pimpl()->pending.clear();
+	pimpl()->pending_by_state_.clear();
 	ComputeBase::reset();
 }
 
@@ -755,6 +1053,12 @@ bool Connecting::compatible(const InterfaceState& from_state, const InterfaceSta
 	const planning_scene::PlanningSceneConstPtr& from = from_state.scene();
 	const planning_scene::PlanningSceneConstPtr& to = to_state.scene();
 
+	// fast rejection, the full check below confirms matching fingerprints
+	if (from_state.sceneFingerprint() != to_state.sceneFingerprint()) {
+		ROS_DEBUG_STREAM_NAMED("Connecting", name() << ": different objects or object poses");
+		return false;
+	}
+
 	if (from->getWorld()->size() != to->getWorld()->size()) {
 		ROS_DEBUG_STREAM_NAMED("Connecting", name() << ": different number of collision objects");
 		return false;
@@ -34,19 +34,37 @@
  *********************************************************************/
 /* Authors: Robert Haschke, Michael Goerner */
 
-#include <moveit/task_constructor/stages/compute_ik.h>
+#include <moveit/task_constructor/stages/compute_ik_p.h>
 #include <moveit/task_constructor/storage.h>
+#include <moveit/task_constructor/container_p.h>
 #include <moveit/task_constructor/marker_tools.h>
+#include <moveit/task_constructor/scheduler.h>
 
+#include <moveit/kinematics_plugin_loader/kinematics_plugin_loader.h>
 #include <moveit/planning_scene/planning_scene.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit/robot_state/robot_state.h>
+#include <geometric_shapes/shape_operations.h>
+
+#include <unistd.h>
 
 #include <Eigen/Geometry>
 #include <eigen_conversions/eigen_msg.h>
+#include <random_numbers/random_numbers.h>
+#include <boost/functional/hash.hpp>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
 #include <functional>
 #include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 #include <ros/console.h>
 
 namespace moveit { namespace task_constructor { namespace stages {
@@ -61,12 +79,22 @@ ComputeIK::ComputeIK(const std::string &name, Stage::pointer &&child)
 	p.declare<uint32_t>("max_ik_solutions", 1);
 	p.declare<bool>("ignore_collisions", false);
 	p.declare<double>("min_solution_distance", 0.1, "minimum distance between seperate IK solutions for the same target");
+	p.declare<bool>("unique_solutions", false, "apply min_solution_distance to all solutions of the stage");
+	p.declare<uint32_t>("max_batch_size", 1, "number of queued target poses processed per compute() call");
+	p.declare<uint32_t>("ik_seed", 0, "seed for random IK restarts (0: non-deterministic)");
+	p.declare<bool>("cache_collisions", false, "cache collision checks of the placed end-effector");
+	p.declare<double>("collision_cache_resolution", 1e-4,
+	                  "quantization of cached end-effector poses: translation [m], rotation [rad]");
+	p.declare<std::string>("ik_cache_file", "", "file to persistently cache IK solutions in (empty: disabled)");
+	p.declare<double>("ik_cache_resolution", 1e-3, "quantization of cached IK poses: translation [m], rotation [rad]");
 
 	// ik_frame and target_pose are read from the interface
 	p.declare<geometry_msgs::PoseStamped>("ik_frame", "frame to be moved towards goal pose");
 	p.declare<geometry_msgs::PoseStamped>("target_pose", "goal pose for ik frame");
 }
 
+ComputeIK::~ComputeIK() = default;
+
 void ComputeIK::setIKFrame(const Eigen::Isometry3d &pose, const std::string &link)
 {
 	geometry_msgs::PoseStamped pose_msg;
@@ -83,20 +111,327 @@ void ComputeIK::setTargetPose(const Eigen::Isometry3d &pose, const std::string &
 	setTargetPose(pose_msg);
 }
 
-// found IK solutions with a flag indicating validity
-typedef std::vector<std::vector<double>> IKSolutions;
+// IK solution found for a target pose, with a flag indicating validity
+struct IKSolution {
+	std::vector<double> joint_positions;
+	bool feasible;
+};
+
+void ComputeIK::SolutionIndex::reset(const moveit::core::JointModelGroup* group, double distance)
+{
+	jmg = group;
+	min_distance = distance;
+	dim = jmg->getVariableCount();
+	positions.clear();
+	cells.clear();
+	axes.clear();
+	if (min_distance <= 0.0)
+		return;
+	for (const moveit::core::JointModel* joint : jmg->getActiveJointModels()) {
+		if (axes.size() == std::tuple_size<Key>::value)
+			break;
+		if (joint->getVariableCount() != 1 || joint->getDistanceFactor() <= 0.0)
+			continue;
+		if (joint->getType() == moveit::core::JointModel::PRISMATIC ||
+		    (joint->getType() == moveit::core::JointModel::REVOLUTE &&
+		     !static_cast<const moveit::core::RevoluteJointModel*>(joint)->isContinuous()))
+			axes.emplace_back(jmg->getVariableGroupIndex(joint->getName()), min_distance / joint->getDistanceFactor());
+	}
+}
+
+ComputeIK::SolutionIndex::Key ComputeIK::SolutionIndex::key(const double* joint_positions) const
+{
+	Key result {{ 0, 0, 0 }};
+	for (size_t i = 0; i < axes.size(); ++i)
+		result[i] = static_cast<long long>(std::floor(joint_positions[axes[i].first] / axes[i].second));
+	return result;
+}
+
+bool ComputeIK::SolutionIndex::contains(const double* joint_positions) const
+{
+	if (min_distance <= 0.0 || positions.empty())
+		return false;
+
+	// visit all 3^axes neighboring cells
+	const Key center = key(joint_positions);
+	size_t num_cells = 1;
+	for (size_t i = 0; i < axes.size(); ++i)
+		num_cells *= 3;
+	for (size_t n = 0; n < num_cells; ++n) {
+		Key k = center;
+		for (size_t i = 0, code = n; i < axes.size(); ++i, code /= 3)
+			k[i] += static_cast<long long>(code % 3) - 1;
+		auto it = cells.find(k);
+		if (it == cells.end())
+			continue;
+		for (size_t index : it->second)
+			if (jmg->distance(joint_positions, positions.data() + index * dim) < min_distance)
+				return true;
+	}
+	return false;
+}
+
+void ComputeIK::SolutionIndex::insert(const double* joint_positions)
+{
+	cells[key(joint_positions)].push_back(size());
+	positions.insert(positions.end(), joint_positions, joint_positions + dim);
+}
+
+// all data required to sample IK solutions for a single upstream solution
+struct ComputeIK::IKTarget {
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	const SolutionBase* upstream;
+	planning_scene::PlanningScenePtr sandbox_scene;
+	const moveit::core::JointModelGroup* jmg;
+	const robot_model::LinkModel* link;
+	Eigen::Isometry3d target_pose;
+	geometry_msgs::PoseStamped target_pose_msg;
+	geometry_msgs::PoseStamped ik_pose_msg;
+	std::vector<double> compare_pose;  // joint values to compare IK solutions with for costs
+	SolutionBase::MarkerGenerator failure_markers;  // visualizing the placed end-effector
+
+	bool ignore_collisions;
+	double min_solution_distance;
+	uint32_t max_ik_solutions;
+	double timeout;
+	const Deadline* deadline;  // task's planning deadline, checked between IK attempts
+
+	// results of a single sampling job, only accessed by this job while sampling
+	struct JobResult {
+		std::vector<IKSolution> solutions;  // in order of their discovery
+		SolutionIndex solution_index;  // joint positions of solutions
+		size_t num_duplicates = 0;  // number of solutions rejected by stage_index
+		bool cache_hit = false;  // did any cached seed yield a valid solution?
+	};
+	std::vector<JobResult> job_results;  // one per sampling job
+
+	// solutions of all jobs, merged in job order
+	std::vector<IKSolution> solutions;
+	SolutionIndex solution_index;  // joint positions of solutions
+	SolutionIndex* stage_index = nullptr;  // solutions spawned before (read-only during sampling)
+	size_t num_duplicates = 0;
+	std::shared_ptr<IKCache> ik_cache;  // persistent cache (if enabled)
+	uint64_t cache_key;
+	std::vector<std::vector<double>> cached_seeds;  // IK seeds from ik_cache, tried first by job 0
+	bool cache_hit = false;
+
+	/** sample IK solutions of given job until its share of max_ik_solutions was found or timeout is reached
+	 *
+	 * Job 0 seeds from the current state (and cached seeds), other jobs use random restarts only.
+	 * Without a private solver instance, the group's shared solver is used. */
+	void sample(size_t job, random_numbers::RandomNumberGenerator& rng, const kinematics::KinematicsBase* solver);
+	/// merge the results of all jobs in job order, dropping solutions too close to those of previous jobs
+	void merge();
+};
 
 namespace {
 
-// ??? TODO: provide callback methods in PlanningScene class / probably not very useful here though...
-// TODO: move into MoveIt! core, lift active_components_only_ from fcl to common interface
-bool isTargetPoseColliding(const planning_scene::PlanningScenePtr& scene,
-                           Eigen::Isometry3d pose, const robot_model::LinkModel* link,
-                           collision_detection::CollisionResult* collision_result = nullptr)
+/// solve IK for link at pose (w.r.t. model frame) using the given solver instance, cf. RobotState::setFromIK()
+bool solveIK(robot_state::RobotState& state, const kinematics::KinematicsBase& solver,
+             const moveit::core::JointModelGroup* jmg, const robot_model::LinkModel* link, Eigen::Isometry3d pose,
+             double timeout, const moveit::core::GroupStateValidityCallbackFn& is_valid)
 {
-	robot_state::RobotState& robot_state = scene->getCurrentStateNonConst();
+	const std::vector<std::string>& tips = solver.getTipFrames();
+	if (tips.size() != 1)
+		return false;  // multi-tip solvers are not supported
+	const std::string tip_name = !tips[0].empty() && tips[0][0] == '/' ? tips[0].substr(1) : tips[0];
+	const robot_model::LinkModel* tip = state.getRobotModel()->getLinkModel(tip_name);
+	if (!tip)
+		return false;
+
+	state.updateLinkTransforms();
+	if (tip != link) {  // link needs to be rigidly connected to the tip
+		if (robot_model::RobotModel::getRigidlyConnectedParentLinkModel(link) !=
+		    robot_model::RobotModel::getRigidlyConnectedParentLinkModel(tip))
+			return false;
+		pose = pose * state.getGlobalLinkTransform(link).inverse() * state.getGlobalLinkTransform(tip);
+	}
+	// solvers expect the pose w.r.t. their base frame
+	pose = state.getFrameTransform(solver.getBaseFrame()).inverse() * pose;
+	geometry_msgs::Pose pose_msg;
+	tf::poseEigenToMsg(pose, pose_msg);
+
+	// map between group and solver variable order
+	const std::vector<unsigned int>& bij = jmg->getKinematicsSolverJointBijection();
+	std::vector<double> values;
+	state.copyJointGroupPositions(jmg, values);
+	std::vector<double> seed(bij.size());
+	for (size_t i = 0; i < bij.size(); ++i)
+		seed[i] = values[bij[i]];
 
-	// consider all rigidly connected parent links as well
+	auto callback = [&](const geometry_msgs::Pose&, const std::vector<double>& solution,
+	                    moveit_msgs::MoveItErrorCodes& error_code) {
+		for (size_t i = 0; i < bij.size(); ++i)
+			values[bij[i]] = solution[i];
+		error_code.val = is_valid(&state, jmg, values.data()) ? moveit_msgs::MoveItErrorCodes::SUCCESS
+		                                                       : moveit_msgs::MoveItErrorCodes::NO_IK_SOLUTION;
+	};
+	std::vector<double> solution;
+	moveit_msgs::MoveItErrorCodes error_code;
+	if (!solver.searchPositionIK(pose_msg, seed, timeout, solution, callback, error_code))
+		return false;
+
+	for (size_t i = 0; i < bij.size(); ++i)
+		values[bij[i]] = solution[i];
+	state.setJointGroupPositions(jmg, values);
+	state.update();
+	return true;
+}
+
+} // anonymous namespace
+
+void ComputeIK::IKTarget::sample(size_t job, random_numbers::RandomNumberGenerator& rng,
+                                 const kinematics::KinematicsBase* solver)
+{
+	JobResult& result = job_results[job];
+	const size_t quota = (max_ik_solutions + job_results.size() - 1) / job_results.size();
+	// each job samples with its own robot state
+	robot_state::RobotState sandbox_state(sandbox_scene->getCurrentState());
+
+	auto isValid = [this, &result](robot_state::RobotState* state, const robot_model::JointModelGroup* jmg, const double* joint_positions) {
+		if (result.solution_index.contains(joint_positions))
+			return false; // too close to already found solution
+		if (stage_index && stage_index->contains(joint_positions)) {
+			++result.num_duplicates;
+			return false; // too close to a solution spawned before
+		}
+		result.solution_index.insert(joint_positions);
+		state->setJointGroupPositions(jmg, joint_positions);
+		bool feasible = ignore_collisions || !sandbox_scene->isStateColliding(*state, jmg->getName());
+		result.solutions.push_back(IKSolution{ std::vector<double>(joint_positions, joint_positions + jmg->getVariableCount()), feasible });
+		return feasible;
+	};
+
+	bool seed_from_current = job == 0;
+	const bool use_cache = seed_from_current;  // cached seeds are tried by the first job only
+	size_t next_seed = 0;
+
+	double remaining_time = timeout;
+	auto start_time = std::chrono::steady_clock::now();
+	while (remaining_time > 0 && result.solutions.size() < quota) {
+		if (deadline && deadline->expired())
+			break;  // planning was canceled or ran out of time
+		const bool from_cache = use_cache && next_seed < cached_seeds.size();
+		if (from_cache)
+			sandbox_state.setJointGroupPositions(jmg, cached_seeds[next_seed++]);
+		else {
+			if (!seed_from_current)
+				sandbox_state.setToRandomPositions(jmg, rng);
+			else if (next_seed > 0)  // restore current state, modified by cached seeds
+				sandbox_state = sandbox_scene->getCurrentState();
+			seed_from_current = false;
+		}
+
+		bool succeeded = solver ? solveIK(sandbox_state, *solver, jmg, link, target_pose, remaining_time, isValid)
+		                        : sandbox_state.setFromIK(jmg, target_pose, link->getName(), remaining_time, isValid);
+		if (succeeded && from_cache)
+			result.cache_hit = true;
+
+		auto now = std::chrono::steady_clock::now();
+		remaining_time -= std::chrono::duration<double>(now - start_time).count();
+		start_time = now;
+
+		// TODO: magic constant should be a property instead ("current_seed_only", or equivalent)
+		// Yeah, you are right, these are two different semantic concepts:
+		// One could also have multiple IK solutions derived from the same seed
+		if (!succeeded && max_ik_solutions == 1 && !from_cache)
+			break;  // first and only attempt failed
+	}
+}
+
+void ComputeIK::IKTarget::merge()
+{
+	for (JobResult& result : job_results) {
+		num_duplicates += result.num_duplicates;
+		cache_hit = cache_hit || result.cache_hit;
+		for (IKSolution& solution : result.solutions) {
+			if (solutions.size() >= max_ik_solutions)
+				break;
+			if (solution_index.contains(solution.joint_positions.data()))
+				continue;  // too close to a solution of a previous job
+			solution_index.insert(solution.joint_positions.data());
+			solutions.push_back(std::move(solution));
+		}
+	}
+	job_results.clear();
+}
+
+/** Kinematics solver instances for concurrent sampling jobs
+ *
+ * MoveIt shares a single solver instance per JointModelGroup, which is not reentrant in general.
+ * Concurrent jobs borrow their own instances instead, which are loaded on demand via the kinematics
+ * plugin loader and recycled for later jobs. If loading fails, jobs fall back to the shared instance.
+ */
+struct ComputeIK::SolverPool {
+	moveit::core::RobotModelConstPtr robot_model;
+	// declared before the solvers: plugin libraries need to outlive the instances
+	std::unique_ptr<kinematics_plugin_loader::KinematicsPluginLoader> loader;
+	moveit::core::SolverAllocatorFn allocator;
+	std::mutex mutex;  // protects all members
+	std::map<const moveit::core::JointModelGroup*, std::vector<kinematics::KinematicsBasePtr>> idle;
+	bool failed = false;
+
+	explicit SolverPool(const moveit::core::RobotModelConstPtr& model) : robot_model(model) {}
+
+	/// borrow a solver instance for jmg, nullptr if none could be loaded
+	kinematics::KinematicsBasePtr acquire(const moveit::core::JointModelGroup* jmg);
+	/// return a borrowed instance for reuse
+	void release(const moveit::core::JointModelGroup* jmg, kinematics::KinematicsBasePtr&& solver);
+};
+
+kinematics::KinematicsBasePtr ComputeIK::SolverPool::acquire(const moveit::core::JointModelGroup* jmg)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	std::vector<kinematics::KinematicsBasePtr>& solvers = idle[jmg];
+	if (!solvers.empty()) {
+		kinematics::KinematicsBasePtr result = std::move(solvers.back());
+		solvers.pop_back();
+		return result;
+	}
+	if (failed)
+		return kinematics::KinematicsBasePtr();
+
+	if (!loader) {
+		loader.reset(new kinematics_plugin_loader::KinematicsPluginLoader());
+		allocator = loader->getLoaderFunction();
+	}
+	kinematics::KinematicsBasePtr result;
+	if (allocator)
+		result = allocator(jmg);
+	if (!result) {
+		ROS_WARN_STREAM_NAMED("ComputeIK", "Failed to load a kinematics solver instance for group '" << jmg->getName()
+		                      << "': concurrent IK sampling falls back to the group's shared solver");
+		failed = true;
+	}
+	return result;
+}
+
+void ComputeIK::SolverPool::release(const moveit::core::JointModelGroup* jmg, kinematics::KinematicsBasePtr&& solver)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	idle[jmg].push_back(std::move(solver));
+}
+
+namespace {
+
+std::string listCollisionPairs(const collision_detection::CollisionResult::ContactMap &contacts,
+                               const std::string& separator)
+{
+	std::string result;
+	for (const auto& contact : contacts) {
+		if (!result.empty())
+			result.append(separator);
+		result.append(contact.first.first).append(" - ").append(contact.first.second);
+	}
+	return result;
+}
+
+/// place link at given pose, considering all rigidly connected parent links as well
+/// pose is transformed into the pose of the returned, rigidly connected parent link
+const robot_model::LinkModel* placeLink(robot_state::RobotState& robot_state, Eigen::Isometry3d& pose,
+                                        const robot_model::LinkModel* link)
+{
 	const robot_model::LinkModel* parent = robot_model::RobotModel::getRigidlyConnectedParentLinkModel(link);
 	if (parent != link)  // transform pose into pose suitable to place parent
 		pose = pose * robot_state.getGlobalLinkTransform(link).inverse() * robot_state.getGlobalLinkTransform(parent);
@@ -104,14 +439,16 @@ bool isTargetPoseColliding(const planning_scene::PlanningScenePtr& scene,
 	// place link at given pose
 	robot_state.updateStateWithLinkAt(parent, pose);
 	robot_state.updateCollisionBodyTransforms();
+	return parent;
+}
 
-	// disable collision checking for parent links (except links fixed to root)
-	auto& acm = scene->getAllowedCollisionMatrixNonConst();
+/// disable collision checking for parent links (except links fixed to root)
+void ignoreParentLinks(collision_detection::AllowedCollisionMatrix& acm, const robot_model::LinkModel* parent)
+{
 	std::vector<const std::string*> pending_links;  // parent link names that might be rigidly connected to root
 	while (parent) {
 		pending_links.push_back(&parent->getName());
-		link = parent;
-		const robot_model::JointModel* joint = link->getParentJointModel();
+		const robot_model::JointModel* joint = parent->getParentJointModel();
 		parent = joint->getParentLinkModel();
 
 		if (joint->getType() != robot_model::JointModel::FIXED) {
@@ -120,28 +457,386 @@ bool isTargetPoseColliding(const planning_scene::PlanningScenePtr& scene,
 			pending_links.clear();
 		}
 	}
+}
 
+// ??? TODO: provide callback methods in PlanningScene class / probably not very useful here though...
+// TODO: move into MoveIt! core, lift active_components_only_ from fcl to common interface
+bool isTargetPoseColliding(const planning_scene::PlanningScene& scene, const robot_state::RobotState& robot_state,
+                           const collision_detection::AllowedCollisionMatrix& acm, std::string* contacts = nullptr)
+{
 	// check collision with the world using the padded version
 	collision_detection::CollisionRequest req;
-	collision_detection::CollisionResult result;
-	req.contacts = (collision_result != nullptr);
-	collision_detection::CollisionResult& res = collision_result ? *collision_result : result;
-	scene->checkCollision(req, res, robot_state, acm);
+	collision_detection::CollisionResult res;
+	req.contacts = (contacts != nullptr);
+	scene.checkCollision(req, res, robot_state, acm);
+	if (contacts)
+		*contacts = listCollisionPairs(res.contacts, ", ");
 	return res.collision;
 }
 
-std::string listCollisionPairs(const collision_detection::CollisionResult::ContactMap &contacts,
-                               const std::string& separator)
+/// quantize position and (unique) quaternion of pose with given resolution
+PoseKey quantizePose(const Eigen::Isometry3d& pose, double resolution)
 {
-	std::string result;
-	for (const auto& contact : contacts) {
-		if (!result.empty())
-			result.append(separator);
-		result.append(contact.first.first).append(" - ").append(contact.first.second);
+	Eigen::Quaterniond q(pose.linear());
+	if (q.w() < 0)
+		q.coeffs() *= -1.0;
+	const Eigen::Vector3d& t = pose.translation();
+	// rotation of angle a changes quaternion coefficients by about a/2
+	return PoseKey {{ std::llround(t.x() / resolution), std::llround(t.y() / resolution), std::llround(t.z() / resolution),
+	                  std::llround(2.0 * q.x() / resolution), std::llround(2.0 * q.y() / resolution),
+	                  std::llround(2.0 * q.z() / resolution), std::llround(2.0 * q.w() / resolution) }};
+}
+
+/// are collisions of the named entity allowed with anything?
+bool ignoresAllCollisions(const collision_detection::AllowedCollisionMatrix& acm,
+                          const std::vector<std::string>& names, const std::string& name)
+{
+	collision_detection::AllowedCollision::Type type;
+	if (!acm.getDefaultEntry(name, type) || type != collision_detection::AllowedCollision::ALWAYS)
+		return false;
+	// explicit entries take precedence over the default
+	for (const std::string& other : names)
+		if (acm.getEntry(name, other, type) && type != collision_detection::AllowedCollision::ALWAYS)
+			return false;
+	return true;
+}
+
+bool samePose(const Eigen::Isometry3d& a, const Eigen::Isometry3d& b)
+{
+	return a.matrix() == b.matrix();
+}
+
+bool samePoses(const EigenSTL::vector_Isometry3d& a, const EigenSTL::vector_Isometry3d& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), samePose);
+}
+
+/// do both scenes exactly agree in everything hashed by InterfaceState::sceneFingerprint(scene, true)?
+bool sameCollisionScene(const planning_scene::PlanningScene& a, const planning_scene::PlanningScene& b)
+{
+	const collision_detection::World& world_a = *a.getWorld();
+	const collision_detection::World& world_b = *b.getWorld();
+	if (world_a.size() != world_b.size())
+		return false;
+	for (auto it_a = world_a.begin(), it_b = world_b.begin(); it_a != world_a.end(); ++it_a, ++it_b) {
+		if (it_a->first != it_b->first || it_a->second->shapes_ != it_b->second->shapes_ ||
+		    !samePoses(it_a->second->shape_poses_, it_b->second->shape_poses_))
+			return false;
+	}
+
+	const robot_state::RobotState& state_a = a.getCurrentState();
+	const robot_state::RobotState& state_b = b.getCurrentState();
+	if (!std::equal(state_a.getVariablePositions(), state_a.getVariablePositions() + state_a.getVariableCount(),
+	                state_b.getVariablePositions()))
+		return false;
+	std::vector<const robot_state::AttachedBody*> bodies_a, bodies_b;
+	state_a.getAttachedBodies(bodies_a);
+	state_b.getAttachedBodies(bodies_b);
+	if (bodies_a.size() != bodies_b.size())
+		return false;
+	for (size_t i = 0; i < bodies_a.size(); ++i) {
+		const robot_state::AttachedBody& body_a = *bodies_a[i];
+		const robot_state::AttachedBody& body_b = *bodies_b[i];
+		if (body_a.getName() != body_b.getName() || body_a.getAttachedLink() != body_b.getAttachedLink() ||
+		    body_a.getTouchLinks() != body_b.getTouchLinks() || body_a.getShapes() != body_b.getShapes() ||
+		    !samePoses(body_a.getFixedTransforms(), body_b.getFixedTransforms()))
+			return false;
+	}
+
+	const collision_detection::AllowedCollisionMatrix& acm_a = a.getAllowedCollisionMatrix();
+	const collision_detection::AllowedCollisionMatrix& acm_b = b.getAllowedCollisionMatrix();
+	std::vector<std::string> names_a, names_b;
+	acm_a.getAllEntryNames(names_a);
+	acm_b.getAllEntryNames(names_b);
+	if (names_a != names_b)
+		return false;
+	collision_detection::AllowedCollision::Type type_a, type_b;
+	for (size_t i = 0; i < names_a.size(); ++i) {
+		bool has_a = acm_a.getDefaultEntry(names_a[i], type_a);
+		bool has_b = acm_b.getDefaultEntry(names_a[i], type_b);
+		if (has_a != has_b || (has_a && type_a != type_b))
+			return false;
+		for (size_t j = i; j < names_a.size(); ++j) {
+			has_a = acm_a.getEntry(names_a[i], names_a[j], type_a);
+			has_b = acm_b.getEntry(names_a[i], names_a[j], type_b);
+			if (has_a != has_b || (has_a && type_a != type_b))
+				return false;
+		}
+	}
+	return true;
+}
+
+} // anonymous namespace
+
+constexpr size_t ComputeIK::CollisionCache::MAX_CONTEXTS;
+constexpr size_t ComputeIK::CollisionCache::MAX_RESULTS;
+
+const ComputeIK::CollisionCache::Fingerprint&
+ComputeIK::CollisionCache::fingerprint(const planning_scene::PlanningSceneConstPtr& scene)
+{
+	// memoize fingerprint per scene instance: expired entries indicate a reused address
+	auto it = fingerprints_.find(scene.get());
+	if (it != fingerprints_.end() && !it->second.scene.expired())
+		return it->second;
+
+	if (fingerprints_.size() >= MAX_CONTEXTS) {
+		for (auto entry = fingerprints_.begin(); entry != fingerprints_.end();)
+			entry = entry->second.scene.expired() ? fingerprints_.erase(entry) : std::next(entry);
+	}
+	const size_t value = InterfaceState::sceneFingerprint(*scene, true);
+	planning_scene::PlanningSceneConstPtr& reference = references_[value];
+	if (!reference)
+		reference = scene;
+	const bool cacheable = reference == scene || sameCollisionScene(*reference, *scene);
+	return fingerprints_[scene.get()] = Fingerprint{ scene, value, cacheable };
+}
+
+ComputeIK::CollisionCache::Context&
+ComputeIK::CollisionCache::context(size_t fingerprint, const planning_scene::PlanningSceneConstPtr& scene,
+                                   const robot_model::LinkModel* parent)
+{
+	auto key = std::make_pair(fingerprint, parent);
+	auto it = contexts_.find(key);
+	if (it != contexts_.end())
+		return it->second;
+
+	Context& c = contexts_[key];
+	c.acm = scene->getAllowedCollisionMatrix();
+	ignoreParentLinks(c.acm, parent);
+	std::vector<std::string> names;
+	c.acm.getAllEntryNames(names);
+
+	const robot_state::RobotState& state = scene->getCurrentState();
+	const collision_detection::CollisionRobotConstPtr& robot = scene->getCollisionRobot();
+	const auto& moved_links = parent->getParentJointModel()->getDescendantLinkModels();
+	const Eigen::Isometry3d parent_inv = state.getGlobalLinkTransform(parent).inverse();
+	const double inf = std::numeric_limits<double>::infinity();
+
+	auto isMoved = [&moved_links](const robot_model::LinkModel* link) {
+		return std::find(moved_links.begin(), moved_links.end(), link) != moved_links.end();
+	};
+	// add bounding sphere (center w.r.t. global frame) to moved or static objects
+	auto add = [&](bool moved, const Eigen::Vector3d& center, double radius) {
+		if (moved)
+			c.moved.push_back(Sphere{ parent_inv * center, radius });
+		else
+			c.obstacles.push_back(Sphere{ center, radius });
+	};
+	auto addShapes = [&](bool moved, const std::vector<shapes::ShapeConstPtr>& shapes,
+	                     const EigenSTL::vector_Isometry3d& poses, double padding) {
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			Eigen::Vector3d center;
+			double radius;
+			if (shapes[i]->type == shapes::PLANE || shapes[i]->type == shapes::OCTREE) {
+				center.setZero();
+				radius = inf;
+			} else
+				shapes::computeShapeBoundingSphere(shapes[i].get(), center, radius);
+			add(moved, poses[i] * center, radius + padding);
+		}
+	};
+
+	// robot links
+	for (const robot_model::LinkModel* link : state.getRobotModel()->getLinkModelsWithCollisionGeometry()) {
+		if (ignoresAllCollisions(c.acm, names, link->getName()))
+			continue;
+		const Eigen::Vector3d center = state.getGlobalLinkTransform(link) * link->getCenteredBoundingBoxOffset();
+		const double radius = 0.5 * link->getShapeExtentsAtOrigin().norm() * robot->getLinkScale(link->getName())
+		                      + robot->getLinkPadding(link->getName());
+		add(isMoved(link), center, radius);
+	}
+	// attached bodies
+	std::vector<const robot_state::AttachedBody*> bodies;
+	state.getAttachedBodies(bodies);
+	for (const robot_state::AttachedBody* body : bodies) {
+		if (!ignoresAllCollisions(c.acm, names, body->getName()))
+			addShapes(isMoved(body->getAttachedLink()), body->getShapes(), body->getGlobalCollisionBodyTransforms(),
+			          robot->getLinkPadding(body->getAttachedLinkName()));
+	}
+	// world objects
+	const collision_detection::WorldConstPtr& world = scene->getWorld();
+	for (const std::string& id : world->getObjectIds()) {
+		if (ignoresAllCollisions(c.acm, names, id))
+			continue;
+		const collision_detection::World::ObjectConstPtr& object = world->getObject(id);
+		addShapes(false, object->shapes_, object->shape_poses_, 0.0);
+	}
+	return c;
+}
+
+bool ComputeIK::CollisionCache::isColliding(const planning_scene::PlanningSceneConstPtr& scene,
+                                            const robot_state::RobotState& state,
+                                            const robot_model::LinkModel* parent, const Eigen::Isometry3d& pose,
+                                            double resolution, std::string& contacts, Stage& stage)
+{
+	if (contexts_.size() >= MAX_CONTEXTS) {
+		// drop everything: memoized fingerprints were verified against the dropped references
+		contexts_.clear();
+		references_.clear();
+		fingerprints_.clear();
+	}
+	const Fingerprint& fp = fingerprint(scene);
+	if (!fp.cacheable) {  // fingerprint collides with another scene's
+		stage.incrementCounter("collision_cache_misses");
+		collision_detection::AllowedCollisionMatrix acm(scene->getAllowedCollisionMatrix());
+		ignoreParentLinks(acm, parent);
+		return isTargetPoseColliding(*scene, state, acm, &contacts);
+	}
+	Context& c = context(fp.value, scene, parent);
+
+	// bounding-sphere test: are placed links separated from all static objects?
+	bool separated = true;
+	for (const Sphere& m : c.moved) {
+		const Eigen::Vector3d center = pose * m.center;
+		for (const Sphere& o : c.obstacles) {
+			if ((center - o.center).norm() <= m.radius + o.radius) {
+				separated = false;
+				break;
+			}
+		}
+		if (!separated)
+			break;
+	}
+	if (separated && c.separated) {
+		stage.incrementCounter("collision_prefilter_hits");
+		contacts = c.separated->contacts;
+		return c.separated->colliding;
+	}
+
+	// lookup quantized pose
+	auto it = c.results.find(quantizePose(pose, resolution));
+	if (it != c.results.end()) {
+		stage.incrementCounter("collision_cache_hits");
+		contacts = it->second.contacts;
+		return it->second.colliding;
+	}
+
+	stage.incrementCounter("collision_cache_misses");
+	Result result;
+	result.colliding = isTargetPoseColliding(*scene, state, c.acm, &result.contacts);
+	contacts = result.contacts;
+	if (separated)
+		c.separated.reset(new Result(result));
+	else {
+		if (c.results.size() >= MAX_RESULTS)
+			c.results.clear();
+		c.results.emplace(quantizePose(pose, resolution), result);
+	}
+	return result.colliding;
+}
+
+constexpr size_t ComputeIK::IKCache::MAX_SEEDS;
+constexpr uint32_t ComputeIK::IKCache::MAX_VARIABLES;
+constexpr char ComputeIK::IKCache::MAGIC[8];
+
+std::shared_ptr<ComputeIK::IKCache> ComputeIK::IKCache::get(const std::string& file)
+{
+	static std::mutex mutex;
+	static std::map<std::string, std::weak_ptr<IKCache>> caches;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<IKCache> result = caches[file].lock();
+	if (!result) {
+		result = std::make_shared<IKCache>();
+		result->file = file;
+		result->load();
+		caches[file] = result;
 	}
 	return result;
 }
 
+uint64_t ComputeIK::IKCache::key(const moveit::core::JointModelGroup* jmg, const robot_model::LinkModel* link,
+                                 const Eigen::Isometry3d& pose, double resolution)
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, jmg->getParentModel().getName());
+	boost::hash_combine(seed, jmg->getName());
+	boost::hash_combine(seed, link->getName());
+	const PoseKey quantized = quantizePose(pose, resolution);
+	boost::hash_range(seed, quantized.begin(), quantized.end());
+	return seed;
+}
+
+void ComputeIK::IKCache::load()
+{
+	bool empty = true;
+	std::ifstream in(file, std::ios::binary);
+	if (in) {
+		char magic[sizeof(MAGIC)];
+		if (!in.read(magic, sizeof(magic))) {
+			if (in.gcount() != 0) {
+				ROS_WARN_STREAM_NAMED("ComputeIK", "Ignoring invalid IK cache file: " << file);
+				return;
+			}
+		} else if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0)
+			empty = false;
+		else {
+			ROS_WARN_STREAM_NAMED("ComputeIK", "Ignoring invalid IK cache file: " << file);
+			return;
+		}
+
+		uint64_t key;
+		uint32_t size;
+		std::vector<double> joint_positions;
+		std::streamoff valid_end = in.tellg();
+		while (in.read(reinterpret_cast<char*>(&key), sizeof(key)) &&
+		       in.read(reinterpret_cast<char*>(&size), sizeof(size)) && size <= MAX_VARIABLES) {
+			joint_positions.resize(size);
+			if (!in.read(reinterpret_cast<char*>(joint_positions.data()), size * sizeof(double)))
+				break;
+			add(key, joint_positions);
+			valid_end = in.tellg();
+		}
+		// drop a truncated (or corrupted) tail, e.g. due to a crash while writing, before appending
+		in.clear();
+		in.seekg(0, std::ios::end);
+		const std::streamoff file_end = in.tellg();
+		in.close();
+		if (!empty && file_end > valid_end && ::truncate(file.c_str(), valid_end) != 0) {
+			ROS_WARN_STREAM_NAMED("ComputeIK", "Failed to repair IK cache file: " << file);
+			return;
+		}
+	}
+
+	out.open(file, std::ios::binary | std::ios::app);
+	if (!out) {
+		ROS_WARN_STREAM_NAMED("ComputeIK", "Failed to open IK cache file: " << file);
+		return;
+	}
+	if (empty)
+		out.write(MAGIC, sizeof(MAGIC)).flush();
+}
+
+bool ComputeIK::IKCache::add(uint64_t key, const std::vector<double>& joint_positions)
+{
+	std::vector<std::vector<double>>& entries = seeds[key];
+	if (entries.size() >= MAX_SEEDS || std::find(entries.begin(), entries.end(), joint_positions) != entries.end())
+		return false;
+	entries.push_back(joint_positions);
+	return true;
+}
+
+std::vector<std::vector<double>> ComputeIK::IKCache::lookup(uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = seeds.find(key);
+	return it != seeds.end() ? it->second : std::vector<std::vector<double>>();
+}
+
+void ComputeIK::IKCache::insert(uint64_t key, const std::vector<double>& joint_positions)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (!add(key, joint_positions) || !out.is_open())
+		return;
+	const uint32_t size = joint_positions.size();
+	out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	out.write(reinterpret_cast<const char*>(joint_positions.data()), size * sizeof(double));
+	out.flush();
+}
+
+namespace {
+
 bool validateEEF(const PropertyMap& props, const moveit::core::RobotModelConstPtr& robot_model,
                  const moveit::core::JointModelGroup*& jmg, std::string* msg)
 {
@@ -181,6 +876,9 @@ bool validateGroup(const PropertyMap& props, const moveit::core::RobotModelConst
 void ComputeIK::reset()
 {
 	upstream_solutions_.clear();
+	num_targets_ = 0;
+	collision_cache_.reset();
+	solution_indices_.clear();
 	WrapperBase::reset();
 }
 
@@ -201,6 +899,10 @@ void ComputeIK::init(const moveit::core::RobotModelConstPtr& robot_model)
 	if (!validateGroup(props, robot_model, eef_jmg, jmg, &msg))
 		errors.push_back(*this, msg);
 
+	// solver instances are only valid for their robot model
+	if (solver_pool_ && solver_pool_->robot_model != robot_model)
+		solver_pool_.reset();
+
 	if (errors) throw errors;
 }
 
@@ -225,62 +927,138 @@ void ComputeIK::compute()
 	if(upstream_solutions_.empty())
 		return;
 
-	const SolutionBase& s = *upstream_solutions_.pop();
+	const auto& props = properties();
+	const uint32_t max_batch_size = std::max<uint32_t>(1u, props.get<uint32_t>("max_batch_size"));
+	const uint32_t seed = props.get<uint32_t>("ik_seed");
+	Scheduler* scheduler = pimpl()->scheduler();
+	const uint32_t num_threads = scheduler ? scheduler->numThreads() : 1u;
+
+	// collect a batch of targets from queued upstream solutions
+	std::vector<std::unique_ptr<IKTarget>> targets;
+	while (!upstream_solutions_.empty() && targets.size() < max_batch_size) {
+		std::unique_ptr<IKTarget> target = prepare(*upstream_solutions_.pop());
+		if (target)
+			targets.push_back(std::move(target));
+	}
+
+	// concurrent jobs need their own solver instances
+	if (num_threads > 1 && !solver_pool_ && !targets.empty())
+		solver_pool_.reset(new SolverPool(targets.front()->sandbox_scene->getRobotModel()));
 
+	// distribute IK sampling of all targets to jobs: seeding from the current state, and random restarts
+	std::vector<Scheduler::Job> jobs;
+	for (const auto& target : targets) {
+		const size_t target_index = num_targets_++;
+		const uint32_t num_jobs = target->max_ik_solutions == 1 ? 1u : std::min(num_threads, target->max_ik_solutions);
+		target->job_results.resize(num_jobs);
+		for (uint32_t job = 0; job < num_jobs; ++job) {
+			target->job_results[job].solution_index.reset(target->jmg, target->min_solution_distance);
+			// deterministic seed per target and job (if requested)
+			const uint32_t job_seed = seed ^ (static_cast<uint32_t>(target_index) * 0x9e3779b9u + job);
+			IKTarget* t = target.get();
+			jobs.push_back([this, t, job, seed, job_seed]() {
+				std::unique_ptr<random_numbers::RandomNumberGenerator> rng
+				      (seed ? new random_numbers::RandomNumberGenerator(job_seed) : new random_numbers::RandomNumberGenerator());
+				// concurrent jobs use their own solver instance
+				kinematics::KinematicsBasePtr solver;
+				if (solver_pool_)
+					solver = solver_pool_->acquire(t->jmg);
+				t->sample(job, *rng, solver.get());
+				if (solver)
+					solver_pool_->release(t->jmg, std::move(solver));
+			});
+		}
+	}
+
+	{
+		// IK sampling doesn't touch the stage graph
+		ScopedTimer timer(timing("ik"));
+		if (!scheduler || jobs.size() <= 1) {
+			Unlocked unlocked(*this);
+			for (auto& job : jobs)
+				job();
+		} else {
+			// jobs are started holding the scheduler's lock
+			for (auto& job : jobs)
+				job = [this, sample = std::move(job)]() {
+					Unlocked unlocked(*this);
+					sample();
+				};
+			scheduler->parallel(jobs, scheduler->heldLock());
+		}
+	}
+
+	// merge results of each target in job order and spawn them through the normal interface, in order of upstream solutions
+	for (const auto& target : targets) {
+		target->merge();
+		spawnSolutions(*target);
+	}
+}
+
+std::unique_ptr<ComputeIK::IKTarget> ComputeIK::prepare(const SolutionBase& s)
+{
 	// -1 TODO: this should not be necessary in my opinion: Why do you think so?
 	// It is, because the properties on the interface might change from call to call...
 	// enforced initialization from interface ensures that new target_pose is read
 	properties().performInitFrom(INTERFACE, s.start()->properties());
 	const auto& props = properties();
 
-	planning_scene::PlanningScenePtr sandbox_scene = s.start()->scene()->diff();
+	std::unique_ptr<IKTarget> target(new IKTarget);
+	target->upstream = &s;
+	planning_scene::PlanningScenePtr& sandbox_scene = target->sandbox_scene;
+	sandbox_scene = s.start()->scene()->diff();
 
-	const bool ignore_collisions = props.get<bool>("ignore_collisions");
+	target->ignore_collisions = props.get<bool>("ignore_collisions");
 	const auto& robot_model = sandbox_scene->getRobotModel();
 	const moveit::core::JointModelGroup* eef_jmg = nullptr;
-	const moveit::core::JointModelGroup* jmg = nullptr;
+	target->jmg = nullptr;
+	const moveit::core::JointModelGroup*& jmg = target->jmg;
 	std::string msg;
 
 	if (!validateEEF(props, robot_model, eef_jmg, &msg)) {
 		ROS_WARN_STREAM_NAMED("ComputeIK", msg);
-		return;
+		return nullptr;
 	}
 	if (!validateGroup(props, robot_model, eef_jmg, jmg, &msg)) {
 		ROS_WARN_STREAM_NAMED("ComputeIK", msg);
-		return;
+		return nullptr;
 	}
 	if (!eef_jmg && !jmg) {
 		ROS_WARN_STREAM_NAMED("ComputeIK", "Neither eef nor group are well defined");
-		return;
+		return nullptr;
 	}
 	properties().property("timeout").setDefaultValue(jmg->getDefaultIKTimeout());
+	target->timeout = timeout();
+	target->deadline = pimpl()->deadline();
 
 	// extract target_pose
-	geometry_msgs::PoseStamped target_pose_msg = props.get<geometry_msgs::PoseStamped>("target_pose");
+	geometry_msgs::PoseStamped& target_pose_msg = target->target_pose_msg;
+	target_pose_msg = props.get<geometry_msgs::PoseStamped>("target_pose");
 	if (target_pose_msg.header.frame_id.empty())  // if not provided, assume planning frame
 		target_pose_msg.header.frame_id = sandbox_scene->getPlanningFrame();
 
-	Eigen::Isometry3d target_pose;
+	Eigen::Isometry3d& target_pose = target->target_pose;
 	tf::poseMsgToEigen(target_pose_msg.pose, target_pose);
 	if (target_pose_msg.header.frame_id != sandbox_scene->getPlanningFrame()) {
 		if (!sandbox_scene->knowsFrameTransform(target_pose_msg.header.frame_id)) {
 			ROS_WARN_STREAM_NAMED("ComputeIK", "Unknown reference frame for target pose: " << target_pose_msg.header.frame_id);
-			return;
+			return nullptr;
 		}
 		// transform target_pose w.r.t. planning frame
 		target_pose = sandbox_scene->getFrameTransform(target_pose_msg.header.frame_id) * target_pose;
 	}
 
 	// determine IK link from ik_frame
-	const robot_model::LinkModel* link = nullptr;
-	geometry_msgs::PoseStamped ik_pose_msg;
+	target->link = nullptr;
+	const robot_model::LinkModel*& link = target->link;
+	geometry_msgs::PoseStamped& ik_pose_msg = target->ik_pose_msg;
 	const boost::any& value = props.get("ik_frame");
 	if (value.empty()) { // property undefined
 		//  determine IK link from eef/group
 		if (!(link = eef_jmg ? robot_model->getLinkModel(eef_jmg->getEndEffectorParentGroup().second)
 		                     : jmg->getOnlyOneEndEffectorTip())) {
 			ROS_WARN_STREAM_NAMED("ComputeIK", "Failed to derive IK target link");
-			return;
+			return nullptr;
 		}
 		ik_pose_msg.header.frame_id = link->getName();
 		ik_pose_msg.pose.orientation.w = 1.0;
@@ -295,12 +1073,12 @@ void ComputeIK::compute()
 			      = sandbox_scene->getCurrentState().getAttachedBody(ik_pose_msg.header.frame_id);
 			if (!attached) {
 				ROS_WARN_STREAM_NAMED("ComputeIK", "Unknown frame: " << ik_pose_msg.header.frame_id);
-				return;
+				return nullptr;
 			}
 			const EigenSTL::vector_Isometry3d& tf = attached->getFixedTransforms();
 			if (tf.empty()) {
 				ROS_WARN_STREAM_NAMED("ComputeIK", "Attached body doesn't have shapes.");
-				return;
+				return nullptr;
 			}
 			// prepend link
 			link = attached->getAttachedLink();
@@ -310,124 +1088,160 @@ void ComputeIK::compute()
 		target_pose = target_pose * ik_pose.inverse();
 	}
 
-	// validate placed link for collisions
-	collision_detection::CollisionResult collisions;
-	bool colliding = !ignore_collisions && isTargetPoseColliding(sandbox_scene, target_pose, link, &collisions);
-
 	robot_state::RobotState& sandbox_state = sandbox_scene->getCurrentStateNonConst();
 
-	// markers used for failures
-	std::deque<visualization_msgs::Marker> failure_markers;
-	// frames at target pose and ik frame
-	rviz_marker_tools::appendFrame(failure_markers, target_pose_msg, 0.1, "ik frame");
-	rviz_marker_tools::appendFrame(failure_markers, ik_pose_msg, 0.1, "ik frame");
-	// visualize placed end-effector
-	auto appender = [&failure_markers](visualization_msgs::Marker& marker, const std::string& name) {
-		marker.ns = "ik target";
-		marker.color.a *= 0.5;
-		failure_markers.push_back(marker);
+	// validate placed link for collisions
+	bool colliding = false;
+	std::string collisions;
+	if (!target->ignore_collisions) {
+		Eigen::Isometry3d pose = target_pose;
+		const robot_model::LinkModel* parent = placeLink(sandbox_state, pose, link);
+		if (props.get<bool>("cache_collisions")) {
+			if (!collision_cache_)
+				collision_cache_.reset(new CollisionCache);
+			colliding = collision_cache_->isColliding(s.start()->scene(), sandbox_state, parent, pose,
+			                                          props.get<double>("collision_cache_resolution"), collisions, *this);
+		} else {
+			collision_detection::AllowedCollisionMatrix acm(sandbox_scene->getAllowedCollisionMatrix());
+			ignoreParentLinks(acm, parent);
+			colliding = isTargetPoseColliding(*sandbox_scene, sandbox_state, acm, &collisions);
+		}
+	}
+
+	// markers used for failures, generated on demand from a snapshot of the placed end-effector's state
+	// (capturing the sandbox scene would keep its diff alive and reflect later modifications)
+	auto placed = std::make_shared<robot_state::RobotState>(sandbox_state);
+	placed->update();
+	target->failure_markers = [state = robot_state::RobotStateConstPtr(std::move(placed)),
+	                           target_pose_msg, ik_pose_msg, link, colliding](std::vector<visualization_msgs::Marker>& markers) {
+		// frames at target pose and ik frame
+		rviz_marker_tools::appendFrame(markers, target_pose_msg, 0.1, "ik frame");
+		rviz_marker_tools::appendFrame(markers, ik_pose_msg, 0.1, "ik frame");
+		// visualize placed end-effector
+		auto appender = [&markers](visualization_msgs::Marker& marker, const std::string& name) {
+			marker.ns = "ik target";
+			marker.color.a *= 0.5;
+			markers.push_back(marker);
+		};
+		const auto& links_to_visualize = moveit::core::RobotModel::getRigidlyConnectedParentLinkModel(link)
+		                                ->getParentJointModel()->getDescendantLinkModels();
+		if (colliding)
+			generateCollisionMarkers(*state, appender, links_to_visualize);
+		else
+			generateVisualMarkers(*state, appender, links_to_visualize);
 	};
-	const auto& links_to_visualize = moveit::core::RobotModel::getRigidlyConnectedParentLinkModel(link)
-	                                ->getParentJointModel()->getDescendantLinkModels();
 	if (colliding) {
 		SubTrajectory solution;
-		generateCollisionMarkers(sandbox_state, appender, links_to_visualize);
-		std::copy(failure_markers.begin(), failure_markers.end(), std::back_inserter(solution.markers()));
+		solution.addMarkerGenerator(target->failure_markers);
 		solution.markAsFailure();
 		// TODO: visualize collisions
-		solution.setComment(s.comment() + " eef in collision: " + listCollisionPairs(collisions.contacts, ", "));
+		solution.setComment(s.comment() + " eef in collision: " + collisions);
 		spawn(InterfaceState(sandbox_scene), std::move(solution));
-		return;
-	} else
-		generateVisualMarkers(sandbox_state, appender, links_to_visualize);
+		return nullptr;
+	}
 
 
 	// determine joint values of robot pose to compare IK solution with for costs
-	std::vector<double> compare_pose;
 	const std::string &compare_pose_name = props.get<std::string>("default_pose");
 	if (!compare_pose_name.empty()) {
 		robot_state::RobotState compare_state(robot_model);
 		compare_state.setToDefaultValues(jmg, compare_pose_name);
-		compare_state.copyJointGroupPositions(jmg, compare_pose);
+		compare_state.copyJointGroupPositions(jmg, target->compare_pose);
 	} else
-		sandbox_scene->getCurrentState().copyJointGroupPositions(jmg, compare_pose);
+		sandbox_scene->getCurrentState().copyJointGroupPositions(jmg, target->compare_pose);
 
-	double min_solution_distance = props.get<double>("min_solution_distance");
-
-	IKSolutions ik_solutions;
-	auto isValid = [sandbox_scene, ignore_collisions, min_solution_distance, &ik_solutions]
-	               (robot_state::RobotState* state, const robot_model::JointModelGroup* jmg, const double* joint_positions) {
-		for (const auto& sol : ik_solutions){
-			if (jmg->distance(joint_positions, sol.data()) < min_solution_distance)
-				return false; // too close to already found solution
+	target->min_solution_distance = props.get<double>("min_solution_distance");
+	target->max_ik_solutions = props.get<uint32_t>("max_ik_solutions");
+	target->solution_index.reset(jmg, target->min_solution_distance);
+	if (props.get<bool>("unique_solutions")) {
+		std::unique_ptr<SolutionIndex>& index = solution_indices_[std::make_pair(jmg, target->min_solution_distance)];
+		if (!index) {
+			index.reset(new SolutionIndex);
+			index->reset(jmg, target->min_solution_distance);
 		}
-		state->setJointGroupPositions(jmg, joint_positions);
-		ik_solutions.emplace_back();
-		state->copyJointGroupPositions(jmg, ik_solutions.back());
+		target->stage_index = index.get();
+	}
 
-		return ignore_collisions || !sandbox_scene->isStateColliding(*state, jmg->getName());
-	};
+	const std::string& cache_file = props.get<std::string>("ik_cache_file");
+	if (!cache_file.empty()) {
+		if (!ik_cache_ || ik_cache_->file != cache_file)
+			ik_cache_ = IKCache::get(cache_file);
+		target->ik_cache = ik_cache_;
+		target->cache_key = IKCache::key(jmg, link, target_pose, props.get<double>("ik_cache_resolution"));
+		target->cached_seeds = ik_cache_->lookup(target->cache_key);
+		// seeds of another group size (e.g. due to a hash collision) cannot be used
+		const size_t num_variables = jmg->getVariableCount();
+		target->cached_seeds.erase(std::remove_if(target->cached_seeds.begin(), target->cached_seeds.end(),
+		                                          [num_variables](const std::vector<double>& seed) {
+			                                          return seed.size() != num_variables;
+		                                          }),
+		                           target->cached_seeds.end());
+	}
+	return target;
+}
 
-	uint32_t max_ik_solutions = props.get<uint32_t>("max_ik_solutions");
-	bool tried_current_state_as_seed = false;
+void ComputeIK::spawnSolutions(const IKTarget& target)
+{
+	const SolutionBase& s = *target.upstream;
 
-	double remaining_time = timeout();
-	auto start_time = std::chrono::steady_clock::now();
-	while (ik_solutions.size() < max_ik_solutions && remaining_time > 0) {
-		if(tried_current_state_as_seed)
-			sandbox_state.setToRandomPositions(jmg);
-		tried_current_state_as_seed= true;
+	// for all found solutions (successes and failures)
+	size_t num_spawned = 0;
+	size_t num_duplicates = target.num_duplicates;
+	for (const IKSolution& ik_solution : target.solutions) {
+		if (ik_solution.feasible && target.stage_index) {
+			// solutions of other targets in the same batch were not yet known while sampling
+			if (target.stage_index->contains(ik_solution.joint_positions.data())) {
+				++num_duplicates;
+				continue;
+			}
+			target.stage_index->insert(ik_solution.joint_positions.data());
+		}
+		if (ik_solution.feasible && target.ik_cache)
+			target.ik_cache->insert(target.cache_key, ik_solution.joint_positions);
+		++num_spawned;
 
-		size_t previous = ik_solutions.size();
-		bool succeeded = sandbox_state.setFromIK(jmg, target_pose, link->getName(), remaining_time, isValid);
+		// create a new scene for each solution as they will have different robot states
+		planning_scene::PlanningScenePtr scene = s.start()->scene()->diff();
+		SubTrajectory solution;
+		solution.setComment(s.comment());
 
-		auto now = std::chrono::steady_clock::now();
-		remaining_time -= std::chrono::duration<double>(now - start_time).count();
-		start_time = now;
+		// frames at target pose and ik frame
+		solution.addMarkerGenerator([target_pose_msg = target.target_pose_msg, ik_pose_msg = target.ik_pose_msg]
+		                            (std::vector<visualization_msgs::Marker>& markers) {
+			rviz_marker_tools::appendFrame(markers, target_pose_msg, 0.1, "ik frame");
+			rviz_marker_tools::appendFrame(markers, ik_pose_msg, 0.1, "ik frame");
+		});
 
-		// for all new solutions (successes and failures)
-		for (size_t i = previous; i != ik_solutions.size(); ++i) {
-			// create a new scene for each solution as they will have different robot states
-			planning_scene::PlanningScenePtr scene = s.start()->scene()->diff();
-			SubTrajectory solution;
-			solution.setComment(s.comment());
-
-			// frames at target pose and ik frame
-			rviz_marker_tools::appendFrame(solution.markers(), target_pose_msg, 0.1, "ik frame");
-			rviz_marker_tools::appendFrame(solution.markers(), ik_pose_msg, 0.1, "ik frame");
-
-			if (succeeded && i+1 == ik_solutions.size())
-				// compute cost as distance to compare_pose
-				solution.setCost(s.cost() + jmg->distance(ik_solutions.back().data(), compare_pose.data()));
-			else // found an IK solution, but this was not valid
-				solution.markAsFailure();
-
-			// set scene's robot state
-			robot_state::RobotState& robot_state = scene->getCurrentStateNonConst();
-			robot_state.setJointGroupPositions(jmg, ik_solutions.back().data());
-			robot_state.update();
-
-			InterfaceState state(scene);
-			forwardProperties(*s.start(), state);
-			spawn(std::move(state), std::move(solution));
-		}
+		if (ik_solution.feasible)
+			// compute cost as distance to compare_pose
+			solution.setCost(s.cost() + target.jmg->distance(ik_solution.joint_positions.data(), target.compare_pose.data()));
+		else // found an IK solution, but this was not valid
+			solution.markAsFailure();
 
-		// TODO: magic constant should be a property instead ("current_seed_only", or equivalent)
-		// Yeah, you are right, these are two different semantic concepts:
-		// One could also have multiple IK solutions derived from the same seed
-		if (!succeeded && max_ik_solutions == 1)
-			break;  // first and only attempt failed
+		// set scene's robot state
+		robot_state::RobotState& robot_state = scene->getCurrentStateNonConst();
+		robot_state.setJointGroupPositions(target.jmg, ik_solution.joint_positions.data());
+		robot_state.update();
+
+		InterfaceState state(scene);
+		forwardProperties(*s.start(), state);
+		spawn(std::move(state), std::move(solution));
 	}
 
-	if (ik_solutions.empty()) {  // failed to find any solution
+	if (num_duplicates > 0)
+		incrementCounter("duplicate_ik_solutions", num_duplicates);
+	if (target.ik_cache)
+		incrementCounter(target.cache_hit ? "ik_cache_hits" : "ik_cache_misses");
+
+	if (num_spawned == 0) {  // failed to find any (new) solution
 		planning_scene::PlanningScenePtr scene = s.start()->scene()->diff();
 		SubTrajectory solution;
 
 		solution.markAsFailure();
-		solution.setComment(s.comment() + " no IK found");
+		solution.setComment(s.comment() + (num_duplicates > 0 ? " only duplicate IK solutions found" : " no IK found"));
 
 		// ik target link placement
-		std::copy(failure_markers.begin(), failure_markers.end(), std::back_inserter(solution.markers()));
+		solution.addMarkerGenerator(target.failure_markers);
 
 		spawn(InterfaceState(scene), std::move(solution));
 	}
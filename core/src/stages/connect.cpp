@@ -57,6 +57,7 @@ void Connect::reset()
 {
 	Connecting::reset();
 	merged_jmg_.reset();
+	unplanned_joints_.clear();
 	subsolutions_.clear();
 	states_.clear();
 }
@@ -85,6 +86,15 @@ void Connect::init(const core::RobotModelConstPtr& robot_model)
 		}
 	}
 
+	// all joints not covered by any planning group need to match
+	std::set<const moveit::core::JointModel*> planned_joints;
+	for (const moveit::core::JointModelGroup* jmg : groups)
+		planned_joints.insert(jmg->getJointModels().begin(), jmg->getJointModels().end());
+	unplanned_joints_.clear();
+	for (const moveit::core::JointModel* jm : robot_model->getJointModels())
+		if (jm->getVariableCount() > 0 && !planned_joints.count(jm))
+			unplanned_joints_.push_back(jm);
+
 	if (!errors && groups.size() >= 2) {  // enable merging?
 		merged_jmg_.reset(task_constructor::merge(groups));
 		if (merged_jmg_->getJointModels().size() != num_joints) {
@@ -104,24 +114,12 @@ void Connect::init(const core::RobotModelConstPtr& robot_model)
 
 bool Connect::compatible(const InterfaceState& from_state, const InterfaceState& to_state) const
 {
-	if (!Connecting::compatible(from_state, to_state))
-		return false;
-
 	const moveit::core::RobotState& from = from_state.scene()->getCurrentState();
 	const moveit::core::RobotState& to = to_state.scene()->getCurrentState();
 
-	// compose set of joint names we plan for
-	std::set<std::string> planned_joint_names;
-	for (const GroupPlannerVector::value_type& pair : planner_) {
-		const moveit::core::JointModelGroup *jmg = from.getJointModelGroup(pair.first);
-		const auto &names = jmg->getJointModelNames();
-		planned_joint_names.insert(names.begin(), names.end());
-	}
 	// all active joints that we don't plan for should match
-	for (const moveit::core::JointModel* jm : from.getRobotModel()->getJointModels()) {
-		if (planned_joint_names.count(jm->getName()))
-			continue;  // ignore joints we plan for
-
+	// these few values are compared first, as cheap as a fingerprint, but with the exact tolerance
+	for (const moveit::core::JointModel* jm : unplanned_joints_) {
 		const unsigned int num = jm->getVariableCount();
 		Eigen::Map<const Eigen::VectorXd> positions_from (from.getJointPositions(jm), num);
 		Eigen::Map<const Eigen::VectorXd> positions_to (to.getJointPositions(jm), num);
@@ -132,7 +130,7 @@ bool Connect::compatible(const InterfaceState& from_state, const InterfaceState&
 			return false;
 		}
 	}
-	return true;
+	return Connecting::compatible(from_state, to_state);
 }
 
 void Connect::compute(const InterfaceState &from, const InterfaceState &to) {
@@ -161,7 +159,11 @@ void Connect::compute(const InterfaceState &from, const InterfaceState &to) {
 		intermediate_scenes.push_back(end);
 
 		robot_trajectory::RobotTrajectoryPtr trajectory;
-		success = pair.second->plan(start, end, jmg, timeout, trajectory, path_constraints);
+		{
+			ScopedTimer timer(timing("plan"));
+			Unlocked unlocked(*this);
+			success = pair.second->plan(start, end, jmg, timeout, trajectory, path_constraints);
+		}
 		sub_trajectories.push_back(trajectory);  // include failed trajectory
 
 		if (!success)
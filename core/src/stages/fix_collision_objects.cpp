@@ -45,6 +45,8 @@
 #include <eigen_conversions/eigen_msg.h>
 #include <ros/console.h>
 
+#include <memory>
+
 namespace vm = visualization_msgs;
 namespace cd = collision_detection;
 
@@ -111,9 +113,25 @@ SubTrajectory FixCollisionObjects::fixCollisions(planning_scene::PlanningScene &
 	req.distance = false;
 
 
-	vm::Marker m;
-	m.header.frame_id = scene.getPlanningFrame();
-	m.ns = "collisions";
+	// corrections applied, visualized on demand
+	struct Correction {
+		Eigen::Vector3d position;
+		Eigen::Vector3d direction;
+		bool failure;
+	};
+	auto corrections = std::make_shared<std::vector<Correction>>();
+	result.addMarkerGenerator([corrections, frame_id = scene.getPlanningFrame()](std::vector<vm::Marker>& markers) {
+		vm::Marker m;
+		m.header.frame_id = frame_id;
+		m.ns = "collisions";
+		for (const Correction& c : *corrections) {
+			rviz_marker_tools::setColor(m.color, c.failure ? rviz_marker_tools::RED : rviz_marker_tools::GREEN);
+			tf::poseEigenToMsg(Eigen::Translation3d(c.position) *
+			                   Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitX(), c.direction), m.pose);
+			rviz_marker_tools::makeArrow(m, c.direction.norm(), true);
+			markers.push_back(m);
+		}
+	});
 
 	bool failure = false;
 	while (!failure) {
@@ -134,11 +152,7 @@ SubTrajectory FixCollisionObjects::fixCollisions(planning_scene::PlanningScene &
 
 			// marker indicating correction
 			const cd::Contact &c = info.second.front();
-			rviz_marker_tools::setColor(m.color, failure ? rviz_marker_tools::RED : rviz_marker_tools::GREEN);
-			tf::poseEigenToMsg(Eigen::Translation3d(c.pos) *
-			                   Eigen::Quaterniond::FromTwoVectors(Eigen::Vector3d::UnitX(), correction), m.pose);
-			rviz_marker_tools::makeArrow(m, depth, true);
-			result.markers().push_back(m);
+			corrections->push_back(Correction{ c.pos, correction, failure });
 			if (failure)
 				break;
 
@@ -142,7 +142,9 @@ void GenerateGraspPose::compute() {
 		trajectory.setComment(std::to_string(current_angle_));
 
 		// add frame at target pose
-		rviz_marker_tools::appendFrame(trajectory.markers(), target_pose_msg, 0.1, "grasp frame");
+		trajectory.addMarkerGenerator([target_pose_msg](std::vector<visualization_msgs::Marker>& markers) {
+			rviz_marker_tools::appendFrame(markers, target_pose_msg, 0.1, "grasp frame");
+		});
 
 		spawn(std::move(state), std::move(trajectory));
 	}
@@ -131,7 +131,9 @@ void GeneratePlacePose::compute() {
 
 				SubTrajectory trajectory;
 				trajectory.setCost(0.0);
-				rviz_marker_tools::appendFrame(trajectory.markers(), target_pose_msg, 0.1, "place frame");
+				trajectory.addMarkerGenerator([target_pose_msg](std::vector<visualization_msgs::Marker>& markers) {
+					rviz_marker_tools::appendFrame(markers, target_pose_msg, 0.1, "place frame");
+				});
 
 				spawn(std::move(state), std::move(trajectory));
 			}
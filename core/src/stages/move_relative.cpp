@@ -130,6 +130,8 @@ bool MoveRelative::compute(const InterfaceState &state, planning_scene::Planning
 
 	if (getJointStateFromOffset(direction, jmg, scene->getCurrentStateNonConst())) {
 		// plan to joint-space target
+		ScopedTimer timer(timing("plan"));
+		Unlocked unlocked(*this);
 		success = planner_->plan(state.scene(), scene, jmg, timeout, robot_trajectory, path_constraints);
 	} else {
 		// Cartesian targets require an IK reference frame
@@ -232,7 +234,11 @@ COMPUTE:
 		tf::poseMsgToEigen(ik_pose_msg.pose, ik_pose);
 		target_eigen = target_eigen * ik_pose.inverse();
 
-		success = planner_->plan(state.scene(), *link, target_eigen, jmg, timeout, robot_trajectory, path_constraints);
+		{
+			ScopedTimer timer(timing("plan"));
+			Unlocked unlocked(*this);
+			success = planner_->plan(state.scene(), *link, target_eigen, jmg, timeout, robot_trajectory, path_constraints);
+		}
 
 		// min_distance reached?
 		if (min_distance > 0.0) {
@@ -195,6 +195,8 @@ bool MoveTo::compute(const InterfaceState &state, planning_scene::PlanningSceneP
 
 	if (getJointStateGoal(goal, jmg, scene->getCurrentStateNonConst())) {
 		// plan to joint-space target
+		ScopedTimer timer(timing("plan"));
+		Unlocked unlocked(*this);
 		success = planner_->plan(state.scene(), scene, jmg, timeout, robot_trajectory, path_constraints);
 	} else { // Cartesian goal
 		const moveit::core::LinkModel* link;
@@ -231,6 +233,8 @@ bool MoveTo::compute(const InterfaceState &state, planning_scene::PlanningSceneP
 		target_eigen = target_eigen * ik_pose.inverse();
 
 		// plan to Cartesian target
+		ScopedTimer timer(timing("plan"));
+		Unlocked unlocked(*this);
 		success = planner_->plan(state.scene(), *link, target_eigen, jmg, timeout, robot_trajectory, path_constraints);
 	}
 
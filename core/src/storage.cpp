@@ -41,7 +41,10 @@
 #include <moveit/robot_trajectory/robot_trajectory.h>
 #include <moveit/robot_state/conversions.h>
 #include <moveit/planning_scene/planning_scene.h>
+#include <boost/functional/hash.hpp>
 #include <assert.h>
+#include <atomic>
+#include <cmath>
 
 namespace moveit { namespace task_constructor {
 
@@ -53,8 +56,110 @@ ensureUpdated(const planning_scene::PlanningScenePtr& scene) {
 	return scene;
 }
 
+namespace {
+
+std::atomic<unsigned int> max_scene_depth(0);
+
+unsigned int depth(const planning_scene::PlanningScene& scene)
+{
+	unsigned int result = 0;
+	for (const planning_scene::PlanningScene* s = scene.getParent().get(); s; s = s->getParent().get())
+		++result;
+	return result;
+}
+
+/// collapse scene's diff chain if it exceeds the maximum depth
+planning_scene::PlanningSceneConstPtr collapse(const planning_scene::PlanningSceneConstPtr& scene)
+{
+	const unsigned int max_depth = max_scene_depth.load(std::memory_order_relaxed);
+	if (max_depth == 0 || depth(*scene) <= max_depth)
+		return scene;
+
+	// Flatten the parent chain only: clone() decouples from it, copying world objects by reference.
+	// The scene's own changes are re-applied as a diff, such that getPlanningSceneDiffMsg() still reports them.
+	const planning_scene::PlanningSceneConstPtr& parent = scene->getParent();
+	planning_scene::PlanningScenePtr result = planning_scene::PlanningScene::clone(parent)->diff();
+	if (&scene->getCurrentState() != &parent->getCurrentState())
+		result->setCurrentState(scene->getCurrentState());
+	if (&scene->getAllowedCollisionMatrix() != &parent->getAllowedCollisionMatrix())
+		result->getAllowedCollisionMatrixNonConst() = scene->getAllowedCollisionMatrix();
+
+	const collision_detection::WorldConstPtr& world = scene->getWorld();
+	const collision_detection::WorldConstPtr& parent_world = parent->getWorld();
+	const collision_detection::WorldPtr& result_world = result->getWorldNonConst();
+	for (const std::string& id : parent_world->getObjectIds())
+		if (!world->hasObject(id))
+			result_world->removeObject(id);
+	for (const auto& pair : *world) {
+		if (parent_world->getObject(pair.first) == pair.second)
+			continue;  // unchanged object, shared with the parent
+		result_world->removeObject(pair.first);
+		result_world->addToObject(pair.first, pair.second->shapes_, pair.second->shape_poses_);
+		if (scene->hasObjectColor(pair.first))
+			result->setObjectColor(pair.first, scene->getObjectColor(pair.first));
+		if (scene->hasObjectType(pair.first))
+			result->setObjectType(pair.first, scene->getObjectType(pair.first));
+	}
+	return result;
+}
+
+/// estimated memory [bytes] of a RobotState
+size_t robotStateSize(const moveit::core::RobotModel& model)
+{
+	// positions, velocities, accelerations + link, joint, and collision body transforms
+	return sizeof(moveit::core::RobotState) + 3 * model.getVariableCount() * sizeof(double)
+	       + (2 * model.getLinkModelCount() + model.getJointModelCount()) * sizeof(Eigen::Isometry3d);
+}
+
+/// estimated memory [bytes] owned by a single scene, not considering its parents
+size_t planningSceneSize(const planning_scene::PlanningScene& scene)
+{
+	// rough size of a std::map node, storing a key string and some payload
+	static const size_t MAP_NODE_SIZE = 4 * sizeof(void*) + sizeof(std::string) + sizeof(double);
+
+	const planning_scene::PlanningScene* parent = scene.getParent().get();
+	const moveit::core::RobotModelConstPtr& model = scene.getRobotModel();
+	size_t result = sizeof(planning_scene::PlanningScene);
+
+	const moveit::core::RobotState& state = scene.getCurrentState();
+	if (!parent || &state != &parent->getCurrentState())
+		result += robotStateSize(*model);
+
+	const collision_detection::AllowedCollisionMatrix& acm = scene.getAllowedCollisionMatrix();
+	if (!parent || &acm != &parent->getAllowedCollisionMatrix()) {
+		std::vector<std::string> names;
+		acm.getAllEntryNames(names);
+		collision_detection::AllowedCollision::Type type;
+		result += sizeof(collision_detection::AllowedCollisionMatrix) + names.size() * MAP_NODE_SIZE;
+		for (size_t i = 0; i < names.size(); ++i)
+			for (size_t j = i; j < names.size(); ++j)
+				if (acm.getEntry(names[i], names[j], type))
+					result += 2 * MAP_NODE_SIZE;  // symmetric entries
+	}
+
+	// each scene maintains its own map of world objects, while objects are shared copy-on-write
+	const collision_detection::WorldConstPtr& world = scene.getWorld();
+	result += sizeof(collision_detection::World) + world->size() * MAP_NODE_SIZE;
+	if (!parent) {
+		for (const auto& object : *world)
+			result += sizeof(collision_detection::World::Object)
+			          + object.second->shapes_.size() * (sizeof(shapes::ShapeConstPtr) + sizeof(Eigen::Isometry3d));
+	}
+	return result;
+}
+
+
+/// hash a pose exactly
+void hashPose(size_t& seed, const Eigen::Isometry3d& pose)
+{
+	const double* data = pose.matrix().data();
+	boost::hash_range(seed, data, data + 16);
+}
+
+}  // anonymous namespace
+
 InterfaceState::InterfaceState(const planning_scene::PlanningScenePtr& ps)
-   : scene_(ensureUpdated(ps))
+   : scene_(collapse(ensureUpdated(ps)))
 {
 }
 
@@ -63,13 +168,106 @@ InterfaceState::InterfaceState(const planning_scene::PlanningSceneConstPtr& ps)
 {
 	if (scene_->getCurrentState().dirty())
 		ROS_ERROR_NAMED("InterfaceState", "Dirty PlanningScene! Please only forward clean ones into InterfaceState.");
+	else
+		scene_ = collapse(scene_);
+}
+
+unsigned int InterfaceState::sceneDepth() const
+{
+	return depth(*scene_);
+}
+
+size_t InterfaceState::sceneFootprint() const
+{
+	size_t result = 0;
+	for (const planning_scene::PlanningScene* s = scene_.get(); s; s = s->getParent().get())
+		result += planningSceneSize(*s);
+	return result;
+}
+
+void InterfaceState::setMaxSceneDepth(unsigned int depth)
+{
+	max_scene_depth.store(depth, std::memory_order_relaxed);
+}
+
+unsigned int InterfaceState::maxSceneDepth()
+{
+	return max_scene_depth.load(std::memory_order_relaxed);
 }
 
 InterfaceState::InterfaceState(const InterfaceState &other)
-   : scene_(other.scene_), properties_(other.properties_), priority_(other.priority_)
+   : scene_(other.scene_), properties_(other.properties_)
+   , has_fingerprint_(other.has_fingerprint_), fingerprint_(other.fingerprint_)  // same scene
+   , priority_(other.priority_)
 {
 }
 
+size_t InterfaceState::sceneFingerprint() const
+{
+	if (!has_fingerprint_) {
+		fingerprint_ = sceneFingerprint(*scene_);
+		has_fingerprint_ = true;
+	}
+	return fingerprint_;
+}
+
+size_t InterfaceState::sceneFingerprint(const planning_scene::PlanningScene& scene, bool exact)
+{
+	// discrete data, which Connecting::compatible() compares exactly, is always hashed
+	size_t seed = 0;
+	// world objects are ordered by their ids
+	for (const auto& pair : *scene.getWorld()) {
+		const collision_detection::World::Object& object = *pair.second;
+		boost::hash_combine(seed, pair.first);
+		boost::hash_combine(seed, object.shape_poses_.size());
+		if (!exact)
+			continue;
+		for (size_t i = 0; i < object.shapes_.size(); ++i) {
+			boost::hash_combine(seed, object.shapes_[i].get());
+			hashPose(seed, object.shape_poses_[i]);
+		}
+	}
+
+	// attached bodies are ordered by their names
+	const moveit::core::RobotState& state = scene.getCurrentState();
+	std::vector<const moveit::core::AttachedBody*> bodies;
+	state.getAttachedBodies(bodies);
+	for (const moveit::core::AttachedBody* body : bodies) {
+		boost::hash_combine(seed, body->getName());
+		boost::hash_combine(seed, body->getAttachedLinkName());
+		boost::hash_combine(seed, body->getFixedTransforms().size());
+		if (!exact)
+			continue;
+		for (const std::string& name : body->getTouchLinks())
+			boost::hash_combine(seed, name);
+		for (const shapes::ShapeConstPtr& shape : body->getShapes())
+			boost::hash_combine(seed, shape.get());
+		for (const Eigen::Isometry3d& pose : body->getFixedTransforms())
+			hashPose(seed, pose);
+	}
+	if (!exact)
+		return seed;
+
+	// conditional entries are only considered by their type
+	const collision_detection::AllowedCollisionMatrix& acm = scene.getAllowedCollisionMatrix();
+	std::vector<std::string> names;
+	acm.getAllEntryNames(names);
+	collision_detection::AllowedCollision::Type type;
+	for (size_t i = 0; i < names.size(); ++i) {
+		boost::hash_combine(seed, names[i]);
+		if (acm.getDefaultEntry(names[i], type))
+			boost::hash_combine(seed, static_cast<int>(type));
+		for (size_t j = i; j < names.size(); ++j) {
+			if (acm.getEntry(names[i], names[j], type)) {
+				boost::hash_combine(seed, j);
+				boost::hash_combine(seed, static_cast<int>(type));
+			}
+		}
+	}
+
+	boost::hash_range(seed, state.getVariablePositions(), state.getVariablePositions() + state.getVariableCount());
+	return seed;
+}
 
 bool InterfaceState::Priority::operator<(const InterfaceState::Priority& other) const {
 	// infinite costs go always last
@@ -87,12 +285,13 @@ bool InterfaceState::Priority::operator<(const InterfaceState::Priority& other)
 }
 
 
-Interface::Interface(const Interface::NotifyFunction &notify)
-   : notify_(notify)
+Interface::Interface(const Interface::NotifyFunction &notify, TimingStatistics* timing)
+   : notify_(notify), timing_(timing)
 {}
 
 // Announce a new InterfaceState
 void Interface::add(InterfaceState &state) {
+	ScopedTimer timer(timing_);
 	// require valid scene
 	assert(state.scene());
 	// incoming and outgoing must not contain elements both
@@ -118,6 +317,7 @@ void Interface::add(InterfaceState &state) {
 
 	// move list node into interface's state list (sorted by priority)
 	moveFrom(it, container);
+	it->handle_ = it;
 	// and finally call notify callback
 	if (notify_) notify_(it, false);
 }
@@ -133,9 +333,10 @@ Interface::container_type Interface::remove(iterator it)
 void Interface::updatePriority(InterfaceState *state, const InterfaceState::Priority& priority)
 {
 	if (priority != state->priority()) {
-		auto it = std::find_if(begin(), end(), [state](const InterfaceState* other) { return state == other; });
+		ScopedTimer timer(timing_);
 		// state should be part of the interface
-		assert(it != end());
+		assert(state->owner_ == this);
+		Interface::iterator it = state->handle_;
 		state->priority_ = priority;
 		update(it);
 		if (notify_) notify_(it, true);
@@ -161,9 +362,15 @@ void SolutionBase::fillInfo(moveit_task_constructor_msgs::SolutionInfo& info,
 	const Introspection *ci = introspection;
 	info.stage_id = ci ? ci->stageId(this->creator()->me()) : 0;
 
-	const auto& markers = this->markers();
-	info.markers.resize(markers.size());
-	std::copy(markers.begin(), markers.end(), info.markers.begin());
+	info.markers.clear();
+	generateMarkers(info.markers);
+}
+
+void SolutionBase::generateMarkers(std::vector<visualization_msgs::Marker>& markers) const
+{
+	markers.insert(markers.end(), markers_.begin(), markers_.end());
+	for (const MarkerGenerator& generator : marker_generators_)
+		generator(markers);
 }
 
 void SubTrajectory::fillMessage(moveit_task_constructor_msgs::Solution &msg,
@@ -172,19 +379,54 @@ void SubTrajectory::fillMessage(moveit_task_constructor_msgs::Solution &msg,
 	moveit_task_constructor_msgs::SubTrajectory& t = msg.sub_trajectory.back();
 	SolutionBase::fillInfo(t.info, introspection);
 
+	if (introspection)  // introspection caches serialized payloads
+		introspection->fillPayload(t, *this);
+	else
+		fillPayload(t);
+}
+
+size_t SolutionBase::footprint() const
+{
+	return sizeof(SolutionBase) + comment_.capacity() + markers_.capacity() * sizeof(visualization_msgs::Marker) +
+	       marker_generators_.capacity() * sizeof(MarkerGenerator);
+}
+
+size_t SubTrajectory::footprint() const
+{
+	size_t result = SolutionBase::footprint() + sizeof(SubTrajectory) - sizeof(SolutionBase);
+	if (trajectory_)
+		result += sizeof(robot_trajectory::RobotTrajectory)
+		          + trajectory_->getWayPointCount() * (robotStateSize(*trajectory_->getRobotModel()) + sizeof(double));
+	return result;
+}
+
+void SubTrajectory::fillPayload(moveit_task_constructor_msgs::SubTrajectory &msg) const
+{
 	if (trajectory())
-		trajectory()->getRobotTrajectoryMsg(t.trajectory);
+		trajectory()->getRobotTrajectoryMsg(msg.trajectory);
 
-	this->end()->scene()->getPlanningSceneDiffMsg(t.scene_diff);
+	this->end()->scene()->getPlanningSceneDiffMsg(msg.scene_diff);
 }
 
 
 
+size_t SolutionSequence::footprint() const
+{
+	return SolutionBase::footprint() + sizeof(SolutionSequence) - sizeof(SolutionBase)
+	       + subsolutions_.capacity() * sizeof(const SolutionBase*);
+}
+
 void SolutionSequence::push_back(const SolutionBase& solution)
 {
 	subsolutions_.push_back(&solution);
 }
 
+void SolutionSequence::visitSubTrajectories(const std::function<void(const SubTrajectory&)>& visitor) const
+{
+	for (const SolutionBase* s : subsolutions_)
+		s->visitSubTrajectories(visitor);
+}
+
 void SolutionSequence::fillMessage(moveit_task_constructor_msgs::Solution &msg,
                                    Introspection* introspection) const
 {
@@ -40,6 +40,9 @@
 #include <moveit/task_constructor/task.h>
 #include <moveit/task_constructor/container.h>
 #include <moveit/task_constructor/introspection.h>
+#include <moveit/task_constructor/scheduler.h>
+#include <moveit/task_constructor/memory_pool.h>
+#include <moveit/task_constructor/plan_handle.h>
 #include <moveit_task_constructor_msgs/ExecuteTaskSolutionAction.h>
 
 #include <ros/ros.h>
@@ -47,8 +50,17 @@
 
 #include <moveit/robot_model_loader/robot_model_loader.h>
 #include <moveit/planning_pipeline/planning_pipeline.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_trajectory/robot_trajectory.h>
+#include <geometric_shapes/shape_operations.h>
 
+#include <cmath>
 #include <functional>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace {
 std::string rosNormalizeName(const std::string &name) {
@@ -72,8 +84,154 @@ std::string rosNormalizeName(const std::string &name) {
 
 namespace moveit { namespace task_constructor {
 
+namespace {
+/// number of computing stages (leafs or wrappers), which are able to compute
+unsigned int numComputingStages(const ContainerBase& root)
+{
+	unsigned int result = 0;
+	root.traverseRecursively([&result](const Stage& stage, int) {
+		if (dynamic_cast<const ContainerBase*>(&stage) && !dynamic_cast<const WrapperBase*>(&stage))
+			return true;  // descend into children of (non-wrapper) containers
+		if (stage.pimpl()->canCompute())
+			++result;
+		return false;
+	});
+	return result;
+}
+
+constexpr double SCENE_TOLERANCE = 1e-6;
+
+/// do both objects have the same shapes at the same poses? Shapes are compared by type and extents.
+bool sameObject(const collision_detection::World::Object& a, const collision_detection::World::Object& b)
+{
+	if (a.shapes_.size() != b.shapes_.size())
+		return false;
+	for (size_t i = 0; i < a.shapes_.size(); ++i) {
+		if (!a.shape_poses_[i].isApprox(b.shape_poses_[i], SCENE_TOLERANCE))
+			return false;
+		if (a.shapes_[i] == b.shapes_[i])
+			continue;
+		if (a.shapes_[i]->type != b.shapes_[i]->type ||
+		    !shapes::computeShapeExtents(a.shapes_[i].get()).isApprox(shapes::computeShapeExtents(b.shapes_[i].get()),
+		                                                               SCENE_TOLERANCE))
+			return false;
+	}
+	return true;
+}
+
+/// ids of world objects added, removed, or modified between scenes a and b
+std::vector<std::string> changedObjects(const planning_scene::PlanningScene& a, const planning_scene::PlanningScene& b)
+{
+	std::vector<std::string> result;
+	const collision_detection::WorldConstPtr& world_a = a.getWorld();
+	const collision_detection::WorldConstPtr& world_b = b.getWorld();
+	for (const std::string& id : world_a->getObjectIds()) {
+		collision_detection::World::ObjectConstPtr object = world_b->getObject(id);
+		if (!object || !sameObject(*world_a->getObject(id), *object))
+			result.push_back(id);
+	}
+	for (const std::string& id : world_b->getObjectIds())
+		if (!world_a->hasObject(id))
+			result.push_back(id);
+	return result;
+}
+
+/// do robot state, attached bodies, and ACM of scenes a and b agree?
+bool sameRobotAndACM(const planning_scene::PlanningScene& a, const planning_scene::PlanningScene& b)
+{
+	const moveit::core::RobotState& state_a = a.getCurrentState();
+	const moveit::core::RobotState& state_b = b.getCurrentState();
+	if (state_a.getRobotModel() != state_b.getRobotModel())
+		return false;
+	for (size_t i = 0; i < state_a.getVariableCount(); ++i)
+		if (std::fabs(state_a.getVariablePosition(i) - state_b.getVariablePosition(i)) > SCENE_TOLERANCE)
+			return false;
+
+	std::vector<const moveit::core::AttachedBody*> bodies_a, bodies_b;
+	state_a.getAttachedBodies(bodies_a);
+	state_b.getAttachedBodies(bodies_b);
+	if (bodies_a.size() != bodies_b.size())
+		return false;
+	for (const moveit::core::AttachedBody* body : bodies_a) {
+		const moveit::core::AttachedBody* other = state_b.getAttachedBody(body->getName());
+		if (!other || other->getAttachedLink() != body->getAttachedLink() ||
+		    other->getFixedTransforms().size() != body->getFixedTransforms().size())
+			return false;
+	}
+
+	const collision_detection::AllowedCollisionMatrix& acm_a = a.getAllowedCollisionMatrix();
+	const collision_detection::AllowedCollisionMatrix& acm_b = b.getAllowedCollisionMatrix();
+	std::vector<std::string> names_a, names_b;
+	acm_a.getAllEntryNames(names_a);
+	acm_b.getAllEntryNames(names_b);
+	if (names_a != names_b)
+		return false;
+	collision_detection::AllowedCollision::Type type_a, type_b;
+	for (size_t i = 0; i < names_a.size(); ++i) {
+		bool has_a = acm_a.getDefaultEntry(names_a[i], type_a);
+		bool has_b = acm_b.getDefaultEntry(names_a[i], type_b);
+		if (has_a != has_b || (has_a && type_a != type_b))
+			return false;
+		for (size_t j = i; j < names_a.size(); ++j) {
+			has_a = acm_a.getEntry(names_a[i], names_a[j], type_a);
+			has_b = acm_b.getEntry(names_a[i], names_a[j], type_b);
+			if (has_a != has_b || (has_a && type_a != type_b))
+				return false;
+		}
+	}
+	return true;
+}
+
+/** is solution still valid if the changed objects are replaced by their version in scene?
+ *
+ * Results for sub trajectories, which are shared by many solutions, are memoized in checked. */
+bool isValid(const SolutionBase& solution, const planning_scene::PlanningScene& scene,
+             const std::vector<std::string>& changed, std::unordered_map<const SubTrajectory*, bool>& checked)
+{
+	// scene of a sub trajectory's state with changed objects updated, nullptr if the state depends on them
+	auto patch = [&](const InterfaceState* state) {
+		planning_scene::PlanningScenePtr result;
+		for (const std::string& id : changed)
+			if (state->scene()->getCurrentState().hasAttachedBody(id))
+				return result;
+		result = state->scene()->diff();
+		const collision_detection::WorldPtr& world = result->getWorldNonConst();
+		for (const std::string& id : changed) {
+			world->removeObject(id);
+			if (collision_detection::World::ObjectConstPtr object = scene.getWorld()->getObject(id))
+				world->addToObject(id, object->shapes_, object->shape_poses_);
+		}
+		return result;
+	};
+
+	bool valid = true;
+	solution.visitSubTrajectories([&](const SubTrajectory& t) {
+		if (!valid)
+			return;
+		auto it = checked.find(&t);
+		if (it != checked.end()) {
+			valid = it->second;
+			return;
+		}
+		planning_scene::PlanningScenePtr start = patch(t.start());
+		planning_scene::PlanningScenePtr end = t.end() == t.start() ? start : patch(t.end());
+		if (!start || !end)
+			valid = false;
+		// the trajectory was planned in the start scene
+		if (valid && t.trajectory()) {
+			for (size_t i = 0; valid && i < t.trajectory()->getWayPointCount(); ++i)
+				valid = !start->isStateColliding(t.trajectory()->getWayPoint(i));
+		}
+		valid = valid && !end->isStateColliding(end->getCurrentState());
+		checked[&t] = valid;
+	});
+	return valid;
+}
+}
+
 Task::Task(const std::string& id, ContainerBase::pointer &&container)
    : WrapperBase(std::string(), std::move(container)), id_(id), preempt_requested_(false)
+   , deadline_(new Deadline())
 {
 	if (!id.empty()) stages()->setName(id);
 	id_ = rosNormalizeName(id);
@@ -87,6 +245,7 @@ Task::Task(const std::string& id, ContainerBase::pointer &&container)
 
 Task::Task(Task&& other)
    : WrapperBase(std::string(), std::make_unique<SerialContainer>())
+   , preempt_requested_(false), deadline_(new Deadline())
 {
 	*this = std::move(other);
 }
@@ -97,17 +256,147 @@ Task& Task::operator=(Task&& other)
 	robot_model_ = std::move(other.robot_model_);
 	introspection_ = std::move(other.introspection_);
 	task_cbs_ = std::move(other.task_cbs_);
+	num_threads_ = other.num_threads_;
+	scheduler_ = std::move(other.scheduler_);
+	memory_pool_ = std::move(other.memory_pool_);
+	pruning_ = other.pruning_;
+	cost_bound_ = std::move(other.cost_bound_);
+	best_costs_ = std::move(other.best_costs_);
+	resumable_ = other.resumable_;
+	std::swap(deadline_, other.deadline_);
 	std::swap(pimpl_, other.pimpl_);
 	return *this;
 }
 
-struct PlannerCache {
+namespace {
+/** Robot model loaders and planning pipelines of the process
+ *
+ * Shared loaders are cached per robot_description parameter, such that tasks loading the same description share
+ * their robot model, and thus their pipelines, which are cached per robot model and pipeline parameters.
+ * Private loaders are only tracked to retain them with their model's pipelines.
+ * Pipelines and loaders are shared as long as they are used. Retained ones are additionally kept alive until
+ * release(). A retained pipeline retains the loader of its model (if known), as the model's kinematics
+ * plugins are unloaded with the loader. All methods are thread-safe. Loaders and pipelines are created outside
+ * the lock, not to serialize unrelated tasks: if two threads create the same one concurrently, the first one
+ * stored is used by both and the other one is discarded. */
+class PlannerCache {
+public:
 	typedef std::tuple<std::string, std::string, std::string> PlannerID;
-	typedef std::map<PlannerID, std::weak_ptr<planning_pipeline::PlanningPipeline>> PlannerMap;
+
+	static PlannerCache& instance() {
+		static PlannerCache cache;
+		return cache;
+	}
+
+	robot_model_loader::RobotModelLoaderPtr loader(const std::string& robot_description, bool share, bool retain) {
+		robot_model_loader::RobotModelLoaderPtr loader;
+		if (share) {
+			std::lock_guard<std::mutex> lock(mutex_);
+			loader = loaders_[robot_description].loader.lock();
+		}
+		robot_model_loader::RobotModelLoaderPtr created;
+		if (!loader)
+			created = loader = std::make_shared<robot_model_loader::RobotModelLoader>(robot_description);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!share) {
+			private_loaders_.remove_if([](const std::weak_ptr<robot_model_loader::RobotModelLoader>& l) { return l.expired(); });
+			private_loaders_.push_back(loader);
+			return loader;
+		}
+		LoaderEntry& entry = loaders_[robot_description];
+		if (robot_model_loader::RobotModelLoaderPtr stored = entry.loader.lock())
+			loader = stored;  // created concurrently, destroy ours outside the lock
+		else
+			entry.loader = loader;
+		if (retain || retain_)
+			entry.retained = loader;
+		return loader;
+	}
+
+	planning_pipeline::PlanningPipelinePtr get(const robot_model::RobotModelConstPtr& model, const PlannerID& id,
+	                                           bool retain) {
+		planning_pipeline::PlanningPipelinePtr planner;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			planner = retrieve(model, id).pipeline.lock();
+		}
+		planning_pipeline::PlanningPipelinePtr created;
+		if (!planner)  // loading plugins might take a while: don't block other tasks
+			created = planner = std::make_shared<planning_pipeline::PlanningPipeline>
+			                    (model, ros::NodeHandle(std::get<0>(id)), std::get<1>(id), std::get<2>(id));
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		Entry& entry = retrieve(model, id);
+		if (planning_pipeline::PlanningPipelinePtr stored = entry.pipeline.lock())
+			planner = stored;  // created concurrently, destroy ours outside the lock
+		else
+			entry.pipeline = planner;
+		if (retain || retain_) {
+			entry.retained = planner;
+			entry.retained_loader = findLoader(model);
+		}
+		return planner;
+	}
+
+	void setRetain(bool retain) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		retain_ = retain;
+	}
+
+	void release() {
+		// destroy outside the lock, pipelines before loaders
+		std::vector<robot_model_loader::RobotModelLoaderPtr> released_loaders;
+		std::vector<planning_pipeline::PlanningPipelinePtr> released;
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (auto& model : cache_) {
+			for (auto& entry : model.second) {
+				if (entry.second.retained)
+					released.push_back(std::move(entry.second.retained));
+				if (entry.second.retained_loader)
+					released_loaders.push_back(std::move(entry.second.retained_loader));
+			}
+		}
+		for (auto& entry : loaders_)
+			if (entry.second.retained)
+				released_loaders.push_back(std::move(entry.second.retained));
+	}
+
+private:
+	struct Entry {
+		std::weak_ptr<planning_pipeline::PlanningPipeline> pipeline;
+		planning_pipeline::PlanningPipelinePtr retained;  // keeps pipeline alive until release()
+		robot_model_loader::RobotModelLoaderPtr retained_loader;  // keeps plugins of retained pipeline's model loaded
+	};
+	struct LoaderEntry {
+		std::weak_ptr<robot_model_loader::RobotModelLoader> loader;
+		robot_model_loader::RobotModelLoaderPtr retained;  // keeps loader alive until release()
+	};
+	typedef std::map<PlannerID, Entry> PlannerMap;
 	typedef std::list<std::pair<std::weak_ptr<const robot_model::RobotModel>, PlannerMap>> ModelList;
+
+	std::mutex mutex_;  // protects all members
 	ModelList cache_;
+	std::map<std::string, LoaderEntry> loaders_;  // shared loaders per robot_description parameter
+	std::list<std::weak_ptr<robot_model_loader::RobotModelLoader>> private_loaders_;
+	bool retain_ = false;  // retain all pipelines and loaders created or requested
+
+	/// find (alive) loader of model, nullptr if model wasn't loaded via loader()
+	robot_model_loader::RobotModelLoaderPtr findLoader(const robot_model::RobotModelConstPtr& model) {
+		for (auto& entry : loaders_) {
+			robot_model_loader::RobotModelLoaderPtr loader = entry.second.loader.lock();
+			if (loader && loader->getModel() == model)
+				return loader;
+		}
+		for (auto& weak : private_loaders_) {
+			robot_model_loader::RobotModelLoaderPtr loader = weak.lock();
+			if (loader && loader->getModel() == model)
+				return loader;
+		}
+		return robot_model_loader::RobotModelLoaderPtr();
+	}
 
-	PlannerMap::mapped_type& retrieve(const robot_model::RobotModelConstPtr& model, PlannerID id) {
+	Entry& retrieve(const robot_model::RobotModelConstPtr& model, const PlannerID& id) {
 		// find model in cache_ and remove expired entries while doing so
 		ModelList::iterator model_it = cache_.begin();
 		while (model_it != cache_.end()) {
@@ -122,31 +411,54 @@ struct PlannerCache {
 		if (model_it == cache_.end())  // if not found, create a new PlannerMap for this model
 			model_it = cache_.insert(cache_.begin(), std::make_pair(model, PlannerMap()));
 
-		return model_it->second.insert(std::make_pair(id, PlannerMap::mapped_type())).first->second;
+		return model_it->second[id];
 	}
 };
+}
 
 planning_pipeline::PlanningPipelinePtr
 Task::createPlanner(const robot_model::RobotModelConstPtr& model, const std::string& ns,
                     const std::string& planning_plugin_param_name,
                     const std::string& adapter_plugins_param_name) {
-	static PlannerCache cache;
 	PlannerCache::PlannerID id (ns, planning_plugin_param_name, adapter_plugins_param_name);
+	return PlannerCache::instance().get(model, id, false);
+}
 
-	std::weak_ptr<planning_pipeline::PlanningPipeline>& entry = cache.retrieve(model, id);
-	planning_pipeline::PlanningPipelinePtr planner = entry.lock();
-	if (!planner) {
-		// create new entry
-		planner = std::make_shared<planning_pipeline::PlanningPipeline>
-		          (model, ros::NodeHandle(ns), planning_plugin_param_name, adapter_plugins_param_name);
-		// store in cache
-		entry = planner;
+void Task::warmUpPlanners(const robot_model::RobotModelConstPtr& model, const std::vector<std::string>& namespaces,
+                          const std::string& planning_plugin_param_name,
+                          const std::string& adapter_plugins_param_name) {
+	for (const std::string& ns : namespaces) {
+		PlannerCache::PlannerID id (ns, planning_plugin_param_name, adapter_plugins_param_name);
+		PlannerCache::instance().get(model, id, true);
 	}
-	return planner;
+}
+
+void Task::warmUpPlanners(const std::string& robot_description, const std::vector<std::string>& namespaces,
+                          const std::string& planning_plugin_param_name,
+                          const std::string& adapter_plugins_param_name) {
+	robot_model_loader::RobotModelLoaderPtr loader = PlannerCache::instance().loader(robot_description, true, true);
+	if (!loader->getModel())
+		throw Exception("Failed to construct RobotModel from " + robot_description);
+	warmUpPlanners(loader->getModel(), namespaces, planning_plugin_param_name, adapter_plugins_param_name);
+}
+
+void Task::setRetainPlanners(bool retain)
+{
+	PlannerCache::instance().setRetain(retain);
+}
+
+void Task::releasePlanners()
+{
+	PlannerCache::instance().release();
 }
 
 Task::~Task()
 {
+	// stop asynchronous planning
+	if (PlanHandlePtr handle = planHandle()) {
+		handle->cancel();
+		handle->wait();
+	}
 	clear();  // remove all stages
 	robot_model_.reset();
 	// only destroy loader after all references to the model are gone!
@@ -159,8 +471,8 @@ void Task::setRobotModel(const core::RobotModelConstPtr& robot_model)
 	robot_model_ = robot_model;
 }
 
-void Task::loadRobotModel(const std::string& robot_description) {
-	robot_model_loader_ = std::make_shared<robot_model_loader::RobotModelLoader>(robot_description);
+void Task::loadRobotModel(const std::string& robot_description, bool share) {
+	robot_model_loader_ = PlannerCache::instance().loader(robot_description, share, false);
 	setRobotModel(robot_model_loader_->getModel());
 	if (!robot_model_)
 		throw Exception("Task failed to construct RobotModel");
@@ -219,6 +531,12 @@ void Task::reset()
 		introspection_->reset();
 
 	WrapperBase::reset();
+	// release our reference to the memory pool: it is freed in bulk when the last solution is gone
+	memory_pool_.reset();
+	if (cost_bound_)
+		cost_bound_->reset();
+	best_costs_ = std::priority_queue<double>();
+	resumable_ = false;
 }
 
 void Task::init()
@@ -239,10 +557,30 @@ void Task::init()
 	// and *finally* validate connectivity
 	stages()->pimpl()->validateConnectivity();
 
-	// provide introspection instance to all stages
+	// (re)create scheduler for parallel planning
+	if (num_threads_ <= 1)
+		scheduler_.reset();
+	else if (!scheduler_ || scheduler_->numThreads() != num_threads_)
+		scheduler_.reset(new Scheduler(num_threads_));
+
+	if (!memory_pool_)
+		memory_pool_ = std::make_shared<MemoryPool>();
+
+	if (pruning_ && !cost_bound_)
+		cost_bound_.reset(new CostBound());
+	const CostBound* cost_bound = pruning_ ? cost_bound_.get() : nullptr;
+	// provide introspection, scheduler, memory pool, cost bound, and deadline instances to all stages
 	impl->setIntrospection(introspection_.get());
-	impl->traverseStages([this](Stage& stage, int) {
+	impl->setScheduler(scheduler_.get());
+	impl->setMemoryPool(memory_pool_);
+	impl->setCostBound(cost_bound);
+	impl->setDeadline(deadline_.get());
+	impl->traverseStages([this, cost_bound](Stage& stage, int) {
 		stage.pimpl()->setIntrospection(introspection_.get());
+		stage.pimpl()->setScheduler(scheduler_.get());
+		stage.pimpl()->setMemoryPool(memory_pool_);
+		stage.pimpl()->setCostBound(cost_bound);
+		stage.pimpl()->setDeadline(deadline_.get());
 		return true;
 	}, 1, UINT_MAX);
 
@@ -258,30 +596,163 @@ bool Task::canCompute() const
 
 void Task::compute()
 {
-	stages()->compute();
+	// when planning in parallel, the computing thread holds the scheduler's lock,
+	// which is only released while waiting for stages computed by other threads
+	std::unique_ptr<Scheduler::Lock> lock;
+	if (scheduler_)
+		lock.reset(new Scheduler::Lock(*scheduler_));
+	stages()->pimpl()->runCompute();
 }
 
-bool Task::plan(size_t max_solutions)
+void Task::setNumThreads(unsigned int num_threads)
 {
-	reset();
-	init();
+	if (num_threads == 0)
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	num_threads_ = num_threads;
+}
+
+bool Task::plan(size_t max_solutions, double timeout)
+{
+	preempt_requested_ = false;
+	return planImpl(max_solutions, timeout);
+}
+
+PlanHandlePtr Task::planAsync(size_t max_solutions, double timeout)
+{
+	std::lock_guard<std::mutex> lock(plan_handle_mutex_);
+	if (plan_handle_.lock())
+		throw std::runtime_error("Task is already planning");
 
+	// reset preemption before starting the thread: don't miss an early cancel()
 	preempt_requested_ = false;
-	while(ros::ok() && !preempt_requested_ && canCompute() &&
+	PlanHandlePtr handle(new PlanHandle(*this));
+	plan_handle_ = handle;
+	handle->thread_ = std::thread([this, max_solutions, timeout]() {
+		bool success = false;
+		try {
+			success = planImpl(max_solutions, timeout);
+		} catch (const InitStageException& e) {
+			ROS_ERROR_STREAM_NAMED("Task", "asynchronous planning failed:\n" << e);
+		} catch (const std::exception& e) {
+			ROS_ERROR_STREAM_NAMED("Task", "asynchronous planning failed: " << e.what());
+		}
+		PlanHandlePtr handle;
+		{
+			std::lock_guard<std::mutex> lock(plan_handle_mutex_);
+			handle = plan_handle_.lock();
+			plan_handle_.reset();
+		}
+		if (handle)
+			handle->finish(success);
+	});
+	return handle;
+}
+
+PlanHandlePtr Task::planHandle()
+{
+	std::lock_guard<std::mutex> lock(plan_handle_mutex_);
+	return plan_handle_.lock();
+}
+
+bool Task::resume(size_t max_solutions, double timeout)
+{
+	if (!resumable_) {
+		ROS_ERROR_NAMED("Task", "resume(): no previous plan() or start scene changed, call plan() instead");
+		return false;
+	}
+	preempt_requested_ = false;
+	return planImpl(max_solutions, timeout, true);
+}
+
+size_t Task::dropInvalidSolutions(const planning_scene::PlanningSceneConstPtr& scene)
+{
+	// comparison of a start scene with scene, usually shared by all solutions
+	struct Comparison {
+		bool comparable;  // same robot state, attached bodies, and ACM?
+		std::vector<std::string> changed;  // changed world objects
+		std::unordered_map<const SubTrajectory*, bool> checked;  // validity of sub trajectories
+	};
+	std::map<const planning_scene::PlanningScene*, Comparison> comparisons;
+	// without solutions, a scene change cannot be detected
+	bool changed = numSolutions() == 0;
+
+	const size_t dropped = stages()->pimpl()->dropSolutions([&](const SolutionBase& s) {
+		const planning_scene::PlanningScene& start = *s.start()->scene();
+		auto it = comparisons.find(&start);
+		if (it == comparisons.end()) {
+			it = comparisons.emplace(&start, Comparison()).first;
+			it->second.comparable = sameRobotAndACM(start, *scene);
+			if (it->second.comparable)
+				it->second.changed = changedObjects(start, *scene);
+		}
+		Comparison& c = it->second;
+		changed = changed || !c.comparable || !c.changed.empty();
+		return !c.comparable || (!c.changed.empty() && !isValid(s, *scene, c.changed, c.checked));
+	});
+	ROS_DEBUG_NAMED("Task", "dropped %zu invalid solutions, %zu remain valid", dropped, numSolutions());
+	if (changed)
+		resumable_ = false;  // stages would continue planning for the old scene
+	if (dropped == 0)
+		return 0;
+
+	// the pruning bound might stem from a dropped solution
+	best_costs_ = std::priority_queue<double>();
+	for (const auto& solution : solutions()) {
+		if (best_costs_.size() >= pruning_)
+			break;
+		best_costs_.push(solution->cost());
+	}
+	if (cost_bound_) {
+		cost_bound_->reset();
+		if (pruning_ && best_costs_.size() == pruning_)
+			cost_bound_->set(best_costs_.top());
+	}
+	if (introspection_)
+		introspection_->publishTaskState(true);
+	return dropped;
+}
+
+bool Task::planImpl(size_t max_solutions, double timeout, bool resume)
+{
+	// the deadline includes initialization time
+	deadline_->set(timeout);
+	if (preempt_requested_)  // cancel() might have been called before
+		deadline_->cancel();
+
+	if (!resume) {
+		reset();
+		init();
+		resumable_ = true;
+	}
+
+	while(ros::ok() && !preempt_requested_ && !deadline_->expired() && canCompute() &&
 	      (max_solutions == 0 || numSolutions() < max_solutions)) {
+		if (deadline_->active())
+			deadline_->setShares(numComputingStages(*stages()));
 		compute();
 		for (const auto& cb : task_cbs_)
 			cb(*this);
 		if (introspection_)
 			introspection_->publishTaskState();
 	}
+	if (!preempt_requested_ && deadline_->expired())
+		ROS_DEBUG_NAMED("Task", "planning deadline of %g s reached", timeout);
+	deadline_->set(std::numeric_limits<double>::infinity());  // don't limit stages beyond planning
+	if (introspection_)  // final state as full snapshot
+		introspection_->publishTaskState(true);
 	printState();
+
+	const MemoryPool::Statistics stats = memory_pool_->statistics();
+	ROS_DEBUG_NAMED("Task", "memory pool: %zu allocations, %zu bytes in use (peak: %zu), %zu bytes reserved",
+	                stats.allocations, stats.in_use, stats.peak, stats.reserved);
 	return numSolutions() > 0;
 }
 
 void Task::preempt()
 {
 	preempt_requested_ = true;
+	// let running stages finish quickly
+	deadline_->cancel();
 }
 
 void Task::execute(const SolutionBase &s)
@@ -306,6 +777,19 @@ void Task::onNewSolution(const SolutionBase &s)
 	// no need to call WrapperBase::onNewSolution!
 	if (introspection_)
 		introspection_->publishSolution(s);
+
+	// stream solution to asynchronous planning handle
+	if (PlanHandlePtr handle = planHandle())
+		handle->push(s.shared_from_this());
+
+	// the k-th best solution bounds the cost of solutions still worth computing
+	if (!pruning_)
+		return;
+	best_costs_.push(s.cost());
+	while (best_costs_.size() > pruning_)
+		best_costs_.pop();
+	if (cost_bound_ && best_costs_.size() == pruning_)
+		cost_bound_->set(best_costs_.top());
 }
 
 ContainerBase* Task::stages()
@@ -0,0 +1,90 @@
+#include "models.h"
+
+#include <moveit/task_constructor/stage_p.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <limits>
+#include <random>
+
+// Microbenchmark of priority updates of states in a Connecting stage with |starts| x |ends| pending pairs.
+// Usage: benchmark_connecting [num states per side] [num updates]
+
+using namespace moveit::task_constructor;
+
+namespace {
+
+class ConnectMockup : public Connecting {
+public:
+	ConnectMockup() : Connecting("connect") {}
+	bool compatible(const InterfaceState& /*from*/, const InterfaceState& /*to*/) const override { return true; }
+	void compute(const InterfaceState& /*from*/, const InterfaceState& /*to*/) override {}
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	size_t num_states = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000;
+	size_t num_updates = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100;
+
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<double> cost(0.0, 100.0);
+	std::uniform_int_distribution<size_t> pick(0, num_states - 1);
+
+	planning_scene::PlanningSceneConstPtr scene(new planning_scene::PlanningScene(getModel()));
+	ConnectMockup connect;
+	InterfacePtr starts = connect.pimpl()->starts();
+	InterfacePtr ends = connect.pimpl()->ends();
+
+	// states need a trajectory providing their initial priority
+	std::deque<SubTrajectory> trajectories;
+	std::deque<InterfaceState> start_states, end_states;
+
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < num_states; ++i) {
+		trajectories.emplace_back();
+		trajectories.back().setCost(cost(rng));
+		start_states.emplace_back(scene);
+		trajectories.back().setEndState(start_states.back());
+		starts->add(start_states.back());
+	}
+	for (size_t i = 0; i < num_states; ++i) {
+		trajectories.emplace_back();
+		trajectories.back().setCost(cost(rng));
+		end_states.emplace_back(scene);
+		trajectories.back().setStartState(end_states.back());
+		ends->add(end_states.back());
+	}
+	std::printf("%zu x %zu pending pairs created in %.3f ms\n", num_states, num_states, elapsed(start));
+
+	start = Clock::now();
+	for (size_t i = 0; i < num_updates; ++i) {
+		InterfaceState& state = i % 2 ? start_states[pick(rng)] : end_states[pick(rng)];
+		Interface* owner = i % 2 ? starts.get() : ends.get();
+		owner->updatePriority(&state, InterfaceState::Priority(2, cost(rng)));
+	}
+	std::printf("priority update: %.3f ms\n", elapsed(start) / std::max<size_t>(1, num_updates));
+
+	start = Clock::now();
+	for (size_t i = 0; i < num_updates && i < num_states; ++i)
+		starts->updatePriority(&start_states[i],
+		                       InterfaceState::Priority(2, std::numeric_limits<double>::infinity()));
+	std::printf("failure update: %.3f ms\n", elapsed(start) / std::max<size_t>(1, std::min(num_updates, num_states)));
+
+	start = Clock::now();
+	size_t num_computed = 0;
+	for (; num_computed < num_updates && connect.pimpl()->canCompute(); ++num_computed)
+		connect.pimpl()->compute();
+	std::printf("pop of pending pair: %.3f ms\n", elapsed(start) / std::max<size_t>(1, num_computed));
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+#include <moveit/task_constructor/cost_queue.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Microbenchmarks comparing the indexed ordered<T> with the plain sorted std::list it replaced.
+// Usage: benchmark_cost_queue [max size] [repetitions]
+
+namespace {
+
+struct Item {
+	double cost;
+	bool operator<(const Item& other) const { return cost < other.cost; }
+};
+
+/// reference implementation: sorted std::list with linear upper_bound and find_if
+class ListQueue {
+public:
+	typedef std::list<Item*>::iterator iterator;
+
+	void prepare(std::vector<Item>& /*items*/) {}
+	iterator insert(Item* item) {
+		return c.insert(std::upper_bound(c.begin(), c.end(), item, comp), item);
+	}
+	void update(Item* item) {
+		iterator it = std::find_if(c.begin(), c.end(), [item](const Item* other) { return item == other; });
+		std::list<Item*> temp;
+		temp.splice(temp.end(), c, it);
+		c.splice(std::upper_bound(c.begin(), c.end(), item, comp), temp, it);
+	}
+	Item* pop() { Item* result = c.front(); c.pop_front(); return result; }
+	bool empty() const { return c.empty(); }
+
+private:
+	std::list<Item*> c;
+	ValueOrPointeeLess<Item*> comp;
+};
+
+/// ordered<T> with handles remembered on insertion, as done by Interface for InterfaceStates
+class OrderedQueue {
+public:
+	typedef ordered<Item*>::iterator iterator;
+
+	void prepare(std::vector<Item>& items) {
+		base = items.data();
+		handles.resize(items.size());
+	}
+	iterator insert(Item* item) {
+		iterator it = q.insert(item);
+		handles[item - base] = it;
+		return it;
+	}
+	void update(Item* item) { q.update(handles[item - base]); }
+	Item* pop() { return q.pop(); }
+	bool empty() const { return q.empty(); }
+
+private:
+	ordered<Item*> q;
+	Item* base = nullptr;
+	std::vector<iterator> handles;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed(Clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Timings {
+	double insert = 0.0;
+	double update = 0.0;
+	double pop = 0.0;
+};
+
+template <typename Queue>
+Timings run(size_t n, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> cost(0.0, 100.0);
+	std::uniform_int_distribution<size_t> pick(0, n - 1);
+
+	std::vector<Item> items(n);
+	Queue queue;
+	queue.prepare(items);
+	Timings t;
+
+	Clock::time_point start = Clock::now();
+	for (Item& item : items) {
+		item.cost = cost(rng);
+		queue.insert(&item);
+	}
+	t.insert = elapsed(start);
+
+	start = Clock::now();
+	for (size_t i = 0; i < n; ++i) {
+		Item& item = items[pick(rng)];
+		item.cost = cost(rng);
+		queue.update(&item);
+	}
+	t.update = elapsed(start);
+
+	start = Clock::now();
+	double last = 0.0;
+	while (!queue.empty()) {
+		Item* item = queue.pop();
+		if (item->cost < last) {
+			std::fprintf(stderr, "queue order violated\n");
+			std::exit(EXIT_FAILURE);
+		}
+		last = item->cost;
+	}
+	t.pop = elapsed(start);
+	return t;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	size_t max_size = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16384;
+	unsigned int repetitions = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 3;
+
+	std::printf("%8s  %-8s %12s %12s %12s\n", "size", "queue", "insert [ms]", "update [ms]", "pop [ms]");
+	for (size_t n = 256; n <= max_size; n *= 4) {
+		Timings list, indexed;
+		for (unsigned int r = 0; r < repetitions; ++r) {
+			Timings l = run<ListQueue>(n, r);
+			Timings o = run<OrderedQueue>(n, r);
+			list.insert += l.insert / repetitions;
+			list.update += l.update / repetitions;
+			list.pop += l.pop / repetitions;
+			indexed.insert += o.insert / repetitions;
+			indexed.update += o.update / repetitions;
+			indexed.pop += o.pop / repetitions;
+		}
+		std::printf("%8zu  %-8s %12.3f %12.3f %12.3f\n", n, "list", list.insert, list.update, list.pop);
+		std::printf("%8zu  %-8s %12.3f %12.3f %12.3f\n", n, "ordered", indexed.insert, indexed.update, indexed.pop);
+	}
+	return EXIT_SUCCESS;
+}
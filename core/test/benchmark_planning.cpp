@@ -0,0 +1,263 @@
+#include "models.h"
+
+#include <moveit/task_constructor/task.h>
+#include <moveit/task_constructor/container.h>
+#include <moveit/planning_scene/planning_scene.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic planning benchmarks of the core (containers, interfaces, solution storage), not requiring ROS.
+// Stages are mockups with controllable fan-out and cost distribution, using the mock robot model.
+// Usage: benchmark_planning [fan-out] [depth] [repetitions] [uniform|exponential] [output.json]
+
+using namespace moveit::task_constructor;
+
+namespace {
+
+// heap instrumentation: count allocations and track bytes in use, storing the size in front of each block
+std::atomic<size_t> num_allocations{ 0 };
+std::atomic<size_t> heap_in_use{ 0 };
+std::atomic<size_t> heap_peak{ 0 };
+constexpr size_t HEADER = alignof(std::max_align_t);
+
+void* allocate(size_t size) {
+	char* block = static_cast<char*>(std::malloc(size + HEADER));
+	if (!block)
+		throw std::bad_alloc();
+	*reinterpret_cast<size_t*>(block) = size;
+	++num_allocations;
+	size_t in_use = heap_in_use += size;
+	size_t peak = heap_peak.load();
+	while (in_use > peak && !heap_peak.compare_exchange_weak(peak, in_use))
+		;
+	return block + HEADER;
+}
+
+void deallocate(void* ptr) {
+	if (!ptr)
+		return;
+	char* block = static_cast<char*>(ptr) - HEADER;
+	heap_in_use -= *reinterpret_cast<size_t*>(block);
+	std::free(block);
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	try { return allocate(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	try { return allocate(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { deallocate(ptr); }
+
+namespace {
+
+struct Params {
+	size_t fan_out = 4;  // number of solutions per computation
+	size_t depth = 3;  // number of stages following the generator
+	size_t runs = 10;  // number of generator computations
+	bool exponential = false;  // cost distribution: exponential or uniform
+};
+
+// cost distribution shared by all mockups of a task, seeded for reproducible runs
+class CostSampler {
+public:
+	CostSampler(const Params& params, unsigned int seed) : rng_(seed), exponential_(params.exponential) {}
+	double operator()() { return exponential_ ? exp_(rng_) : uniform_(rng_); }
+
+private:
+	std::mt19937 rng_;
+	bool exponential_;
+	std::uniform_real_distribution<double> uniform_{ 0.0, 2.0 };
+	std::exponential_distribution<double> exp_{ 1.0 };
+};
+
+class GeneratorBench : public Generator {
+	planning_scene::PlanningScenePtr scene_;
+	CostSampler& cost_;
+	size_t runs_;
+	size_t fan_out_;
+
+public:
+	GeneratorBench(CostSampler& cost, size_t runs, size_t fan_out)
+	   : Generator("generator"), cost_(cost), runs_(runs), fan_out_(fan_out) {}
+	void init(const moveit::core::RobotModelConstPtr& robot_model) override {
+		Generator::init(robot_model);
+		scene_.reset(new planning_scene::PlanningScene(robot_model));
+	}
+	bool canCompute() const override { return runs_ > 0; }
+	void compute() override {
+		--runs_;
+		for (size_t i = 0; i < fan_out_; ++i)
+			spawn(InterfaceState(scene_), cost_());
+	}
+};
+
+class PropagatorBench : public PropagatingForward {
+	CostSampler& cost_;
+	size_t fan_out_;
+
+public:
+	PropagatorBench(CostSampler& cost, size_t fan_out) : PropagatingForward("propagator"), cost_(cost), fan_out_(fan_out) {}
+	void computeForward(const InterfaceState& from) override {
+		for (size_t i = 0; i < fan_out_; ++i) {
+			SubTrajectory trajectory;
+			trajectory.setCost(cost_());
+			sendForward(from, InterfaceState(from.scene()), std::move(trajectory));
+		}
+	}
+};
+
+class ConnectBench : public Connecting {
+	CostSampler& cost_;
+
+public:
+	ConnectBench(CostSampler& cost) : Connecting("connect"), cost_(cost) {}
+	void compute(const InterfaceState& from, const InterfaceState& to) override {
+		connect(from, to, SubTrajectory(), cost_());
+	}
+};
+
+struct Result {
+	size_t solutions = 0;
+	double seconds = 0.0;
+	double first_solution = 0.0;  // time to first solution [s]
+	size_t allocations = 0;
+	size_t peak_heap = 0;  // peak heap bytes in use, relative to the start of planning
+};
+
+typedef std::chrono::steady_clock Clock;
+
+// generator followed by depth propagators: exercises SerialContainer::onNewSolution() and Interface
+void serial(Task& t, CostSampler& cost, const Params& p) {
+	t.add(std::make_unique<GeneratorBench>(cost, p.runs, p.fan_out));
+	for (size_t i = 0; i < p.depth; ++i)
+		t.add(std::make_unique<PropagatorBench>(cost, p.fan_out));
+}
+
+// two generators joined by a Connecting stage: exercises pending pairs of Connecting and ordered<T>
+void connecting(Task& t, CostSampler& cost, const Params& p) {
+	t.add(std::make_unique<GeneratorBench>(cost, p.runs, p.fan_out));
+	t.add(std::make_unique<ConnectBench>(cost));
+	t.add(std::make_unique<GeneratorBench>(cost, p.runs, p.fan_out));
+}
+
+// generator followed by depth Alternatives of fan_out propagators: exercises parallel containers
+void alternatives(Task& t, CostSampler& cost, const Params& p) {
+	t.add(std::make_unique<GeneratorBench>(cost, p.runs, p.fan_out));
+	for (size_t i = 0; i < p.depth; ++i) {
+		auto alternatives = std::make_unique<Alternatives>();
+		for (size_t j = 0; j < p.fan_out; ++j)
+			alternatives->insert(std::make_unique<PropagatorBench>(cost, 1));
+		t.add(std::move(alternatives));
+	}
+}
+
+typedef std::function<void(Task&, CostSampler&, const Params&)> Setup;
+
+Result run(const Setup& setup, const Params& params, unsigned int seed) {
+	CostSampler cost(params, seed);
+	Result result;
+	{
+		Task t;
+		t.setRobotModel(getModel());
+		setup(t, cost, params);
+
+		size_t allocations = num_allocations;
+		heap_peak = heap_in_use.load();
+		size_t heap_start = heap_in_use;
+		Clock::time_point start = Clock::now();
+
+		// plan without Task::plan(), which requires ros::init()
+		t.init();
+		while (t.canCompute()) {
+			t.compute();
+			if (result.first_solution == 0.0 && t.numSolutions() > 0)
+				result.first_solution = std::chrono::duration<double>(Clock::now() - start).count();
+		}
+
+		result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		result.solutions = t.numSolutions();
+		result.allocations = num_allocations - allocations;
+		result.peak_heap = heap_peak - heap_start;
+	}
+	return result;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+	Params params;
+	params.fan_out = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : params.fan_out;
+	params.depth = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : params.depth;
+	unsigned int repetitions = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 3;
+	params.exponential = argc > 4 && std::strcmp(argv[4], "exponential") == 0;
+	FILE* json = argc > 5 ? std::fopen(argv[5], "w") : nullptr;
+	if (argc > 5 && !json) {
+		std::fprintf(stderr, "failed to open %s\n", argv[5]);
+		return EXIT_FAILURE;
+	}
+	repetitions = std::max(1u, repetitions);
+
+	const std::vector<std::pair<const char*, Setup>> benchmarks = {
+		{ "serial", serial }, { "connecting", connecting }, { "alternatives", alternatives }
+	};
+
+	std::printf("%-12s %10s %12s %14s %14s %12s %14s\n", "benchmark", "solutions", "time [ms]", "solutions/s",
+	            "first [ms]", "allocations", "peak heap [KiB]");
+	if (json)
+		std::fprintf(json, "[\n");
+	for (size_t b = 0; b < benchmarks.size(); ++b) {
+		// average over repetitions, but report maximum peak memory
+		Result mean;
+		for (unsigned int r = 0; r < repetitions; ++r) {
+			Result result = run(benchmarks[b].second, params, r);
+			mean.solutions = result.solutions;
+			mean.seconds += result.seconds / repetitions;
+			mean.first_solution += result.first_solution / repetitions;
+			mean.allocations += result.allocations / repetitions;
+			mean.peak_heap = std::max(mean.peak_heap, result.peak_heap);
+		}
+		double rate = mean.seconds > 0.0 ? mean.solutions / mean.seconds : 0.0;
+		std::printf("%-12s %10zu %12.3f %14.1f %14.3f %12zu %14zu\n", benchmarks[b].first, mean.solutions,
+		            mean.seconds * 1e3, rate, mean.first_solution * 1e3, mean.allocations, mean.peak_heap / 1024);
+		if (json)
+			std::fprintf(json,
+			             "  {\"benchmark\": \"%s\", \"fan_out\": %zu, \"depth\": %zu, \"distribution\": \"%s\", "
+			             "\"repetitions\": %u, \"solutions\": %zu, \"seconds\": %g, \"solutions_per_second\": %g, "
+			             "\"first_solution_seconds\": %g, \"allocations\": %zu, \"peak_heap_bytes\": %zu}%s\n",
+			             benchmarks[b].first, params.fan_out, params.depth, params.exponential ? "exponential" : "uniform",
+			             repetitions, mean.solutions, mean.seconds, rate, mean.first_solution, mean.allocations,
+			             mean.peak_heap, b + 1 < benchmarks.size() ? "," : "");
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	std::printf("max resident set size: %ld KiB\n", usage.ru_maxrss);
+	if (json) {
+		std::fprintf(json, "]\n");
+		std::fclose(json);
+	}
+	return EXIT_SUCCESS;
+}
@@ -1,4 +1,5 @@
 #include <moveit/task_constructor/task.h>
+#include <moveit/task_constructor/container.h>
 
 #include <moveit/task_constructor/solvers/cartesian_path.h>
 #include <moveit/task_constructor/solvers/pipeline_planner.h>
@@ -16,6 +17,7 @@
 #include <ros/ros.h>
 #include <moveit/planning_scene/planning_scene.h>
 #include <gtest/gtest.h>
+#include <string>
 
 using namespace moveit::task_constructor;
 
@@ -183,6 +185,16 @@ TEST(PA10, pick) {
 	auto solutions = t.solutions().size();
 	EXPECT_GE(solutions, 5u);
 	EXPECT_LE(solutions, 10u);
+
+	// record memory of states and solutions, to compare allocation strategies on real-world tasks
+	size_t state_memory = 0, solution_memory = 0;
+	t.stages()->traverseRecursively([&](const Stage& stage, int) {
+		state_memory += stage.stateMemory();
+		solution_memory += stage.solutionMemory();
+		return true;
+	});
+	RecordProperty("state_memory", std::to_string(state_memory));
+	RecordProperty("solution_memory", std::to_string(solution_memory));
 }
 
 int main(int argc, char** argv){
@@ -1,4 +1,5 @@
 #include <moveit/task_constructor/task.h>
+#include <moveit/task_constructor/container.h>
 
 #include <moveit/task_constructor/stages/current_state.h>
 #include <moveit/task_constructor/stages/generate_grasp_pose.h>
@@ -10,6 +11,7 @@
 #include <ros/ros.h>
 #include <moveit/planning_scene_interface/planning_scene_interface.h>
 #include <gtest/gtest.h>
+#include <string>
 
 using namespace moveit::task_constructor;
 
@@ -83,6 +85,16 @@ TEST(PR2, pick) {
 	auto solutions = t.solutions().size();
 	EXPECT_GE(solutions, 5u);
 	EXPECT_LE(solutions, 10u);
+
+	// record memory of states and solutions, to compare allocation strategies on real-world tasks
+	size_t state_memory = 0, solution_memory = 0;
+	t.stages()->traverseRecursively([&](const Stage& stage, int) {
+		state_memory += stage.stateMemory();
+		solution_memory += stage.solutionMemory();
+		return true;
+	});
+	RecordProperty("state_memory", std::to_string(state_memory));
+	RecordProperty("solution_memory", std::to_string(solution_memory));
 }
 
 int main(int argc, char** argv){
@@ -0,0 +1,290 @@
+#include <moveit/task_constructor/stages/compute_ik_p.h>
+#include <moveit/task_constructor/task.h>
+
+#include <moveit/kinematics_base/kinematics_base.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/robot_model/robot_model.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <geometric_shapes/shapes.h>
+
+#include "models.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+using namespace moveit::task_constructor;
+
+// kinematics solver returning its seed as the only solution, such that IK solutions reflect the sampled seeds
+class SeedSolver : public kinematics::KinematicsBase {
+	std::vector<std::string> joints_ { "joint_f" };
+	std::vector<std::string> links_ { "link_e" };
+
+public:
+	SeedSolver() { setValues("", "mim_joints", "base_link", links_, 0.1); }
+
+	bool supportsGroup(const moveit::core::JointModelGroup*, std::string* = nullptr) const override { return true; }
+	const std::vector<std::string>& getJointNames() const override { return joints_; }
+	const std::vector<std::string>& getLinkNames() const override { return links_; }
+	bool getPositionFK(const std::vector<std::string>&, const std::vector<double>&,
+	                   std::vector<geometry_msgs::Pose>&) const override { return false; }
+
+	bool getPositionIK(const geometry_msgs::Pose& pose, const std::vector<double>& seed, std::vector<double>& solution,
+	                   moveit_msgs::MoveItErrorCodes& error_code,
+	                   const kinematics::KinematicsQueryOptions& = kinematics::KinematicsQueryOptions()) const override {
+		return solve(pose, seed, solution, IKCallbackFn(), error_code);
+	}
+	bool searchPositionIK(const geometry_msgs::Pose& pose, const std::vector<double>& seed, double,
+	                      std::vector<double>& solution, moveit_msgs::MoveItErrorCodes& error_code,
+	                      const kinematics::KinematicsQueryOptions& = kinematics::KinematicsQueryOptions()) const override {
+		return solve(pose, seed, solution, IKCallbackFn(), error_code);
+	}
+	bool searchPositionIK(const geometry_msgs::Pose& pose, const std::vector<double>& seed, double,
+	                      const std::vector<double>&, std::vector<double>& solution,
+	                      moveit_msgs::MoveItErrorCodes& error_code,
+	                      const kinematics::KinematicsQueryOptions& = kinematics::KinematicsQueryOptions()) const override {
+		return solve(pose, seed, solution, IKCallbackFn(), error_code);
+	}
+	bool searchPositionIK(const geometry_msgs::Pose& pose, const std::vector<double>& seed, double,
+	                      std::vector<double>& solution, const IKCallbackFn& callback,
+	                      moveit_msgs::MoveItErrorCodes& error_code,
+	                      const kinematics::KinematicsQueryOptions& = kinematics::KinematicsQueryOptions()) const override {
+		return solve(pose, seed, solution, callback, error_code);
+	}
+	bool searchPositionIK(const geometry_msgs::Pose& pose, const std::vector<double>& seed, double,
+	                      const std::vector<double>&, std::vector<double>& solution, const IKCallbackFn& callback,
+	                      moveit_msgs::MoveItErrorCodes& error_code,
+	                      const kinematics::KinematicsQueryOptions& = kinematics::KinematicsQueryOptions()) const override {
+		return solve(pose, seed, solution, callback, error_code);
+	}
+
+private:
+	bool solve(const geometry_msgs::Pose& pose, const std::vector<double>& seed, std::vector<double>& solution,
+	           const IKCallbackFn& callback, moveit_msgs::MoveItErrorCodes& error_code) const {
+		solution = seed;
+		error_code.val = moveit_msgs::MoveItErrorCodes::SUCCESS;
+		if (callback)
+			callback(pose, solution, error_code);
+		return error_code.val == moveit_msgs::MoveItErrorCodes::SUCCESS;
+	}
+};
+
+// generator spawning a single state with a target_pose for ComputeIK
+class TargetGenerator : public Generator {
+	planning_scene::PlanningScenePtr scene;
+	bool spawned = false;
+public:
+	TargetGenerator() : Generator("target") {}
+	void init(const moveit::core::RobotModelConstPtr& robot_model) override {
+		Generator::init(robot_model);
+		scene.reset(new planning_scene::PlanningScene(robot_model));
+		spawned = false;
+	}
+	bool canCompute() const override { return !spawned; }
+	void compute() override {
+		spawned = true;
+		geometry_msgs::PoseStamped target;
+		target.header.frame_id = scene->getPlanningFrame();
+		tf::poseEigenToMsg(scene->getCurrentState().getGlobalLinkTransform("link_e"), target.pose);
+		InterfaceState state(scene);
+		state.properties().set("target_pose", target);
+		spawn(std::move(state), 0.0);
+	}
+};
+
+// IK solutions (sorted joint_f values) of a task sampling IK with given seed
+std::vector<double> sampleIK(uint32_t seed) {
+	moveit::core::RobotModelPtr model = getModel();
+	model->getJointModelGroup("mim_joints")->setSolverAllocators(
+	      [](const moveit::core::JointModelGroup*) { return std::make_shared<SeedSolver>(); });
+
+	auto ik = std::make_unique<stages::ComputeIK>("ik", std::make_unique<TargetGenerator>());
+	ik->setProperty("group", std::string("mim_joints"));
+	ik->setIKFrame("link_e");
+	ik->setIgnoreCollisions(true);
+	ik->setMaxIKSolutions(5);
+	ik->setMinSolutionDistance(1e-6);
+	ik->setIKSeed(seed);
+	ik->properties().configureInitFrom(Stage::INTERFACE, { "target_pose" });
+
+	Task t;
+	t.setRobotModel(model);
+	t.add(std::move(ik));
+	t.init();
+	while (t.canCompute())
+		t.compute();
+
+	std::vector<double> solutions;
+	for (const auto& s : t.solutions())
+		solutions.push_back(s->end()->scene()->getCurrentState().getVariablePosition("joint_f"));
+	std::sort(solutions.begin(), solutions.end());
+	return solutions;
+}
+
+TEST(ComputeIK, seedDeterminism) {
+	std::vector<double> first = sampleIK(42);
+	ASSERT_EQ(first.size(), 5u);
+	// same seed, same solutions
+	EXPECT_EQ(sampleIK(42), first);
+	// random restarts differ with another seed
+	EXPECT_NE(sampleIK(7), first);
+}
+
+// collision checks of link_d placed in a scene with a box: only its child link_e is checked
+class CollisionCacheTest : public ::testing::Test {
+protected:
+	using CollisionCache = stages::ComputeIK::CollisionCache;
+	planning_scene::PlanningScenePtr scene;
+	const moveit::core::LinkModel* link;
+	stages::ComputeIK stage;  // collecting counters
+
+	void SetUp() override {
+		scene = std::make_shared<planning_scene::PlanningScene>(getModel());
+		link = scene->getRobotModel()->getLinkModel("link_d");
+		scene->getWorldNonConst()->addToObject("box", std::make_shared<shapes::Box>(0.5, 0.5, 0.5),
+		                                       Eigen::Isometry3d(Eigen::Translation3d(3, 0, 0)));
+	}
+	// place link_d such that link_e is centered at (x, y, 0)
+	bool isColliding(CollisionCache& cache, const planning_scene::PlanningSceneConstPtr& scene, double x, double y,
+	                 Stage& stage) {
+		const Eigen::Isometry3d pose(Eigen::Translation3d(x - 0.1, y - 0.1, 0));
+		moveit::core::RobotState state(scene->getCurrentState());
+		state.updateStateWithLinkAt(link, pose);
+		state.updateCollisionBodyTransforms();
+		std::string contacts;
+		return cache.isColliding(scene, state, link, pose, 1e-4, contacts, stage);
+	}
+	// result of a fresh cache, i.e. of the uncached check
+	bool uncached(const planning_scene::PlanningSceneConstPtr& scene, double x, double y) {
+		CollisionCache cache;
+		stages::ComputeIK scratch;
+		return isColliding(cache, scene, x, y, scratch);
+	}
+	size_t counter(const std::string& name) const {
+		auto it = stage.counters().find(name);
+		return it == stage.counters().end() ? 0 : it->second;
+	}
+};
+
+TEST_F(CollisionCacheTest, hitsMatchUncached) {
+	CollisionCache cache;
+	// far away (separated), colliding, and close to the box (not separated by bounding spheres)
+	const std::vector<std::pair<double, double>> poses { { 0, 10 }, { 0, -10 }, { 3, 0 }, { 3, 1.45 } };
+	EXPECT_FALSE(uncached(scene, 0, 10));
+	EXPECT_TRUE(uncached(scene, 3, 0));
+	EXPECT_FALSE(uncached(scene, 3, 1.45));
+
+	for (int pass = 0; pass < 2; ++pass)
+		for (const auto& p : poses)
+			EXPECT_EQ(isColliding(cache, scene, p.first, p.second, stage), uncached(scene, p.first, p.second))
+			      << "pose " << p.first << ", " << p.second << " in pass " << pass;
+	// separated poses share a single miss, other poses miss once
+	EXPECT_EQ(counter("collision_cache_misses"), 3u);
+	EXPECT_EQ(counter("collision_prefilter_hits"), 3u);
+	EXPECT_EQ(counter("collision_cache_hits"), 2u);
+}
+
+TEST_F(CollisionCacheTest, sceneIdentity) {
+	CollisionCache cache;
+	EXPECT_TRUE(isColliding(cache, scene, 3, 0, stage));
+	EXPECT_EQ(counter("collision_cache_misses"), 1u);
+
+	// an unmodified diff shares the cached results
+	planning_scene::PlanningScenePtr same = scene->diff();
+	EXPECT_TRUE(isColliding(cache, same, 3, 0, stage));
+	EXPECT_EQ(counter("collision_cache_hits"), 1u);
+
+	// a moved box doesn't
+	planning_scene::PlanningScenePtr moved = scene->diff();
+	moved->getWorldNonConst()->moveShapeInObject("box", moved->getWorld()->getObject("box")->shapes_[0],
+	                                              Eigen::Isometry3d(Eigen::Translation3d(-3, 0, 0)));
+	EXPECT_EQ(isColliding(cache, moved, 3, 0, stage), uncached(moved, 3, 0));
+	EXPECT_FALSE(isColliding(cache, moved, 3, 0, stage));
+	EXPECT_EQ(counter("collision_cache_misses"), 2u);
+}
+
+TEST(SolutionIndex, matchesBruteForce) {
+	moveit::core::RobotModelPtr model = getModel();
+	// planar base, continuous joint_a, and prismatic joint_c (the only grid axis)
+	const moveit::core::JointModelGroup* jmg = model->getJointModelGroup("base_from_joints");
+	const size_t dim = jmg->getVariableCount();
+	std::mt19937 rng(0);
+	std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+	for (double distance : { 0.0, 0.3, 1.0 }) {
+		stages::ComputeIK::SolutionIndex index;
+		index.reset(jmg, distance);
+		EXPECT_EQ(index.axes.size(), distance > 0.0 ? 1u : 0u);
+
+		std::vector<std::vector<double>> stored;
+		for (int i = 0; i < 500; ++i) {
+			std::vector<double> positions(dim);
+			for (double& p : positions)
+				p = uniform(rng);
+			bool expected = false;
+			for (const std::vector<double>& other : stored)
+				expected = expected || jmg->distance(positions.data(), other.data()) < distance;
+			EXPECT_EQ(index.contains(positions.data()), expected) << "distance " << distance << ", sample " << i;
+			if (!expected) {
+				index.insert(positions.data());
+				stored.push_back(positions);
+			}
+		}
+		EXPECT_EQ(index.size(), stored.size());
+	}
+}
+
+TEST(IKCache, roundTrip) {
+	using IKCache = stages::ComputeIK::IKCache;
+	using Seeds = std::vector<std::vector<double>>;
+	const std::string file = "/tmp/mtc_test_ik_cache_" + std::to_string(getpid());
+	std::remove(file.c_str());
+	auto file_size = [&file]() { return std::ifstream(file, std::ios::binary | std::ios::ate).tellg(); };
+
+	{
+		std::shared_ptr<IKCache> cache = IKCache::get(file);
+		cache->insert(1, { 0.1, 0.2 });
+		cache->insert(1, { 0.3, 0.4 });
+		cache->insert(2, { 0.5 });
+		cache->insert(1, { 0.1, 0.2 });  // duplicates are ignored
+		EXPECT_EQ(IKCache::get(file), cache) << "caches are shared per file";
+	}
+	const auto valid_size = file_size();
+
+	// the released cache is loaded from file again
+	{
+		std::shared_ptr<IKCache> cache = IKCache::get(file);
+		EXPECT_EQ(cache->lookup(1), Seeds({ { 0.1, 0.2 }, { 0.3, 0.4 } }));
+		EXPECT_EQ(cache->lookup(2), Seeds({ { 0.5 } }));
+		EXPECT_TRUE(cache->lookup(3).empty());
+	}
+
+	// append a truncated record, e.g. from a crash while writing
+	{
+		std::ofstream out(file, std::ios::binary | std::ios::app);
+		const uint64_t key = 3;
+		const uint32_t size = 4;
+		const double value = 1.0;
+		out.write(reinterpret_cast<const char*>(&key), sizeof(key));
+		out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+	EXPECT_GT(file_size(), valid_size);
+	{
+		std::shared_ptr<IKCache> cache = IKCache::get(file);
+		EXPECT_TRUE(cache->lookup(3).empty());
+		EXPECT_EQ(cache->lookup(1).size(), 2u);
+		EXPECT_EQ(file_size(), valid_size) << "truncated tail should be dropped";
+		cache->insert(4, { 0.7 });
+	}
+	// records appended after the repair are readable
+	{
+		std::shared_ptr<IKCache> cache = IKCache::get(file);
+		EXPECT_EQ(cache->lookup(4), Seeds({ { 0.7 } }));
+		EXPECT_EQ(cache->lookup(2), Seeds({ { 0.5 } }));
+	}
+	std::remove(file.c_str());
+}
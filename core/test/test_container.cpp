@@ -2,9 +2,18 @@
 #include <moveit/task_constructor/stage_p.h>
 #include <moveit/task_constructor/task.h>
 
+#include <moveit/planning_scene/planning_scene.h>
+#include <geometric_shapes/shapes.h>
+
+#include "models.h"
 #include "gtest_value_printers.h"
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <initializer_list>
+#include <limits>
+#include <list>
+#include <set>
+#include <thread>
 
 using namespace moveit::task_constructor;
 
@@ -536,3 +545,515 @@ TEST(Task, move) {
 	EXPECT_EQ(t1.stages()->numChildren(), 2u);
 	EXPECT_EQ(t2.stages()->numChildren(), 0u);
 }
+
+
+// generator spawning a solution of given cost in its solve_at-th run
+class SolutionMockup : public Generator {
+	planning_scene::PlanningScenePtr scene;
+	int runs;
+	int solve_at;
+	double cost;
+public:
+	int computed = 0;
+
+	SolutionMockup(int runs, int solve_at, double cost)
+	   : Generator("solution"), runs(runs), solve_at(solve_at), cost(cost) {}
+	void init(const moveit::core::RobotModelConstPtr& robot_model) override {
+		Generator::init(robot_model);
+		scene.reset(new planning_scene::PlanningScene(robot_model));
+	}
+	bool canCompute() const override { return computed < runs; }
+	void compute() override {
+		if (++computed == solve_at)
+			spawn(InterfaceState(scene), cost);
+	}
+};
+
+// plan task with the manual planning loop (Task::plan() requires ROS), returning costs of solutions
+std::vector<double> planTask(Task& t) {
+	t.setRobotModel(getModel());
+	t.init();
+	while (t.canCompute())
+		t.compute();
+
+	std::vector<double> costs;
+	for (const auto& s : t.solutions())
+		costs.push_back(s->cost());
+	return costs;
+}
+
+// plan task consisting of container only, returning costs of solutions
+std::vector<double> planContainer(Task& t, ContainerBase::pointer&& container) {
+	t.add(std::move(container));
+	return planTask(t);
+}
+
+TEST(Fallbacks, sequential) {
+	auto fallbacks = std::make_unique<Fallbacks>();
+	SolutionMockup *a, *b;
+	fallbacks->insert(Stage::pointer(a = new SolutionMockup(3, 0, 1.0)));
+	fallbacks->insert(Stage::pointer(b = new SolutionMockup(1, 1, 2.0)));
+
+	Task t;
+	EXPECT_EQ(planContainer(t, std::move(fallbacks)), std::vector<double>({ 2.0 }));
+	EXPECT_EQ(a->computed, 3);
+	EXPECT_EQ(b->computed, 1);
+}
+
+TEST(Fallbacks, speculative) {
+	auto fallbacks = std::make_unique<Fallbacks>();
+	fallbacks->setSpeculationDelay(0.0);
+	SolutionMockup *a, *b, *c;
+	fallbacks->insert(Stage::pointer(a = new SolutionMockup(3, 3, 1.0)));
+	fallbacks->insert(Stage::pointer(b = new SolutionMockup(3, 1, 2.0)));
+	fallbacks->insert(Stage::pointer(c = new SolutionMockup(3, 0, 3.0)));
+
+	// solution of b is held back and c is stopped, solution of a is preferred
+	Task t;
+	EXPECT_EQ(planContainer(t, std::move(fallbacks)), std::vector<double>({ 1.0 }));
+	EXPECT_EQ(a->computed, 3);
+	EXPECT_EQ(b->computed, 3);
+	EXPECT_EQ(c->computed, 1);
+}
+
+TEST(Fallbacks, speculativeFailure) {
+	auto fallbacks = std::make_unique<Fallbacks>();
+	fallbacks->setSpeculationDelay(0.0);
+	SolutionMockup *a, *b;
+	fallbacks->insert(Stage::pointer(a = new SolutionMockup(3, 0, 1.0)));
+	fallbacks->insert(Stage::pointer(b = new SolutionMockup(1, 1, 2.0)));
+
+	// speculatively found solution of b is reported after a failed
+	Task t;
+	EXPECT_EQ(planContainer(t, std::move(fallbacks)), std::vector<double>({ 2.0 }));
+	EXPECT_EQ(a->computed, 3);
+	EXPECT_EQ(b->computed, 1);
+}
+
+TEST(Alternatives, joined) {
+	auto alternatives = std::make_unique<Alternatives>();
+	SolutionMockup *a, *b, *c;
+	alternatives->insert(Stage::pointer(a = new SolutionMockup(1, 1, 3.0)));
+	alternatives->insert(Stage::pointer(b = new SolutionMockup(2, 2, 1.0)));
+	alternatives->insert(Stage::pointer(c = new SolutionMockup(1, 1, 2.0)));
+
+	// solutions of all children are reported
+	Task t;
+	EXPECT_EQ(planContainer(t, std::move(alternatives)), std::vector<double>({ 1.0, 2.0, 3.0 }));
+	EXPECT_EQ(a->computed, 1);
+	EXPECT_EQ(b->computed, 2);
+	EXPECT_EQ(c->computed, 1);
+}
+
+// bookkeeping of a Merger's source state with children's solutions of given costs
+class MergerCombinations : public ::testing::Test {
+protected:
+	using ChildSolutionList = MergerPrivate::ChildSolutionList;
+	GeneratorMockup a, b, c;  // stand-ins for the Merger's children
+	std::list<SubTrajectory> storage;
+	MergerPrivate::SourceSolutions source;
+
+	const SubTrajectory* add(const Stage& child, double cost) {
+		storage.emplace_back();
+		storage.back().setCost(cost);
+		ChildSolutionList& list = source.solutions[child.pimpl()];
+		list.push_back(&storage.back());
+		return &storage.back();
+	}
+	// enumerate combinations including current solution of child, returning the merged ones
+	std::vector<ChildSolutionList> enumerate(const Stage& child, const SubTrajectory* current, uint32_t max_merges = 0,
+	                                        const MergerPrivate::CombinationMerger& merge = {}) {
+		std::vector<ChildSolutionList> merged;
+		MergerPrivate::enumerateCombinations(source, child.pimpl(), current, max_merges,
+		                                     [&](const ChildSolutionList& sub_solutions) {
+			                                     merged.push_back(sub_solutions);
+			                                     return merge ? merge(sub_solutions) : true;
+		                                     });
+		return merged;
+	}
+	static double cost(const ChildSolutionList& sub_solutions) {
+		double result = 0.0;
+		for (const SubTrajectory* s : sub_solutions)
+			result += s->cost();
+		return result;
+	}
+	static bool contains(const ChildSolutionList& sub_solutions, const SubTrajectory* s) {
+		return std::find(sub_solutions.begin(), sub_solutions.end(), s) != sub_solutions.end();
+	}
+};
+
+TEST_F(MergerCombinations, order) {
+	for (double cost : { 1.0, 2.0, 4.0 })
+		add(a, cost);
+	for (double cost : { 10.0, 20.0 })
+		add(b, cost);
+	add(c, 200.0);
+	const SubTrajectory* current = add(c, 100.0);
+
+	// all combinations with the current solution, cheapest first
+	std::vector<double> costs;
+	std::set<ChildSolutionList> unique;
+	for (const auto& combination : enumerate(c, current)) {
+		EXPECT_TRUE(contains(combination, current));
+		costs.push_back(cost(combination));
+		unique.insert(combination);
+	}
+	EXPECT_EQ(costs, std::vector<double>({ 111.0, 112.0, 114.0, 121.0, 122.0, 124.0 }));
+	EXPECT_EQ(unique.size(), 6u);
+	EXPECT_EQ(source.merges, 6u);
+}
+
+TEST_F(MergerCombinations, maxMerges) {
+	for (double cost : { 1.0, 2.0, 3.0 })
+		add(a, cost);
+	const SubTrajectory* first = add(b, 10.0);
+
+	EXPECT_EQ(enumerate(b, first, 2).size(), 2u);
+	EXPECT_EQ(source.merges, 2u);
+
+	// the cap holds per source state, across arriving solutions
+	const SubTrajectory* second = add(b, 20.0);
+	EXPECT_EQ(enumerate(b, second, 2).size(), 0u);
+	EXPECT_EQ(enumerate(b, second, 3).size(), 1u);
+	EXPECT_EQ(source.merges, 3u);
+}
+
+TEST_F(MergerCombinations, countMaterialized) {
+	const SubTrajectory* a1 = add(a, 1.0);
+	add(a, 2.0);
+	add(a, 3.0);
+	const SubTrajectory* current = add(b, 10.0);
+
+	// combinations failing to merge don't count towards max_merges
+	auto materialize = [&](const ChildSolutionList& sub_solutions) { return !contains(sub_solutions, a1); };
+	EXPECT_EQ(enumerate(b, current, 2, materialize).size(), 3u);
+	EXPECT_EQ(source.merges, 2u);
+}
+
+TEST_F(MergerCombinations, conflicts) {
+	const SubTrajectory* a1 = add(a, 1.0);
+	const SubTrajectory* a2 = add(a, 2.0);
+	const SubTrajectory* b1 = add(b, 10.0);
+	const SubTrajectory* b2 = add(b, 20.0);
+	const SubTrajectory* current = add(c, 100.0);
+
+	// pair known from previous merges
+	source.conflicts.insert(std::minmax(a2, b1));
+	// merging detects a1 colliding with the current solution
+	auto detect = [&](const ChildSolutionList& sub_solutions) {
+		if (contains(sub_solutions, a1))
+			source.conflicts.insert(std::minmax(a1, current));
+		return true;
+	};
+
+	// (a1, b1) collides, (a1, b2) and (a2, b1) are never merged
+	std::vector<ChildSolutionList> merged = enumerate(c, current, 0, detect);
+	using Set = std::set<const SubTrajectory*>;
+	ASSERT_EQ(merged.size(), 2u);
+	EXPECT_EQ(Set(merged[0].begin(), merged[0].end()), Set({ a1, b1, current }));
+	EXPECT_EQ(Set(merged[1].begin(), merged[1].end()), Set({ a2, b2, current }));
+	EXPECT_EQ(source.merges, 2u);
+
+	// cached conflicts persist for subsequent solutions
+	const SubTrajectory* other = add(c, 50.0);
+	for (const auto& combination : enumerate(c, other))
+		EXPECT_FALSE(contains(combination, a2) && contains(combination, b1));
+}
+
+// generator spawning a solution per run, with cost of the run index
+class CountingGenerator : public Generator {
+	planning_scene::PlanningScenePtr scene;
+	int runs;
+public:
+	CountingGenerator(int runs) : Generator("counting"), runs(runs) {}
+	void init(const moveit::core::RobotModelConstPtr& robot_model) override {
+		Generator::init(robot_model);
+		scene.reset(new planning_scene::PlanningScene(robot_model));
+	}
+	bool canCompute() const override { return runs > 0; }
+	void compute() override { spawn(InterfaceState(scene), --runs); }
+};
+
+// propagator sending fan_out solutions of costs cost, 2*cost, ... for each input state
+class CostPropagator : public PropagatingForward {
+	double cost;
+	int fan_out;
+public:
+	CostPropagator(double cost, int fan_out) : PropagatingForward("cost"), cost(cost), fan_out(fan_out) {}
+	void computeForward(const InterfaceState& from) override {
+		{
+			Unlocked unlocked(*this);  // allow other stages to compute concurrently
+			std::this_thread::yield();
+		}
+		for (int i = 1; i <= fan_out; ++i) {
+			SubTrajectory trajectory;
+			trajectory.setCost(i * cost);
+			sendForward(from, InterfaceState(from.scene()), std::move(trajectory));
+		}
+	}
+};
+
+// sorted costs of all solutions found by planning with the given number of threads via Task::compute()
+std::vector<double> planThreaded(unsigned int num_threads) {
+	Task t;
+	t.setNumThreads(num_threads);
+	t.add(std::make_unique<CountingGenerator>(3));
+	auto alternatives = std::make_unique<Alternatives>();
+	alternatives->insert(std::make_unique<CostPropagator>(1.0, 2));
+	alternatives->insert(std::make_unique<CostPropagator>(10.0, 1));
+	t.add(std::move(alternatives));
+	t.add(std::make_unique<CostPropagator>(100.0, 2));
+
+	std::vector<double> costs = planTask(t);
+	std::sort(costs.begin(), costs.end());
+	return costs;
+}
+
+TEST(Task, parallelPlanning) {
+	const std::vector<double> serial = planThreaded(1);
+	EXPECT_EQ(serial.size(), 3u * 3u * 2u);
+	// parallel planning via the manual planning loop finds the same solutions
+	for (unsigned int num_threads : { 2u, 4u })
+		EXPECT_EQ(planThreaded(num_threads), serial);
+}
+
+TEST(Task, pruningBound) {
+	Task t;
+	t.setPruning(2);
+	t.add(std::make_unique<CountingGenerator>(4));  // spawns costs 3, 2, 1, 0
+	t.setRobotModel(getModel());
+	t.init();
+
+	// the bound is the cost of the 2nd best solution found so far
+	std::vector<double> bounds;
+	while (t.canCompute()) {
+		t.compute();
+		bounds.push_back(t.stages()->pimpl()->costBound()->value());
+	}
+	const double inf = std::numeric_limits<double>::infinity();
+	EXPECT_EQ(bounds, std::vector<double>({ inf, 3.0, 2.0, 1.0 }));
+
+	t.reset();
+	EXPECT_EQ(t.stages()->pimpl()->costBound()->value(), inf);
+}
+
+// number of solutions after each planning step with the given number of threads
+std::vector<size_t> solutionsPerStep(unsigned int num_threads) {
+	Task t;
+	t.setNumThreads(num_threads);
+	t.add(std::make_unique<CountingGenerator>(1));
+	t.add(std::make_unique<CostPropagator>(1.0, 1));
+	t.setRobotModel(getModel());
+	t.init();
+
+	std::vector<size_t> result;
+	while (t.canCompute()) {
+		t.compute();
+		result.push_back(t.solutions().size());
+	}
+	return result;
+}
+
+TEST(Task, parallelPlanningSteps) {
+	// serially, the propagator processes the generator's state within the same step
+	EXPECT_EQ(solutionsPerStep(1), std::vector<size_t>({ 1 }));
+	// in parallel, children ready for computation are determined before any of them runs
+	EXPECT_EQ(solutionsPerStep(2), std::vector<size_t>({ 0, 1 }));
+}
+
+// generator spawning a state for each of the given costs in a single run
+class FanGenerator : public Generator {
+	planning_scene::PlanningScenePtr scene;
+	std::vector<double> costs;
+public:
+	FanGenerator(std::vector<double> costs, planning_scene::PlanningScenePtr scene = nullptr)
+	  : Generator("fan"), scene(std::move(scene)), costs(std::move(costs)) {}
+	void init(const moveit::core::RobotModelConstPtr& robot_model) override {
+		Generator::init(robot_model);
+		if (!scene)
+			scene.reset(new planning_scene::PlanningScene(robot_model));
+	}
+	bool canCompute() const override { return !costs.empty(); }
+	void compute() override {
+		for (double cost : costs)
+			spawn(InterfaceState(scene), cost);
+		costs.clear();
+	}
+};
+
+TEST(SerialContainer, enumeratePaths) {
+	Task t;
+	t.add(std::make_unique<FanGenerator>(std::vector<double>{ 2.0, 0.0, 1.0 }));
+	t.add(std::make_unique<CostPropagator>(10.0, 2));
+	t.add(std::make_unique<CostPropagator>(100.0, 3));
+
+	std::vector<double> announced;
+	t.stages()->addSolutionCallback([&announced](const SolutionBase& s) { announced.push_back(s.cost()); });
+	std::vector<double> costs = planTask(t);
+
+	std::vector<double> expected;
+	for (double g : { 0.0, 1.0, 2.0 })
+		for (double m : { 10.0, 20.0 })
+			for (double l : { 100.0, 200.0, 300.0 })
+				expected.push_back(g + m + l);
+	std::sort(expected.begin(), expected.end());
+
+	// every full path is lifted exactly once
+	std::sort(costs.begin(), costs.end());
+	EXPECT_EQ(costs, expected);
+	std::set<std::vector<const SubTrajectory*>> paths;
+	for (const auto& s : t.solutions()) {
+		std::vector<const SubTrajectory*> trace;
+		s->visitSubTrajectories([&trace](const SubTrajectory& sub) { trace.push_back(&sub); });
+		EXPECT_EQ(trace.size(), 3u);
+		paths.insert(trace);
+	}
+	EXPECT_EQ(paths.size(), expected.size());
+
+	// paths are lifted best-first
+	EXPECT_EQ(announced.size(), expected.size());
+	EXPECT_TRUE(std::is_sorted(announced.begin(), announced.end()));
+}
+
+TEST(SerialContainer, liftAllCheapestPaths) {
+	Task t;
+	t.add(std::make_unique<FanGenerator>(std::vector<double>{ 2.0, 0.0, 1.0 }));
+	std::vector<double> announced;
+	t.stages()->addSolutionCallback([&announced](const SolutionBase& s) { announced.push_back(s.cost()); });
+	t.setRobotModel(getModel());
+	t.init();
+
+	// a single step announces all full paths, as there are no partial ones left
+	t.compute();
+	EXPECT_EQ(announced, std::vector<double>({ 0.0, 1.0, 2.0 }));
+	EXPECT_FALSE(t.canCompute());
+}
+
+// (depth, cost) priorities of all states in the given interface, sorted
+std::vector<std::pair<unsigned int, double>> priorities(const InterfaceConstPtr& interface) {
+	std::vector<std::pair<unsigned int, double>> result;
+	for (const InterfaceState* state : *interface)
+		result.emplace_back(state->priority().depth(), state->priority().cost());
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+TEST(SerialContainer, statePriorities) {
+	Task t;
+	t.add(std::make_unique<FanGenerator>(std::vector<double>{ 1.0, 0.0 }));
+	t.add(std::make_unique<CostPropagator>(10.0, 2));
+	Stage* connect = new ConnectMockup();  // keeps its start states, never completes a path
+	t.add(Stage::pointer(connect));
+	t.add(std::make_unique<GeneratorMockup>());
+
+	EXPECT_TRUE(planTask(t).empty());
+
+	// states are prioritized by the best partial path through them, as computed by the old traversal
+	using P = std::pair<unsigned int, double>;
+	EXPECT_EQ(priorities(connect->pimpl()->starts()),
+	          std::vector<P>({ P(2, 10.0), P(2, 11.0), P(2, 20.0), P(2, 21.0) }));
+}
+
+TEST(Task, memoryPool) {
+	Task t;
+	t.add(std::make_unique<FanGenerator>(std::vector<double>{ 0.0, 1.0 }));
+	t.add(std::make_unique<CostPropagator>(10.0, 2));
+	EXPECT_EQ(planTask(t).size(), 4u);
+
+	std::weak_ptr<MemoryPool> pool = t.stages()->pimpl()->memoryPool();
+	ASSERT_FALSE(pool.expired());
+	const MemoryPool::Statistics stats = pool.lock()->statistics();
+	RecordProperty("allocations", std::to_string(stats.allocations));
+	RecordProperty("peak_bytes", std::to_string(stats.peak));
+	EXPECT_GT(stats.allocations, 0u);
+	EXPECT_GE(stats.peak, stats.in_use);
+
+	// solutions referenced from outside keep the pool alive
+	SolutionBaseConstPtr solution = t.solutions().front();
+	t.reset();
+	EXPECT_FALSE(pool.expired());
+	solution.reset();
+	EXPECT_TRUE(pool.expired());
+}
+
+TEST(Task, dropSolutions) {
+	Task t;
+	t.add(std::make_unique<FanGenerator>(std::vector<double>{ 0.0, 1.0 }));
+	t.add(std::make_unique<CostPropagator>(10.0, 2));
+	EXPECT_EQ(planTask(t), std::vector<double>({ 10.0, 11.0, 20.0, 21.0 }));
+
+	// each solution is composed of the generator's and the propagator's sub trajectories
+	for (const auto& s : t.solutions()) {
+		size_t count = 0;
+		s->visitSubTrajectories([&count](const SubTrajectory&) { ++count; });
+		EXPECT_EQ(count, 2u);
+	}
+
+	std::set<const SolutionBase*> dropped;
+	EXPECT_EQ(t.stages()->pimpl()->dropSolutions([&dropped](const SolutionBase& s) {
+		if (s.cost() < 15.0)
+			return false;
+		dropped.insert(&s);
+		return true;
+	}),
+	          2u);
+	std::vector<double> costs;
+	for (const auto& s : t.solutions())
+		costs.push_back(s->cost());
+	EXPECT_EQ(costs, std::vector<double>({ 10.0, 11.0 }));
+
+	// dropped solutions are detached from their states
+	for (const auto& s : t.solutions()) {
+		for (const SolutionBase* out : s->start()->outgoingTrajectories())
+			EXPECT_EQ(dropped.count(out), 0u);
+		for (const SolutionBase* in : s->end()->incomingTrajectories())
+			EXPECT_EQ(dropped.count(in), 0u);
+	}
+}
+
+TEST(Task, dropInvalidSolutions) {
+	auto model = getModel();
+	auto scene = std::make_shared<planning_scene::PlanningScene>(model);
+	// only consider collisions with world objects
+	const std::vector<std::string>& links = model->getLinkModelNamesWithCollisionGeometry();
+	scene->getAllowedCollisionMatrixNonConst().setEntry(links, links, true);
+	scene->getWorldNonConst()->addToObject("box", std::make_shared<shapes::Box>(0.1, 0.1, 0.1),
+	                                       Eigen::Isometry3d(Eigen::Translation3d(10, 0, 0)));
+
+	auto plan = [&](Task& t) {
+		t.setRobotModel(model);
+		t.add(std::make_unique<FanGenerator>(std::vector<double>{ 0.0, 1.0 }, scene));
+		t.add(std::make_unique<CostPropagator>(10.0, 2));
+		t.init();
+		while (t.canCompute())
+			t.compute();
+		ASSERT_EQ(t.numSolutions(), 4u);
+	};
+
+	Task t;
+	plan(t);
+	// unchanged scene
+	EXPECT_EQ(t.dropInvalidSolutions(scene), 0u);
+
+	// object moved, but still collision-free
+	auto moved = scene->diff();
+	moved->getWorldNonConst()->moveShapeInObject("box", moved->getWorld()->getObject("box")->shapes_[0],
+	                                             Eigen::Isometry3d(Eigen::Translation3d(0, 10, 0)));
+	EXPECT_EQ(t.dropInvalidSolutions(moved), 0u);
+	EXPECT_EQ(t.numSolutions(), 4u);
+
+	// new object colliding with the robot
+	auto colliding = scene->diff();
+	colliding->getWorldNonConst()->addToObject("obstacle", std::make_shared<shapes::Box>(0.1, 0.1, 0.1),
+	                                           Eigen::Isometry3d::Identity());
+	EXPECT_EQ(t.dropInvalidSolutions(colliding), 4u);
+	EXPECT_EQ(t.numSolutions(), 0u);
+
+	// changed robot state invalidates all solutions, even without collisions
+	Task other;
+	plan(other);
+	auto state_changed = scene->diff();
+	state_changed->getCurrentStateNonConst().setVariablePosition("joint_a", 1.0);
+	EXPECT_EQ(other.dropInvalidSolutions(state_changed), 4u);
+	EXPECT_EQ(other.numSolutions(), 0u);
+}
@@ -151,3 +151,41 @@ TEST_F(CostOrderedTestInt, update) {
 	EXPECT_EQ(queue.top(), first);
 	EXPECT_EQ(*(++queue.begin()), added);
 }
+
+TEST_F(CostOrderedTestInt, reorder) {
+	fill(1, 5);
+	auto it = queue.begin();
+	it->second = 10;
+	queue.update(it);
+	EXPECT_EQ(queue.back().value(), 1);
+	EXPECT_EQ(queue.top().value(), 2);
+
+	// items with same cost keep their relative order
+	it = queue.insert(5, 3);
+	EXPECT_EQ((++++queue.begin())->value(), 5);
+	it->second = 2;
+	queue.update(it);
+	EXPECT_EQ((++queue.begin())->value(), 5);
+
+	queue.erase(it);
+	EXPECT_EQ(queue.size(), 4u);
+	EXPECT_EQ((++queue.begin())->value(), 3);
+}
+
+TEST(Ordered, updateRange) {
+	// several items referring to a shared value, like pending pairs of a Connecting stage
+	int a = 1, b = 2, c = 3;
+	ordered<int*> queue;
+	std::vector<ordered<int*>::iterator> shared { queue.insert(&a) };
+	queue.insert(&b);
+	queue.insert(&c);
+	shared.push_back(queue.insert(&a));
+	EXPECT_EQ(*queue.top(), 1);
+
+	a = 5;
+	queue.update(shared.begin(), shared.end());
+	std::vector<int> actual;
+	while (!queue.empty())
+		actual.push_back(*queue.pop());
+	EXPECT_THAT(actual, ::testing::ElementsAre(2, 3, 5, 5));
+}
@@ -1,5 +1,11 @@
+#include "models.h"
+
 #include <list>
+#include <map>
+#include <set>
 #include <moveit/task_constructor/storage.h>
+#include <moveit/planning_scene/planning_scene.h>
+#include <geometric_shapes/shapes.h>
 #include <gtest/gtest.h>
 
 using namespace moveit::task_constructor;
@@ -17,3 +23,96 @@ TEST(InterfaceStatePriority, compare) {
 	EXPECT_TRUE(Prio(0, 0) < Prio(0, inf));
 	EXPECT_TRUE(Prio(0, inf) > Prio(0, 0));
 }
+
+TEST(InterfaceState, collapseSceneDepth) {
+	const unsigned int max_depth = InterfaceState::maxSceneDepth();
+	InterfaceState::setMaxSceneDepth(3);
+
+	planning_scene::PlanningSceneConstPtr scene(new planning_scene::PlanningScene(getModel()));
+	EXPECT_EQ(InterfaceState(scene).sceneDepth(), 0u);
+
+	// derive a chain of scenes from each other, as stages do
+	size_t deep_footprint = 0;
+	for (unsigned int i = 1; i <= 3; ++i) {
+		InterfaceState state(scene->diff());
+		EXPECT_EQ(state.sceneDepth(), i);
+		deep_footprint = state.sceneFootprint();
+		scene = state.scene();
+	}
+
+	// exceeding the maximum depth collapses the parent chain
+	planning_scene::PlanningScenePtr diff = scene->diff();
+	InterfaceState state(diff);
+	EXPECT_EQ(state.sceneDepth(), 1u);
+	EXPECT_NE(state.scene(), diff);
+	EXPECT_LT(state.sceneFootprint(), deep_footprint);
+
+	InterfaceState::setMaxSceneDepth(max_depth);
+}
+
+TEST(InterfaceState, collapseKeepsDiff) {
+	const unsigned int max_depth = InterfaceState::maxSceneDepth();
+	InterfaceState::setMaxSceneDepth(2);
+
+	shapes::ShapeConstPtr box(new shapes::Box(0.1, 0.1, 0.1));
+	planning_scene::PlanningScenePtr root(new planning_scene::PlanningScene(getModel()));
+	root->getWorldNonConst()->addToObject("removed", box, Eigen::Isometry3d::Identity());
+	root->getWorldNonConst()->addToObject("kept", box, Eigen::Isometry3d::Identity());
+	planning_scene::PlanningSceneConstPtr scene = root;
+	for (unsigned int i = 0; i < 2; ++i)
+		scene = scene->diff();
+
+	// diff exceeding the maximum depth, adding and removing an object
+	planning_scene::PlanningScenePtr diff = scene->diff();
+	diff->getWorldNonConst()->removeObject("removed");
+	diff->getWorldNonConst()->addToObject("added", box, Eigen::Isometry3d(Eigen::Translation3d(1, 0, 0)));
+	InterfaceState state(diff);
+	ASSERT_NE(state.scene(), diff);
+
+	moveit_msgs::PlanningScene msg;
+	state.scene()->getPlanningSceneDiffMsg(msg);
+	std::map<std::string, int8_t> operations;
+	for (const moveit_msgs::CollisionObject& object : msg.world.collision_objects)
+		operations[object.id] = object.operation;
+	EXPECT_EQ(operations, (std::map<std::string, int8_t>{ { "added", moveit_msgs::CollisionObject::ADD },
+	                                                      { "removed", moveit_msgs::CollisionObject::REMOVE } }));
+
+	// collapsed scene has the same objects
+	EXPECT_TRUE(state.scene()->getWorld()->hasObject("kept"));
+	EXPECT_TRUE(state.scene()->getWorld()->hasObject("added"));
+	EXPECT_FALSE(state.scene()->getWorld()->hasObject("removed"));
+
+	InterfaceState::setMaxSceneDepth(max_depth);
+}
+
+TEST(InterfaceState, sceneFingerprint) {
+	planning_scene::PlanningScenePtr scene(new planning_scene::PlanningScene(getModel()));
+	shapes::ShapeConstPtr box(new shapes::Box(0.1, 0.1, 0.1));
+	scene->getWorldNonConst()->addToObject("box", box, Eigen::Isometry3d::Identity());
+	InterfaceState state(scene);
+
+	// derived scenes with identical objects share the fingerprint
+	planning_scene::PlanningScenePtr same = scene->diff();
+	same->getCurrentStateNonConst().setToRandomPositions();
+	EXPECT_EQ(InterfaceState(same).sceneFingerprint(), state.sceneFingerprint());
+	EXPECT_EQ(InterfaceState(state).sceneFingerprint(), state.sceneFingerprint());
+
+	// poses are compared with a tolerance by Connecting, thus moving an object must not change it
+	planning_scene::PlanningScenePtr moved = scene->diff();
+	moved->getWorldNonConst()->moveShapeInObject("box", box, Eigen::Isometry3d(Eigen::Translation3d(5e-4 + 1e-5, 0, 0)));
+	planning_scene::PlanningScenePtr nearby = scene->diff();
+	nearby->getWorldNonConst()->moveShapeInObject("box", box, Eigen::Isometry3d(Eigen::Translation3d(5e-4 - 1e-5, 0, 0)));
+	EXPECT_EQ(InterfaceState(moved).sceneFingerprint(), InterfaceState(nearby).sceneFingerprint());
+
+	// adding an object changes it
+	planning_scene::PlanningScenePtr added = scene->diff();
+	added->getWorldNonConst()->addToObject("other", box, Eigen::Isometry3d::Identity());
+	EXPECT_NE(InterfaceState(added).sceneFingerprint(), state.sceneFingerprint());
+
+	// attaching an object changes it
+	planning_scene::PlanningScenePtr attached = scene->diff();
+	const std::string& link = attached->getRobotModel()->getLinkModelNames().back();
+	attached->getCurrentStateNonConst().attachBody("attached", { box }, { Eigen::Isometry3d::Identity() },
+	                                               std::set<std::string>(), link);
+	EXPECT_NE(InterfaceState(attached).sceneFingerprint(), state.sceneFingerprint());
+}
@@ -0,0 +1,99 @@
+#include "models.h"
+
+#include <moveit/task_constructor/marker_tools.h>
+#include <moveit/task_constructor/storage.h>
+#include <moveit/robot_model/robot_model.h>
+#include <moveit/robot_state/robot_state.h>
+#include <eigen_conversions/eigen_msg.h>
+#include <gtest/gtest.h>
+
+using namespace moveit::task_constructor;
+namespace vm = visualization_msgs;
+
+std::vector<vm::Marker> visualMarkers(const moveit::core::RobotState& state, const std::vector<std::string>& links) {
+	std::vector<vm::Marker> markers;
+	generateVisualMarkers(state, [&markers](vm::Marker& m, const std::string&) { markers.push_back(m); }, links);
+	return markers;
+}
+
+void expectPose(const vm::Marker& marker, const Eigen::Isometry3d& expected) {
+	Eigen::Isometry3d pose;
+	tf::poseMsgToEigen(marker.pose, pose);
+	EXPECT_TRUE(pose.isApprox(expected, 1e-6)) << pose.matrix() << "\nvs.\n" << expected.matrix();
+}
+
+TEST(MarkerTools, linkMarkers) {
+	moveit::core::RobotState state(getModel());
+	state.setToDefaultValues();
+	state.update();
+
+	std::vector<vm::Marker> markers = visualMarkers(state, { "link_a", "link_d" });
+	ASSERT_EQ(markers.size(), 2u);
+	for (const vm::Marker& m : markers) {
+		EXPECT_EQ(m.type, vm::Marker::CUBE);
+		EXPECT_EQ(m.header.frame_id, state.getRobotModel()->getModelFrame());
+	}
+	// marker poses are the link poses composed with the visual's origin
+	const Eigen::Isometry3d origin_d = Eigen::Translation3d(0, 0.1, 0) * Eigen::AngleAxisd(1.0, Eigen::Vector3d::UnitY());
+	expectPose(markers[0], state.getGlobalLinkTransform("link_a"));
+	expectPose(markers[1], state.getGlobalLinkTransform("link_d") * origin_d);
+
+	// modifying generated markers doesn't affect the shared templates
+	generateVisualMarkers(state, [](vm::Marker& m, const std::string&) {
+		m.ns = "modified";
+		m.color.a = 0.0;
+	}, std::vector<std::string>{ "link_a" });
+
+	// templates are instantiated at the current link poses
+	state.setVariablePosition("joint_a", 1.0);
+	state.update();
+	std::vector<vm::Marker> moved = visualMarkers(state, { "link_a", "link_d" });
+	ASSERT_EQ(moved.size(), 2u);
+	expectPose(moved[0], state.getGlobalLinkTransform("link_a"));
+	expectPose(moved[1], state.getGlobalLinkTransform("link_d") * origin_d);
+	for (size_t i = 0; i < moved.size(); ++i) {
+		EXPECT_EQ(moved[i].ns, markers[i].ns);
+		EXPECT_EQ(moved[i].color.a, markers[i].color.a);
+		EXPECT_EQ(moved[i].scale.x, markers[i].scale.x);
+		EXPECT_EQ(moved[i].scale.y, markers[i].scale.y);
+		EXPECT_EQ(moved[i].scale.z, markers[i].scale.z);
+	}
+}
+
+TEST(MarkerTools, linkMarkersOfNewModel) {
+	// templates are not shared with a different model, even if it reuses a freed model's address
+	for (int i = 0; i < 3; ++i) {
+		moveit::core::RobotState state(getModel());
+		state.setToDefaultValues();
+		state.update();
+		std::vector<vm::Marker> markers = visualMarkers(state, { "link_a" });
+		ASSERT_EQ(markers.size(), 1u);
+		EXPECT_EQ(markers[0].header.frame_id, state.getRobotModel()->getModelFrame());
+	}
+}
+
+TEST(SolutionBase, markerGenerators) {
+	SubTrajectory solution;
+	solution.markers().emplace_back();
+	solution.markers().back().ns = "stored";
+
+	size_t calls = 0;
+	solution.addMarkerGenerator([&calls](std::vector<vm::Marker>& markers) {
+		++calls;
+		markers.emplace_back();
+		markers.back().ns = "generated";
+	});
+	EXPECT_EQ(calls, 0u) << "markers should be generated on demand only";
+
+	std::vector<vm::Marker> markers;
+	solution.generateMarkers(markers);
+	EXPECT_EQ(calls, 1u);
+	ASSERT_EQ(markers.size(), 2u);
+	EXPECT_EQ(markers[0].ns, "stored");
+	EXPECT_EQ(markers[1].ns, "generated");
+
+	// generators run on each serialization, appending to existing markers
+	solution.generateMarkers(markers);
+	EXPECT_EQ(calls, 2u);
+	EXPECT_EQ(markers.size(), 4u);
+}
@@ -0,0 +1,42 @@
+#include <moveit/task_constructor/memory_pool.h>
+#include <gtest/gtest.h>
+#include <list>
+#include <string>
+
+using namespace moveit::task_constructor;
+
+TEST(MemoryPool, recycle) {
+	MemoryPool pool;
+	void* first = pool.allocate(40);
+	pool.deallocate(first, 40);
+	// same size class reuses freed block
+	EXPECT_EQ(pool.allocate(48), first);
+	EXPECT_NE(pool.allocate(48), first);
+
+	// large blocks are not served from the pool
+	void* large = pool.allocate(4096);
+	EXPECT_EQ(pool.statistics().in_use, 2u * 48 + 4096);
+	pool.deallocate(large, 4096);
+	EXPECT_EQ(pool.statistics().allocations, 4u);
+	EXPECT_EQ(pool.statistics().peak, 2u * 48 + 4096);
+}
+
+TEST(MemoryPool, allocator) {
+	auto pool = std::make_shared<MemoryPool>(1024);
+	std::weak_ptr<MemoryPool> weak = pool;
+	std::shared_ptr<std::string> shared;
+	{
+		std::list<std::string, PoolAllocator<std::string>> list{PoolAllocator<std::string>(pool)};
+		for (int i = 0; i < 100; ++i)
+			list.push_back(std::to_string(i));
+		EXPECT_EQ(pool->statistics().allocations, 100u);
+		EXPECT_GE(pool->statistics().reserved, 100u * sizeof(std::string));
+		shared = std::allocate_shared<std::string>(PoolAllocator<std::string>(pool), "shared");
+	}
+	// shared objects keep the pool alive
+	pool.reset();
+	EXPECT_FALSE(weak.expired());
+	EXPECT_EQ(*shared, "shared");
+	shared.reset();
+	EXPECT_TRUE(weak.expired());
+}
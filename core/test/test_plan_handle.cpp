@@ -0,0 +1,175 @@
+#include <moveit/task_constructor/task.h>
+#include <moveit/task_constructor/plan_handle.h>
+
+#include <moveit/planning_scene/planning_scene.h>
+#include <moveit/planning_pipeline/planning_pipeline.h>
+#include <geometric_shapes/shapes.h>
+
+#include "models.h"
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <chrono>
+#include <thread>
+
+using namespace moveit::task_constructor;
+
+// generator spawning solutions of decreasing cost (runs-1, ..., 0), sleeping before each one
+// with negative runs, it spawns solutions of cost zero forever
+class SlowGenerator : public Generator {
+	planning_scene::PlanningScenePtr scene;
+	int runs;
+public:
+	SlowGenerator(int runs) : Generator("slow"), runs(runs) {}
+	void init(const moveit::core::RobotModelConstPtr& robot_model) override {
+		Generator::init(robot_model);
+		scene.reset(new planning_scene::PlanningScene(robot_model));
+	}
+	bool canCompute() const override { return runs != 0; }
+	void compute() override {
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		spawn(InterfaceState(scene), runs < 0 ? 0.0 : --runs);
+	}
+};
+
+Task createTask(int runs) {
+	Task t;
+	t.setRobotModel(getModel());
+	t.add(std::make_unique<SlowGenerator>(runs));
+	return t;
+}
+
+TEST(PlanHandle, stream) {
+	Task t = createTask(10);
+	PlanHandlePtr handle = t.planAsync();
+	ASSERT_TRUE(handle->wait(10.0));
+	EXPECT_TRUE(handle->finished());
+	EXPECT_TRUE(handle->success());
+
+	// all solutions are streamed in cost order
+	double last = -1.0;
+	for (int i = 0; i < 10; ++i) {
+		SolutionBaseConstPtr s = handle->next(0.0);
+		ASSERT_TRUE(s);
+		EXPECT_GE(s->cost(), last);
+		last = s->cost();
+	}
+	EXPECT_FALSE(handle->next(0.0));
+	EXPECT_EQ(t.numSolutions(), 10u);
+}
+
+TEST(PlanHandle, waitForSolution) {
+	Task t = createTask(100);
+	PlanHandlePtr handle = t.planAsync();
+
+	// solutions of decreasing cost: 99, 98, ...
+	SolutionBaseConstPtr s = handle->waitForSolution(95.0, 10.0);
+	ASSERT_TRUE(s);
+	EXPECT_LT(s->cost(), 95.0);
+	// peeking doesn't retrieve the solution from the stream
+	SolutionBaseConstPtr first = handle->next(0.0);
+	ASSERT_TRUE(first);
+	EXPECT_LE(first->cost(), s->cost());
+
+	// a cost never reached: returns when planning finished
+	EXPECT_FALSE(handle->waitForSolution(-1.0));
+	EXPECT_TRUE(handle->finished());
+}
+
+TEST(PlanHandle, cancel) {
+	Task t = createTask(-1);
+	PlanHandlePtr handle = t.planAsync();
+	ASSERT_TRUE(handle->next(10.0));
+	EXPECT_FALSE(handle->finished());
+
+	handle->cancel();
+	ASSERT_TRUE(handle->wait(10.0));
+	EXPECT_TRUE(handle->success());
+	// the task is available for planning again
+	EXPECT_TRUE(t.planAsync(1)->wait(10.0));
+}
+
+TEST(PlanHandle, destroyWhilePlanning) {
+	Task t = createTask(-1);
+	PlanHandlePtr handle = t.planAsync();
+	ASSERT_TRUE(handle->waitForSolution(1.0, 10.0));
+	EXPECT_THROW(t.planAsync(), std::runtime_error);
+
+	// destroying the handle cancels planning and waits for it
+	handle.reset();
+	handle = t.planAsync(1);
+	EXPECT_TRUE(handle->wait(10.0));
+	EXPECT_TRUE(handle->success());
+}
+
+TEST(PlanHandle, destroyTaskWhilePlanning) {
+	PlanHandlePtr handle;
+	{
+		Task t = createTask(-1);
+		handle = t.planAsync();
+		ASSERT_TRUE(handle->next(10.0));
+	}
+	// destroying the task cancels planning
+	EXPECT_TRUE(handle->finished());
+}
+
+TEST(Task, resume) {
+	Task t = createTask(10);
+	EXPECT_FALSE(t.resume()) << "resume() requires a previous plan()";
+
+	EXPECT_TRUE(t.plan(3));
+	EXPECT_EQ(t.numSolutions(), 3u);
+	EXPECT_TRUE(t.resume(5));
+	EXPECT_EQ(t.numSolutions(), 5u);
+
+	// unchanged start scene
+	planning_scene::PlanningSceneConstPtr scene = t.solutions().front()->start()->scene();
+	EXPECT_EQ(t.dropInvalidSolutions(scene), 0u);
+	EXPECT_TRUE(t.resume(6));
+	EXPECT_EQ(t.numSolutions(), 6u);
+
+	// stages would continue planning for the old start scene
+	planning_scene::PlanningScenePtr changed = scene->diff();
+	changed->getWorldNonConst()->addToObject("box", std::make_shared<shapes::Box>(0.1, 0.1, 0.1),
+	                                         Eigen::Isometry3d(Eigen::Translation3d(10, 0, 0)));
+	t.dropInvalidSolutions(changed);
+	const size_t remaining = t.numSolutions();
+	EXPECT_FALSE(t.resume());
+	EXPECT_EQ(t.numSolutions(), remaining);
+
+	// planning from scratch is allowed
+	EXPECT_TRUE(t.plan());
+	EXPECT_EQ(t.numSolutions(), 10u);
+	EXPECT_TRUE(t.resume());
+}
+
+TEST(Task, plannerLifetime) {
+	moveit::core::RobotModelConstPtr model = getModel();
+	std::weak_ptr<planning_pipeline::PlanningPipeline> weak;
+	{
+		planning_pipeline::PlanningPipelinePtr planner = Task::createPlanner(model);
+		weak = planner;
+		EXPECT_EQ(Task::createPlanner(model), planner) << "pipelines are shared while used";
+		EXPECT_NE(Task::createPlanner(model, "other_ns"), planner) << "pipelines are cached per namespace";
+	}
+	EXPECT_TRUE(weak.expired()) << "pipelines are not retained by default";
+
+	Task::warmUpPlanners(model);
+	weak = Task::createPlanner(model);
+	EXPECT_FALSE(weak.expired()) << "warmed up pipelines are retained";
+	Task::releasePlanners();
+	EXPECT_TRUE(weak.expired()) << "released pipelines are destroyed with their last user";
+
+	Task::setRetainPlanners(true);
+	weak = Task::createPlanner(model);
+	Task::setRetainPlanners(false);
+	EXPECT_FALSE(weak.expired());
+	Task::releasePlanners();
+	EXPECT_TRUE(weak.expired());
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	ros::init(argc, argv, "test_plan_handle");
+	ros::NodeHandle nh;  // start ros, planning loops run while ros::ok()
+	return RUN_ALL_TESTS();
+}
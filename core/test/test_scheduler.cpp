@@ -0,0 +1,67 @@
+#include <moveit/task_constructor/scheduler.h>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+using namespace moveit::task_constructor;
+
+class SchedulerTest : public ::testing::TestWithParam<unsigned int> {
+protected:
+	// recursively fork 3 jobs per level, counting all calls
+	void fork(Scheduler& scheduler, unsigned int depth) {
+		++count;
+		if (depth == 0) return;
+		std::vector<Scheduler::Job> jobs(3, [this, &scheduler, depth]() { fork(scheduler, depth - 1); });
+		scheduler.parallel(jobs, scheduler.heldLock());
+	}
+	std::atomic<unsigned int> count{0};
+};
+
+TEST_P(SchedulerTest, nested) {
+	Scheduler scheduler(GetParam());
+	Scheduler::Lock lock(scheduler);
+	fork(scheduler, 4);
+	EXPECT_EQ(count.load(), 1u + 3 + 9 + 27 + 81);
+}
+
+TEST_P(SchedulerTest, serialized) {
+	Scheduler scheduler(GetParam());
+	Scheduler::Lock lock(scheduler);
+	unsigned int unprotected = 0;  // jobs hold the scheduler's mutex, thus no atomic required
+	std::vector<Scheduler::Job> jobs(100, [&unprotected]() { ++unprotected; });
+	scheduler.parallel(jobs, lock.get());
+	EXPECT_EQ(unprotected, 100u);
+}
+
+TEST_P(SchedulerTest, exception) {
+	Scheduler scheduler(GetParam());
+	Scheduler::Lock lock(scheduler);
+	std::vector<Scheduler::Job> jobs(10, [this]() { ++count; });
+	jobs[3] = []() { throw std::runtime_error("failed job"); };
+	EXPECT_THROW(scheduler.parallel(jobs, lock.get()), std::runtime_error);
+	// remaining jobs were still processed
+	EXPECT_EQ(count.load(), 9u);
+	EXPECT_TRUE(lock.get().owns_lock());
+}
+
+TEST_P(SchedulerTest, lockRequired) {
+	Scheduler scheduler(GetParam());
+	std::vector<Scheduler::Job> jobs(3, [this]() { ++count; });
+	EXPECT_THROW(scheduler.heldLock(), std::logic_error);
+	std::unique_lock<std::mutex> unlocked(scheduler.mutex(), std::defer_lock);
+	EXPECT_THROW(scheduler.parallel(jobs, unlocked), std::logic_error);
+	EXPECT_EQ(count.load(), 0u);
+
+	Scheduler::Lock lock(scheduler);
+	EXPECT_EQ(&scheduler.heldLock(), &lock.get());
+	// jobs hold their own lock, while the caller's one is released
+	jobs.assign(3, [this, &scheduler, &lock]() {
+		EXPECT_NE(&scheduler.heldLock(), &lock.get());
+		EXPECT_FALSE(lock.get().owns_lock());
+		++count;
+	});
+	scheduler.parallel(jobs, lock.get());
+	EXPECT_EQ(count.load(), 3u);
+	EXPECT_EQ(&scheduler.heldLock(), &lock.get());
+}
+
+INSTANTIATE_TEST_CASE_P(Threads, SchedulerTest, ::testing::Values(1, 2, 4));
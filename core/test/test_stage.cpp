@@ -1,13 +1,20 @@
 #include "models.h"
 
 #include <moveit/task_constructor/stage_p.h>
+#include <moveit/task_constructor/task.h>
+#include <moveit/task_constructor/introspection.h>
+#include <moveit/task_constructor/container.h>
 #include <moveit/task_constructor/stages/compute_ik.h>
+#include <moveit/task_constructor/stages/predicate_filter.h>
 #include <moveit/task_constructor/stages/modify_planning_scene.h>
 #include <moveit/planning_scene/planning_scene.h>
 #include <geometry_msgs/PoseStamped.h>
 
 #include <ros/console.h>
+#include <ros/init.h>
+#include <ros/node_handle.h>
 #include <gtest/gtest.h>
+#include <set>
 
 using namespace moveit::task_constructor;
 using namespace planning_scene;
@@ -37,6 +44,35 @@ public:
 	}
 };
 
+// generator spawning a failure per compute(), alternately commented "even" and "odd"
+class FailureGenerator : public Generator {
+	PlanningScenePtr ps;
+	InterfacePtr prev;
+	InterfacePtr next;
+	size_t count = 0;
+
+public:
+	FailureGenerator() : Generator("failures") {
+		prev.reset(new Interface);
+		next.reset(new Interface);
+		pimpl()->setPrevEnds(prev);
+		pimpl()->setNextStarts(next);
+	}
+
+	void init(const moveit::core::RobotModelConstPtr &robot_model) override {
+		ps.reset((new PlanningScene(robot_model)));
+	}
+
+	bool canCompute() const override { return true; }
+	void compute() override {
+		SubTrajectory trajectory;
+		trajectory.markAsFailure();
+		trajectory.setComment(++count % 2 ? "odd" : "even");
+		spawn(InterfaceState(ps), std::move(trajectory));
+	}
+	const Interface& interface() const { return *next; }
+};
+
 class ConnectMockup : public Connecting {
 public:
 	using Connecting::compatible;
@@ -64,6 +100,81 @@ TEST(Stage, registerCallbacks) {
 	EXPECT_EQ(called, 1u);
 }
 
+TEST(Stage, timings) {
+	GeneratorMockup g;
+	g.init(getModel());
+
+	g.pimpl()->runCompute();
+	g.pimpl()->runCompute();
+	EXPECT_EQ(g.timings().at("compute").count, 2u);
+	EXPECT_EQ(g.timings().at("new_solution").count, 2u);
+	EXPECT_LE(g.timings().at("compute").min, g.timings().at("compute").max);
+	EXPECT_GT(g.stateMemory(), 0u);
+	EXPECT_GT(g.solutionMemory(), 0u);
+
+	{
+		ScopedTimer timer(g.timing("custom"));
+	}
+	EXPECT_EQ(g.timings().at("custom").count, 1u);
+
+	// reset clears statistics, but keeps the sections
+	g.reset();
+	EXPECT_EQ(g.timings().at("compute").count, 0u);
+	EXPECT_EQ(g.timings().at("custom").count, 0u);
+	EXPECT_EQ(g.solutionMemory(), 0u);
+}
+
+TEST(Stage, prune) {
+	GeneratorMockup g;
+	g.init(getModel());
+	g.compute();
+	// spawned states are created together with their solution
+	const SolutionBaseConstPtr& s = *g.solutions().begin();
+	EXPECT_TRUE(s->start()->createdByOutgoing());
+	EXPECT_FALSE(s->start()->createdByIncoming());
+	EXPECT_TRUE(s->end()->createdByIncoming());
+
+	CostBound bound;
+	g.pimpl()->setCostBound(&bound);
+	EXPECT_FALSE(g.pimpl()->prune(1e6));  // no solution yet
+
+	bound.set(10.0);
+	g.setCostLowerBound(2.0);
+	EXPECT_FALSE(g.pimpl()->prune(7.0));
+	EXPECT_TRUE(g.pimpl()->prune(8.0));
+	EXPECT_EQ(g.counters().at("pruned"), 1u);
+}
+
+TEST(Stage, deadline) {
+	GeneratorMockup g;
+	g.setTimeout(10.0);
+	Deadline deadline;
+	g.pimpl()->setDeadline(&deadline);
+	EXPECT_EQ(g.timeout(), 10.0);  // no deadline set
+
+	// remaining time is shared among stages
+	deadline.set(1.0);
+	deadline.setShares(4);
+	EXPECT_FALSE(deadline.expired());
+	EXPECT_LE(g.timeout(), 0.25);
+	EXPECT_GT(g.timeout(), 0.2);
+
+	deadline.set(0.0);
+	EXPECT_TRUE(deadline.expired());
+	EXPECT_EQ(g.timeout(), 0.0);
+
+	deadline.set(std::numeric_limits<double>::infinity());
+	EXPECT_FALSE(deadline.expired());
+	EXPECT_EQ(g.timeout(), 10.0);
+
+	// canceling expires the deadline until it is set again
+	deadline.cancel();
+	EXPECT_TRUE(deadline.expired());
+	EXPECT_EQ(g.timeout(), 0.0);
+	deadline.set(std::numeric_limits<double>::infinity());
+	EXPECT_FALSE(deadline.expired());
+}
+
 TEST(ComputeIK, init) {
 	ros::console::set_logger_level(ROSCONSOLE_ROOT_LOGGER_NAME, ros::console::levels::Fatal);
 
@@ -177,3 +288,183 @@ TEST(Connect, compatible) {
 	attachObject(*other, "object", "base_link", true);
 	EXPECT_FALSE(connect.compatible(scene, other)) << "different pose";
 }
+
+// failures are only stored with introspection
+class FailureRetention : public ::testing::Test {
+protected:
+	Task task;
+	Introspection introspection{ task };
+	FailureGenerator g;
+
+	void SetUp() override {
+		g.init(getModel());
+		g.pimpl()->setIntrospection(&introspection);
+	}
+	void TearDown() override { g.pimpl()->setIntrospection(nullptr); }
+
+	void compute(size_t runs) {
+		for (size_t i = 0; i < runs; ++i)
+			g.compute();
+	}
+	// each spawned failure creates two states
+	size_t numStates() const { return g.stateMemory() / sizeof(InterfaceState); }
+	// all stored failures are attached to their own states
+	void expectAttached() const {
+		for (const auto& f : g.failures()) {
+			ASSERT_EQ(f->start()->outgoingTrajectories().size(), 1u);
+			EXPECT_EQ(f->start()->outgoingTrajectories().front(), f.get());
+			ASSERT_EQ(f->end()->incomingTrajectories().size(), 1u);
+			EXPECT_EQ(f->end()->incomingTrajectories().front(), f.get());
+		}
+	}
+};
+
+TEST_F(FailureRetention, all) {
+	compute(10);
+	EXPECT_EQ(g.numFailures(), 10u);
+	EXPECT_EQ(g.failures().size(), 10u);
+	EXPECT_EQ(numStates(), 20u);
+}
+
+TEST_F(FailureRetention, last) {
+	g.setFailureRetention(Stage::RETAIN_LAST, 3);
+	compute(10);
+	EXPECT_EQ(g.numFailures(), 10u);
+	ASSERT_EQ(g.failures().size(), 3u);
+	// the last failures are kept, in order
+	std::vector<std::string> comments;
+	for (const auto& f : g.failures())
+		comments.push_back(f->comment());
+	EXPECT_EQ(comments, std::vector<std::string>({ "even", "odd", "even" }));
+
+	// states of dropped failures are freed, failure states never enter the interface
+	EXPECT_EQ(numStates(), 6u);
+	EXPECT_EQ(g.interface().size(), 0u);
+	expectAttached();
+
+	g.reset();
+	EXPECT_EQ(g.numFailures(), 0u);
+	EXPECT_EQ(numStates(), 0u);
+}
+
+TEST_F(FailureRetention, lastNone) {
+	g.setFailureRetention(Stage::RETAIN_LAST, 0);
+	compute(5);
+	EXPECT_EQ(g.numFailures(), 5u);
+	EXPECT_TRUE(g.failures().empty());
+	EXPECT_EQ(numStates(), 0u);
+}
+
+TEST_F(FailureRetention, sample) {
+	g.setFailureRetention(Stage::RETAIN_SAMPLE, 4);
+	std::set<const SolutionBase*> seen;
+	for (size_t i = 0; i < 50; ++i) {
+		g.compute();
+		EXPECT_LE(g.failures().size(), 4u);
+		for (const auto& f : g.failures())
+			seen.insert(f.get());
+	}
+	EXPECT_EQ(g.numFailures(), 50u);
+	EXPECT_EQ(g.failures().size(), 4u);
+	EXPECT_GT(seen.size(), 4u) << "sample should be replaced over time";
+
+	EXPECT_EQ(numStates(), 8u);
+	EXPECT_EQ(g.interface().size(), 0u);
+	expectAttached();
+}
+
+TEST_F(FailureRetention, counts) {
+	g.setFailureRetention(Stage::RETAIN_COUNTS);
+	compute(5);
+	EXPECT_EQ(g.numFailures(), 5u);
+	EXPECT_TRUE(g.failures().empty());
+	EXPECT_EQ(g.counters().at("failed: odd"), 3u);
+	EXPECT_EQ(g.counters().at("failed: even"), 2u);
+	EXPECT_EQ(numStates(), 0u);
+}
+
+TEST_F(FailureRetention, callbacks) {
+	// dropped failures are announced nevertheless
+	size_t announced = 0;
+	g.addSolutionCallback([&announced](const SolutionBase& s) { announced += s.isFailure(); });
+	g.setFailureRetention(Stage::RETAIN_COUNTS);
+	compute(5);
+	EXPECT_EQ(announced, 5u);
+}
+
+// generator alternately spawning a failure and a solution of cost 0, 1, ...
+class MixedGenerator : public Generator {
+	PlanningScenePtr ps;
+	int runs;
+	int count = 0;
+
+public:
+	MixedGenerator(int runs) : Generator("mixed"), runs(runs) {}
+	void init(const moveit::core::RobotModelConstPtr& robot_model) override {
+		Generator::init(robot_model);
+		ps.reset(new PlanningScene(robot_model));
+	}
+	bool canCompute() const override { return runs > 0; }
+	void compute() override {
+		--runs;
+		if (++count % 2) {
+			SubTrajectory failure;
+			failure.markAsFailure();
+			spawn(InterfaceState(ps), std::move(failure));
+		} else
+			spawn(InterfaceState(ps), count / 2 - 1);
+	}
+};
+
+TEST(FailureRetention, containers) {
+	Stage* plain = new MixedGenerator(6);
+	Stage* wrapped = new MixedGenerator(6);
+	auto filter = std::make_unique<stages::PredicateFilter>("filter", Stage::pointer(wrapped));
+	filter->setPredicate([](const SolutionBase& s, std::string& comment) { return s.cost() < 1.0; });
+	Stage* filter_ptr = filter.get();
+	auto alternatives = std::make_unique<Alternatives>();
+	Stage* alternatives_ptr = alternatives.get();
+	alternatives->insert(Stage::pointer(plain));
+	alternatives->insert(std::move(filter));
+
+	Task t;
+	t.setRobotModel(getModel());
+	t.enableIntrospection();
+	t.add(std::move(alternatives));
+	for (Stage* stage : { plain, wrapped, filter_ptr, alternatives_ptr })
+		stage->setFailureRetention(Stage::RETAIN_LAST, 1);
+	t.init();
+	while (t.canCompute())
+		t.compute();
+
+	EXPECT_EQ(plain->numFailures(), 3u);
+	EXPECT_EQ(plain->failures().size(), 1u);
+	EXPECT_EQ(wrapped->numFailures(), 3u);
+	EXPECT_EQ(wrapped->failures().size(), 1u);
+	// rejected solutions are lifted as failures
+	EXPECT_EQ(filter_ptr->numFailures(), 2u);
+	EXPECT_EQ(filter_ptr->failures().size(), 1u);
+
+	// all remaining solutions and failures of containers refer to valid sub solutions
+	EXPECT_EQ(t.numSolutions(), 4u);
+	for (Stage* stage : { filter_ptr, alternatives_ptr }) {
+		std::vector<SolutionBaseConstPtr> all(stage->solutions().begin(), stage->solutions().end());
+		all.insert(all.end(), stage->failures().begin(), stage->failures().end());
+		for (const SolutionBaseConstPtr& s : all) {
+			size_t count = 0;
+			s->visitSubTrajectories([&count](const SubTrajectory& sub) {
+				EXPECT_FALSE(sub.isFailure());
+				++count;
+			});
+			EXPECT_EQ(count, 1u);
+		}
+	}
+	t.introspection().publishAllSolutions(false);
+}
+
+int main(int argc, char** argv) {
+	testing::InitGoogleTest(&argc, argv);
+	ros::init(argc, argv, "test_stage");
+	ros::NodeHandle nh;  // introspection advertises its topics
+	return RUN_ALL_TESTS();
+}
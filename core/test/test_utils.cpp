@@ -0,0 +1,43 @@
+#include <moveit/task_constructor/utils.h>
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace moveit::task_constructor;
+
+TEST(LRUCache, eviction) {
+	LRUCache<int, std::string> cache(2);
+	int fills = 0;
+	auto get = [&](int key) {
+		return cache.get(key, [&](std::string& value) {
+			++fills;
+			value = std::to_string(key);
+		});
+	};
+
+	EXPECT_EQ(get(1), "1");
+	EXPECT_EQ(get(2), "2");
+	EXPECT_EQ(fills, 2);
+	EXPECT_EQ(get(1), "1") << "cached";
+	EXPECT_EQ(fills, 2);
+
+	// 2 is least recently used
+	EXPECT_EQ(get(3), "3");
+	EXPECT_EQ(cache.size(), 2u);
+	EXPECT_EQ(get(1), "1");
+	EXPECT_EQ(fills, 3);
+	EXPECT_EQ(get(2), "2") << "evicted entries are filled again";
+	EXPECT_EQ(fills, 4);
+
+	// shrinking evicts the least recently used entries, keeping at least one
+	cache.setCapacity(0);
+	EXPECT_EQ(cache.size(), 1u);
+	EXPECT_EQ(get(2), "2");
+	EXPECT_EQ(fills, 4);
+
+	cache.erase(2);
+	EXPECT_EQ(cache.size(), 0u);
+	EXPECT_EQ(get(2), "2");
+	EXPECT_EQ(fills, 5);
+	cache.clear();
+	EXPECT_EQ(cache.size(), 0u);
+}
@@ -349,10 +349,18 @@ void RemoteTaskModel::processStageDescriptions(const moveit_task_constructor_msg
 	}
 }
 
-void RemoteTaskModel::processStageStatistics(const moveit_task_constructor_msgs::TaskStatistics::_stages_type &msg)
+void RemoteTaskModel::processStageStatistics(const moveit_task_constructor_msgs::TaskStatistics &msg)
 {
+	// deltas can only be applied on top of their predecessor: otherwise wait for next snapshot
+	if (!msg.snapshot && (!statistics_synced_ || msg.seq != statistics_seq_ + 1)) {
+		statistics_synced_ = false;
+		return;
+	}
+	statistics_seq_ = msg.seq;
+	statistics_synced_ = true;
+
 	// iterate over statistics and update node's solutions where needed
-	for (const auto &s : msg) {
+	for (const auto &s : msg.stages) {
 		// find node for stage s, this should always exist
 		auto it = id_to_stage_.find(s.id);
 		if (it == id_to_stage_.end()) {
@@ -360,7 +368,7 @@ void RemoteTaskModel::processStageStatistics(const moveit_task_constructor_msgs:
 			continue;
 		}
 		Node *n = it->second;
-		n->solutions_->processSolutionIDs(s.solved, s.failed, s.num_failed);
+		n->solutions_->processSolutionIDs(s.solved, s.failed, s.num_failed, msg.snapshot);
 
 		// emit notify about model changes when node was already visited
 		if (n->node_flags_ & WAS_VISITED) {
@@ -379,15 +387,19 @@ void RemoteTaskModel::setSolutionData(const moveit_task_constructor_msgs::Soluti
 
 DisplaySolutionPtr RemoteTaskModel::processSolutionMessage(const moveit_task_constructor_msgs::Solution &msg)
 {
-	DisplaySolutionPtr s(new DisplaySolution);
-	s->setFromMessage(scene_->diff(), msg);
-
 	// store sub solution data in model
 	for (const auto& sub : msg.sub_solution)
 		setSolutionData(sub.info);
 	for (const auto& sub : msg.sub_trajectory)
 		setSolutionData(sub.info);
 
+	// light solution messages only provide meta data: fetch full solution via GetSolution when needed
+	if (msg.start_scene.robot_model_name.empty())
+		return DisplaySolutionPtr();
+
+	DisplaySolutionPtr s(new DisplaySolution);
+	s->setFromMessage(scene_->diff(), msg);
+
 	// caching is only enabled for top-level solutions (stage_id == 1)
 	// otherwise we would store PlanningScenes over and over
 	if (!msg.sub_solution.empty() &&
@@ -633,11 +645,14 @@ void RemoteSolutionModel::sortInternal()
 // process solution ids received in stage statistics
 void RemoteSolutionModel::processSolutionIDs(const std::vector<uint32_t> &successful,
                                              const std::vector<uint32_t> &failed,
-                                             size_t num_failed)
+                                             size_t num_failed, bool snapshot)
 {
+	// deltas only know the cost order of new solutions: rank them behind known ones until next snapshot
+	const size_t num_successful = snapshot ? 0 : numSuccessful();
+
 	// append new items to the end of data_
-	processSolutionIDs(successful, true);
-	processSolutionIDs(failed, false);
+	processSolutionIDs(successful, true, num_successful);
+	processSolutionIDs(failed, false, 0);
 
 	// assign consecutive creation ranks
 	uint32_t rank = 0;
@@ -646,18 +661,17 @@ void RemoteSolutionModel::processSolutionIDs(const std::vector<uint32_t> &succes
 
 	// the task may not report failure ids (in failed),
 	// but it may report the overall number of failures
-	num_failed_data_ = failed.size(); // needed to compute number of successes
+	num_failed_data_ = (snapshot ? 0 : num_failed_data_) + failed.size(); // needed to compute number of successes
 	num_failed_ = std::max(num_failed, num_failed_data_);
 
 	sortInternal();
 }
 
-void RemoteSolutionModel::processSolutionIDs(const std::vector<uint32_t> &ids, bool successful)
+void RemoteSolutionModel::processSolutionIDs(const std::vector<uint32_t> &ids, bool successful, uint32_t cost_rank)
 {
 	// ids are ordered by cost, insert them into data_ list sorted by id
 	double default_cost = successful ? std::numeric_limits<double>::quiet_NaN()
 	                                 : std::numeric_limits<double>::infinity();
-	uint32_t cost_rank = 0;
 	for (const uint32_t id : ids) {
 		uint32_t rank = successful ? ++cost_rank : std::numeric_limits<uint32_t>::max();
 		auto it = detail::insert(data_, Data(id, default_cost, rank));
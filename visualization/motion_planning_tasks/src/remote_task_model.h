@@ -58,6 +58,9 @@ class RemoteTaskModel : public BaseTaskModel {
 
 	std::map<uint32_t, Node*> id_to_stage_;
 	std::map<uint32_t, DisplaySolutionPtr> id_to_solution_;
+	// sequence number of last applied statistics message, deltas require their predecessor
+	uint32_t statistics_seq_ = 0;
+	bool statistics_synced_ = false;
 
 	inline Node* node(const QModelIndex &index) const;
 	QModelIndex index(const Node* n) const;
@@ -83,7 +86,7 @@ public:
 
 	QModelIndex indexFromStageId(size_t id) const override;
 	void processStageDescriptions(const moveit_task_constructor_msgs::TaskDescription::_stages_type &msg);
-	void processStageStatistics(const moveit_task_constructor_msgs::TaskStatistics::_stages_type &msg);
+	void processStageStatistics(const moveit_task_constructor_msgs::TaskStatistics &msg);
 	DisplaySolutionPtr processSolutionMessage(const moveit_task_constructor_msgs::Solution &msg);
 
 	QAbstractItemModel* getSolutionModel(const QModelIndex& index) override;
@@ -123,7 +126,7 @@ class RemoteSolutionModel : public QAbstractTableModel {
 	std::vector<DataList::iterator> sorted_;
 
 	inline bool isVisible (const Data& item) const;
-	void processSolutionIDs(const std::vector<uint32_t>& ids, bool successful);
+	void processSolutionIDs(const std::vector<uint32_t>& ids, bool successful, uint32_t cost_rank);
 	void sortInternal();
 
 public:
@@ -139,7 +142,9 @@ public:
 	void sort(int column, Qt::SortOrder order) override;
 
 	void setSolutionData(uint32_t id, float cost, const QString &comment);
-	void processSolutionIDs(const std::vector<uint32_t> &successful, const std::vector<uint32_t> &failed, size_t num_failed);
+	/// process solution ids from stage statistics, either a full snapshot or only new ids
+	void processSolutionIDs(const std::vector<uint32_t> &successful, const std::vector<uint32_t> &failed,
+	                        size_t num_failed, bool snapshot = true);
 };
 
 }
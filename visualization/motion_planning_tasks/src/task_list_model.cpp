@@ -307,7 +307,7 @@ void TaskListModel::processTaskStatisticsMessage(const std::string &id,
 	if (!remote_task || (remote_task->taskFlags() & RemoteTaskModel::IS_DESTROYED))
 		return; // task is not in use anymore
 
-	remote_task->processStageStatistics(msg.stages);
+	remote_task->processStageStatistics(msg);
 }
 
 DisplaySolutionPtr TaskListModel::processSolutionMessage(const std::string &id,
@@ -54,3 +54,18 @@ TEST_F(SolutionModelTest, sorting) {
 	processAndValidate({1,3}, {2});
 	processAndValidate({4,1,6,3}, {5,2});
 }
+
+TEST_F(SolutionModelTest, deltas) {
+	RemoteSolutionModel model;
+	model.processSolutionIDs({1,3}, {2}, 1);
+
+	// deltas only report new ids, which are ranked behind known ones
+	model.processSolutionIDs({6,4}, {5}, 2, false);
+	EXPECT_EQ(model.numFailed(), 2u);
+	EXPECT_EQ(model.numSuccessful(), 4u);
+	validateSorting(model, 1, Qt::AscendingOrder, {1,3,6,4,2,5});
+
+	// a snapshot restores the full cost order
+	model.processSolutionIDs({4,1,6,3}, {5,2}, 2);
+	validateSorting(model, 1, Qt::AscendingOrder, {4,1,6,3,2,5});
+}